@@ -1,675 +1,10145 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // renameat2, syncfs
+#endif
+
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
 
-// Function to create a directory
-int create_directory(const char *path);
+#ifdef __linux__
+#include <linux/fs.h>  // FICLONE
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>  // makedev, for stat data from statx
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <stdint.h>
+#endif
+#endif
+#endif
 
-// Function to write a file
-void write_file(const char *path, const char *content);
+// --io=uring needs the operations and registered-file slots of Linux 5.15 and later headers
+#if defined(IORING_FILE_INDEX_ALLOC) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING
+#endif
 
-// Function to create a .clang-format file
-void create_clang_format(const char *root_dir);
-void create_clang_tidy(const char *root_dir);
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
-// Function to create all the necessary md files
-void create_markdown(const char *root_dir);
+// How initialize_git_repository creates the repository
+typedef enum git_mode {
+    GIT_NATIVE,  // write .git directly from the files generated in memory
+    GIT_SYSTEM,  // shell out to the git binary (git init / add / commit)
+    GIT_NONE,    // no repository
+} git_mode;
 
-// Function to initialize a Git repository and create a .gitignore file
-void initialize_git_repository(const char *path);
+// Where generated projects go
+typedef enum output_mode {
+    OUTPUT_DIRECTORY,   // a directory tree, staged and renamed into place
+    OUTPUT_TAR,         // a ustar stream on stdout; nothing is written to disk
+    OUTPUT_MEMORY,      // a tree of nodes in the project's arena, for 'progen fuzz'
+} output_mode;
 
-// Function to create a LICENSE file with MIT license
-void create_license_file(const char *root_dir);
+// How the directory output makes its file system calls
+typedef enum io_mode {
+    IO_SYNC,    // one call at a time
+    IO_URING,   // queued per project and submitted in batches through io_uring
+} io_mode;
 
-// Function to create the whole project
-void create_project_structure(const char *root_dir, const char *app_dir, const char *lib_dir);
+// Optional library modules, selected with --with=<module>,...
+typedef enum feature {
+    FEATURE_ALLOC,  // arena and pool allocators
+    FEATURE_THREADS,    // work-stealing thread pool
+    FEATURE_SIMD,       // kernels with per-instruction-set variants picked at run time
+    FEATURE_COUNT,
+    FEATURE_WORKSPACE = 31, // not a module: tags the templates of --workspace targets
+} feature;
 
-// Main function
-int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <project> <app> <lib>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
+#define FEATURE_BIT(feature) (1u << (feature))
 
-    const char *project_name = argv[1];
-    const char *app_name = argv[2];
-    const char *lib_name = argv[3];
+// Linkage of the generated library, selected with --lib-kind=<kind>
+typedef enum lib_kind {
+    LIB_STATIC,
+    LIB_SHARED,
+    LIB_HEADER_ONLY,    // a CMake INTERFACE library whose header includes the source
+    LIB_OBJECT,
+    LIB_KIND_COUNT
+} lib_kind;
 
-    // Debug messages
-    printf("Creating project structure for '%s' with app '%s' and library '%s'.\n", project_name, app_name, lib_name);
+// Variables available to templates as {{name}}
+typedef enum template_variable {
+    VAR_PROJECT,    // {{project}}
+    VAR_APP,        // {{app}}
+    VAR_APP_UPPER,  // {{APP}}
+    VAR_LIB,        // {{lib}}
+    VAR_LIB_UPPER,  // {{LIB}}
+    VAR_LIB_SOURCES,    // {{lib_sources}}: CMake source list of the library directory
+    VAR_APP_SOURCES,    // {{app_sources}}
+    VAR_TEST_SOURCES,   // {{test_sources}}: tests/
+    VAR_BENCH_SOURCES,  // {{bench_sources}}: bench/
+    VAR_MODULES,        // {{modules}}: the --with modules, space-separated
+    VAR_LIB_KIND,       // {{lib_kind}}: add_library() type of the --lib-kind, INTERFACE for header-only
+    VAR_SUBDIRECTORIES, // {{subdirectories}}: add_subdirectory() lines of the root CMakeLists.txt
+    VAR_DEPS,           // {{deps}}: direct dependencies of a workspace target, space-separated
+    VAR_LINKS,          // {{links}}: every library a workspace app depends on, directly or not
+    VAR_DEP_INCLUDES,   // {{dep_includes}}: #include lines of the direct dependencies' headers
+    VAR_DEP_CALLS,      // {{dep_calls}}: calls of the direct dependencies' init functions
+    VAR_TEST_LINKS,     // {{test_links}}: what tests and benchmarks link, the library or every workspace library
+    VAR_COUNT
+} template_variable;
 
-    create_project_structure(project_name, app_name, lib_name);
+// Built-in templates, one per generated file
+typedef enum template_id {
+    TEMPLATE_LIB_HEADER,
+    TEMPLATE_LIB_EXPORT,
+    TEMPLATE_LIB_SOURCE,
+    TEMPLATE_TEST_SOURCE,
+    TEMPLATE_APP_SOURCE,
+    TEMPLATE_CMAKE_ROOT,
+    TEMPLATE_CMAKE_LIB,
+    TEMPLATE_CMAKE_APP,
+    TEMPLATE_CMAKE_TESTS,
+    TEMPLATE_CMAKE_BENCH,
+    TEMPLATE_BENCH_HARNESS,
+    TEMPLATE_BENCH_SOURCE,
+    TEMPLATE_CMAKE_PRESETS,
+    TEMPLATE_CMAKE_OPTIMIZATION,
+    TEMPLATE_CMAKE_ACCELERATION,
+    TEMPLATE_CMAKE_BUILD_TYPES,
+    TEMPLATE_CMAKE_PERF_GATE,
+    TEMPLATE_CMAKE_BUILD_PROFILE,
+    TEMPLATE_BUILD_PROFILE_SCRIPT,
+    TEMPLATE_ALLOC_HEADER,      // --with=alloc
+    TEMPLATE_ALLOC_SOURCE,
+    TEMPLATE_ALLOC_TEST,
+    TEMPLATE_ALLOC_BENCH,
+    TEMPLATE_THREADS_HEADER,    // --with=threads
+    TEMPLATE_THREADS_SOURCE,
+    TEMPLATE_THREADS_TEST,
+    TEMPLATE_THREADS_BENCH,
+    TEMPLATE_SIMD_HEADER,       // --with=simd
+    TEMPLATE_SIMD_KERNELS,
+    TEMPLATE_SIMD_SOURCE,
+    TEMPLATE_SIMD_SSE2,
+    TEMPLATE_SIMD_AVX2,
+    TEMPLATE_SIMD_AVX512,
+    TEMPLATE_SIMD_NEON,
+    TEMPLATE_SIMD_TEST,
+    TEMPLATE_SIMD_BENCH,
+    TEMPLATE_WORKSPACE_LIB_HEADER,  // --workspace targets
+    TEMPLATE_WORKSPACE_LIB_SOURCE,
+    TEMPLATE_WORKSPACE_CMAKE_LIB,
+    TEMPLATE_WORKSPACE_LIB_TEST,
+    TEMPLATE_WORKSPACE_LIB_BENCH,
+    TEMPLATE_WORKSPACE_APP_SOURCE,
+    TEMPLATE_WORKSPACE_CMAKE_APP,
+    TEMPLATE_README,
+    TEMPLATE_CONTRIBUTING,
+    TEMPLATE_CODE_OF_CONDUCT,
+    TEMPLATE_CHANGELOG,
+    TEMPLATE_GITIGNORE,
+    TEMPLATE_LICENSE,
+    TEMPLATE_CLANG_FORMAT,
+    TEMPLATE_CLANG_TIDY,
+    TEMPLATE_COUNT
+} template_id;
 
-    printf("Project '%s' with app '%s' and library '%s' created successfully!\n", project_name, app_name, lib_name);
+// Output path and content of a template, both of which may use {{variables}}
+typedef struct template_source {
+    const char *path;
+    const char *content;
+} template_source;
 
-    return EXIT_SUCCESS;
-}
+// One text (path or content) of a template inside a template pack. The segments were split out
+// when the pack was built: 12-byte records of offset, length and variable, so rendering is only
+// a sequence of copies.
+typedef struct template_text {
+    const char *text;               // NUL-terminated, inside the pack or builtin_templates
+    size_t length;
+    const unsigned char *segments;
+    size_t segment_count;
+    size_t literal_length;          // bytes contributed by the literal segments
+} template_text;
 
-// IMPLEMENTATION
+// A template resolved from a pack
+typedef struct pack_template {
+    template_text path;
+    template_text content;
+} pack_template;
 
-int create_directory(const char *path) {
-#ifdef _WIN32
-    return mkdir(path);
-#else
-    return mkdir(path, 0755);
+// Templates in effect for a run: the embedded pack, with entries replaced or added by --templates
+typedef struct template_set {
+    pack_template builtin[TEMPLATE_COUNT];
+    pack_template *extra;           // pack entries without a built-in counterpart
+    size_t extra_count;
+} template_set;
+
+// Growable byte buffer
+typedef struct byte_buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+} byte_buffer;
+
+// Block of the per-project arena that rendered text is allocated from
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block;
+
+// Phases recorded by --trace
+typedef enum trace_phase {
+    TRACE_PROJECT,      // create_project_structure, end to end
+    TRACE_STAGING,
+    TRACE_DIRECTORY,
+    TRACE_RENDER,
+    TRACE_WRITE,
+    TRACE_MARKDOWN,
+    TRACE_LICENSE,
+    TRACE_MANIFEST,
+    TRACE_GIT,
+    TRACE_PUBLISH,
+    TRACE_PHASE_COUNT
+} trace_phase;
+
+// One timed span of a project's generation
+typedef struct trace_event {
+    trace_phase phase;
+    const char *detail;     // path or project name; must stay valid until the context is freed
+    long long start;        // nanoseconds, monotonic
+    long long duration;
+} trace_event;
+
+// Command-line options shared by every project generated in one invocation
+typedef struct options {
+    const char *manifest_path;  // --manifest <file>: generate every project listed in the file
+    const char *workspace_path; // --workspace <file>: generate one project with the libraries and apps of a spec
+    long jobs;                  // --jobs <n>: worker threads for manifest mode (0 = one per core)
+    git_mode git;               // --git=native|system|none
+    output_mode output;         // --output=dir|tar
+    io_mode io;                 // --io=sync|uring
+    int durable;                // --durable: sync the finished tree once before publishing it
+    const char *store_path;     // --store <dir>: share files that are identical in every project
+    const char *templates_path; // --templates <pack>: template pack replacing or adding templates
+    const char *trace_path;     // --trace=<file>: write a Chrome trace of every generation phase
+    unsigned int features;      // --with=<module>,...: FEATURE_BIT set of optional library modules
+    lib_kind lib_kind;          // --lib-kind=static|shared|header-only|object
+    const template_set *templates;  // templates in effect, resolved by load_templates
+    const char *positional[3];  // <project> <app> <lib>
+    int positional_count;
+} options;
+
+// A file generated for the project, kept in memory so the repository can be written without rereading it
+typedef struct generated_file {
+    const char *path;       // relative to the project root, '/'-separated
+    const char *content;    // static template text or arena memory, valid as long as the context
+    size_t length;
+    struct stat info;   // stat data recorded right after writing, for the git index
+    unsigned char blob_id[20];  // git blob id of the content, once hashed
+    int hashed;
+} generated_file;
+
+// Counters of what a generation did
+typedef struct generation_stats {
+    size_t directories_created;
+    size_t files_written;
+    size_t bytes_written;
+    size_t shared_reflinks;     // files materialized from the --store by reflink
+    size_t shared_hardlinks;    // ... by hardlink
+    size_t shared_copies;       // ... by plain copy, when neither link kind works
+    size_t shared_bytes;        // bytes whose data blocks are shared with a store object that already existed
+    size_t shared_inodes;       // hardlinks to a store object that already existed, each saving an inode
+    size_t syscalls;            // file system calls issued for the project (not counting child processes)
+} generation_stats;
+
+// A library or app of a workspace spec
+typedef struct workspace_target {
+    const char *name;           // points into the spec text
+    int is_app;
+    int line;                   // spec line it was declared on, for messages
+    size_t first_dependency;    // direct dependencies: workspace.dependencies[first_dependency...]
+    size_t dependency_count;
+} workspace_target;
+
+// A parsed and validated workspace spec (--workspace)
+typedef struct workspace {
+    char *source;           // the spec as read; copied into the project for 'progen update'
+    size_t source_length;
+    char *text;             // copy of the spec, split into names in place
+    const char *project;
+    workspace_target *targets;  // in spec order
+    size_t target_count;
+    size_t *dependencies;   // target indices
+    size_t dependency_count;
+    size_t *order;          // target indices, every target after the ones it depends on
+} workspace;
+
+// File or directory of the in-memory output (OUTPUT_MEMORY)
+typedef struct memory_node {
+    const char *name;
+    const char *data;               // NULL for a directory
+    size_t length;
+    struct memory_node *children;   // first entry of a directory
+    struct memory_node *next;       // next entry of the same directory
+} memory_node;
+
+// Per-project generation state. Each project owns one, so batch workers share nothing mutable.
+typedef struct project_context {
+    const options *opts;
+    const char *root_dir;
+    const char *project_name;   // {{project}}; the root directory unless an update says otherwise
+    const char *app_dir;
+    const char *lib_dir;
+    unsigned int features;  // optional modules; from the options, or the manifest on update
+    lib_kind lib_kind;      // likewise
+    const workspace *workspace; // targets of a --workspace project, NULL for a single library and app
+    int render_only;        // record files in memory without touching the disk, for 'progen update'
+    char *staging_path;     // hidden directory the project is generated in before the final rename
+    int root_fd;            // open descriptor of staging_path; every path below is relative to it
+    byte_buffer tar;        // --output=tar: the project's members, written to stdout in one piece once complete
+    unsigned long long *directories;    // tar and io_uring: hashes of the directories created so far
+    size_t directory_count;
+    size_t directory_capacity;
+    memory_node *memory_root;   // OUTPUT_MEMORY: the project's root directory
+    struct io_ring *ring;   // --io=uring: directory creations and writes waiting to be submitted
+    generation_stats stats;
+    const char *variables[VAR_COUNT];   // template variable values
+    size_t variable_lengths[VAR_COUNT];
+    arena_block *arena;     // rendered paths and contents, released with the context
+    arena_block *spare_arena;   // empty blocks to use before allocating new ones ('progen serve' workers)
+    generated_file *files;  // every file written so far
+    size_t file_count;
+    size_t file_capacity;
+    int trace_lane;         // thread id of the project's events in the trace
+    trace_event *trace_events;  // spans recorded under --trace, flushed when the context is freed
+    size_t trace_count;
+    size_t trace_capacity;
+} project_context;
+
+// One manifest entry and the outcome of generating it
+typedef struct manifest_job {
+    const char *project;
+    const char *app;
+    const char *lib;
+    int status;
+    generation_stats stats;
+} manifest_job;
+
+// Work queue shared by the manifest workers; each worker claims the next unclaimed job
+typedef struct job_queue {
+    const options *opts;
+    manifest_job *jobs;
+    size_t count;
+    size_t next;
+    int workers_started;    // numbers the workers, as trace thread ids
+#ifndef _WIN32
+    pthread_mutex_t lock;
 #endif
-}
+} job_queue;
 
-void write_file(const char *path, const char *content) {
-    FILE *file = fopen(path, "w");
-    if (file == NULL) {
-        perror("Error opening file");
-        exit(EXIT_FAILURE);
-    }
-    fprintf(file, "%s", content);
-    fclose(file);
-}
+// Function to parse the command line into options
+int parse_options(int argc, char *argv[], options *opts);
 
-void create_markdown(const char *root_dir) {
-    // README.md
-    char path[512];
-    snprintf(path, sizeof(path), "%s/README.md", root_dir);
-    char readme_content[4096];
-    snprintf(readme_content, sizeof(readme_content),
-             "# %s\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## 🗨️ PRESENTATION\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## 🖥️ SUPPORTED PLATFORMS\n"
-             "\n"
-             "- [ ] Windows\n"
-             "- [ ] Linux\n"
-             "- [ ] macOS\n"
-             "- [ ] Web\n"
-             "- [ ] iOS\n"
-             "- [ ] Android\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## ✅ PREREQUISITES\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## ❓ HOW TO USE\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## 📋 TODO\n"
-             "\n"
-             "---\n"
-             "\n"
-             "## ↩️ REFERENCES\n",
-             root_dir);
-    write_file(path, readme_content);
+// Function to print the usage message
+void print_usage(const char *program);
 
-    // Create additional markdown files
-    // CONTRIBUTING.md
-    snprintf(path, sizeof(path), "%s/CONTRIBUTING.md", root_dir);
-    char contributing_content[4096];
-    snprintf(contributing_content, sizeof(contributing_content),
-             "# Contributing to %s\n"
-             "\n"
-             "## How to Contribute\n"
-             "\n"
-             "We welcome contributions to this project! Here are a few ways you can help:\n"
-             "\n"
-             "1. **Report Bugs**: If you find a bug, please open an issue on our GitHub repository.\n"
-             "2. **Suggest Features**: If you have an idea for a new feature, let us know by opening an issue or a pull request.\n"
-             "3. **Contribute Code**: Fork the repository, make your changes, and submit a pull request. Please ensure that your code follows our coding standards and includes appropriate tests.\n"
-             "\n"
-             "## Coding Standards\n"
-             "\n"
-             "- Use descriptive variable names.\n"
-             "- Write clear and concise comments.\n"
-             "- Follow the coding style outlined in our `.clang-format` file.\n"
-             "\n"
-             "## Testing\n"
-             "\n"
-             "Please ensure that all tests pass before submitting a pull request. To run the tests, use:\n"
-             "\n"
-             "```bash\n"
-             "cd build\n"
-             "cmake ..\n"
-             "make\n"
-             "ctest\n"
-             "```\n"
-             "\n"
-             "## Code Review\n"
-             "\n"
-             "All pull requests will be reviewed by the project maintainers. We may request changes before merging your pull request.\n"
-             "\n"
-             "Thank you for contributing!\n",
-             root_dir);
-    write_file(path, contributing_content);
+// Function to parse a comma-separated --with module list into FEATURE_BITs
+int parse_features(const char *list, unsigned int *features);
 
-    // CODE_OF_CONDUCT.md
-    snprintf(path, sizeof(path), "%s/CODE_OF_CONDUCT.md", root_dir);
-    char code_of_conduct_content[4096];
-    snprintf(code_of_conduct_content, sizeof(code_of_conduct_content),
-             "# Code of Conduct\n"
-             "\n"
-             "## Our Pledge\n"
-             "\n"
-             "We as members, contributors, and maintainers pledge to make participation in our project and our community a harassment-free experience for everyone, regardless of age, body size, disability, ethnicity, sex characteristics, gender identity and expression, level of experience, education, socio-economic status, nationality, personal appearance, race, religion, or sexual identity and orientation.\n"
-             "\n"
-             "## Our Standards\n"
-             "\n"
-             "Examples of behavior that contributes to creating a positive environment include:\n"
-             "\n"
-             "- Using welcoming and inclusive language\n"
-             "- Being respectful of differing viewpoints and experiences\n"
-             "- Gracefully accepting constructive criticism\n"
-             "- Focusing on what is best for the community\n"
-             "- Showing empathy towards other community members\n"
-             "\n"
-             "## Enforcement\n"
-             "\n"
-             "Instances of abusive, harassing, or otherwise unacceptable behavior may be reported by contacting the project team at [your email]. All complaints will be reviewed and investigated promptly and fairly.\n"
-             "\n"
-             "## Attribution\n"
-             "\n"
-             "This Code of Conduct is adapted from the Contributor Covenant (http://contributor-covenant.org), version 1.4.\n");
-    write_file(path, code_of_conduct_content);
+// Function to parse a --lib-kind name
+int parse_lib_kind(const char *name, lib_kind *kind);
 
-    // CHANGELOG.md
-    snprintf(path, sizeof(path), "%s/CHANGELOG.md", root_dir);
-    char changelog_content[4096];
-    snprintf(changelog_content, sizeof(changelog_content),
-             "# Changelog\n"
-             "\n"
-             "## [Unreleased]\n"
-             "\n"
-             "### Added\n"
-             "- Initial project setup with CMake, Git, and documentation.\n"
-             "\n"
-             "### Changed\n"
-             "- Added testing framework integration with CTest.\n"
-             "\n"
-             "## [1.0.0] - YYYY-MM-DD\n"
-             "\n"
-             "### Added\n"
-             "- First stable release of the project.\n");
-    write_file(path, changelog_content);
-}
-
-void initialize_git_repository(const char *path) {
-    char command[512];
-
-    // Define the content of the .gitignore file
-    const char *gitignore_content =
-        "# Ignore specific directories\n"
-        ".vs/\n"
-        ".vscode/\n"
-        ".cache/\n"
-        "[Bb]in/\n"
-        "[Oo]bj/\n"
-        "[Tt]mp/\n"
-        "[Bb]uild/\n"
-        "[Cc]ache/\n"
-        "\n"
-        "# Ignore executable files\n"
-        "*.exe\n"
-        "*.out\n"
-        "*.app\n"
-        "*.dmg\n"
-        "*.pkg\n"
-        "\n"
-        "# Ignore object files\n"
-        "*.o\n"
-        "*.obj\n"
-        "*.a\n"
-        "*.so\n"
-        "*.lib\n"
-        "*.dll\n"
-        "\n"
-        "# Optional: Ignore other common temporary files\n"
-        "*.log\n"
-        "*.tmp\n"
-        "*.swp\n"
-        "*.swo\n"
-        "*.bak\n"
-        "*.backup\n";
+// Function to prepare a project context
+void init_project_context(project_context *ctx, const options *opts,
+                          const char *root_dir, const char *app_dir, const char *lib_dir);
 
-    // Write the .gitignore file
-    char gitignore_path[512];
-    snprintf(gitignore_path, sizeof(gitignore_path), "%s/.gitignore", path);
-    write_file(gitignore_path, gitignore_content);
+// Function to release everything a project context owns
+void free_project_context(project_context *ctx);
 
-    // Initialize Git repository
-    snprintf(command, sizeof(command), "cd %s && git init -b master", path);
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error initializing Git repository.\n");
-        exit(EXIT_FAILURE);
-    }
+// Function to accumulate generation counters
+void add_generation_stats(generation_stats *total, const generation_stats *stats);
 
-    // Add all files to Git, including .gitignore
-    snprintf(command, sizeof(command), "cd %s && git add .", path);
-    result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error adding files to Git repository.\n");
-        exit(EXIT_FAILURE);
-    }
+// Function to report what the --store saved
+void print_store_summary(const options *opts, const generation_stats *stats);
 
-    // Optionally commit the initial state
-    snprintf(command, sizeof(command), "cd %s && git commit -m \"Initial commit\"", path);
-    result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error committing files to Git repository.\n");
-        exit(EXIT_FAILURE);
-    }
-}
+// Function to start writing the --trace file
+int open_trace(const char *path);
 
-void create_license_file(const char *root_dir) {
-    char path[512];
-    snprintf(path, sizeof(path), "%s/LICENSE", root_dir);
+// Function to append a project's recorded spans to the trace file
+void flush_trace(project_context *ctx);
 
-    // Define the license content
-    const char *license_content =
-        "MIT License\n"
-        "\n"
-        "Copyright (c) 2024 ItsJustGalileo\n"
-        "\n"
-        "Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the \"Software\"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, subject to the following conditions:\n"
-        "\n"
-        "1. The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.\n"
-        "\n"
-        "2. THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.\n";
+// Function to finish the trace file and print the per-phase summary
+int close_trace(void);
 
-    // Write the LICENSE file
-    write_file(path, license_content);
-}
+// Function to generate every project listed in a manifest file using a worker pool
+int run_manifest(const options *opts);
 
-void create_project_structure(const char *root_dir, const char *app_dir, const char *lib_dir) {
-    char path[512];
-    char LIB_DIR[512], APP_DIR[512];
+// Function to read a workspace spec and check its names and dependency graph
+int load_workspace(const char *path, workspace *ws);
 
-    if (strlen(lib_dir) >= sizeof(LIB_DIR) || strlen(app_dir) >= sizeof(APP_DIR)) {
-        fprintf(stderr, "Directory name too long.\n");
-        exit(EXIT_FAILURE);
-    }
+// Function to release a workspace spec
+void free_workspace(workspace *ws);
 
-    // Convert directories to uppercase
-    strncpy(LIB_DIR, lib_dir, sizeof(LIB_DIR) - 1);
-    LIB_DIR[sizeof(LIB_DIR) - 1] = '\0';
-    for (size_t i = 0; i < strlen(LIB_DIR); ++i) {
-        LIB_DIR[i] = toupper(LIB_DIR[i]);
-    }
+// Function to generate the project described by a workspace spec
+int run_workspace(const options *opts);
 
-    strncpy(APP_DIR, app_dir, sizeof(APP_DIR) - 1);
-    APP_DIR[sizeof(APP_DIR) - 1] = '\0';
-    for (size_t i = 0; i < strlen(APP_DIR); ++i) {
-        APP_DIR[i] = toupper(APP_DIR[i]);
-    }
+// Function to send generated projects to stdout as a tar stream instead of writing them to disk
+int open_tar_output(void);
 
-    // Create root directory
-    if (create_directory(root_dir) != 0) {
-        perror("Error creating root directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to add a file, or a directory when data is NULL, to the project's tar members
+int append_tar_member(project_context *ctx, const char *path, const void *data, size_t length);
 
-    // Create subdirectories
-    snprintf(path, sizeof(path), "%s/%s", root_dir, lib_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating library directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to end the tar stream
+int close_tar_output(void);
 
-    snprintf(path, sizeof(path), "%s/%s", root_dir, app_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating application directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to create the hidden staging directory the project is generated in
+int begin_staging(project_context *ctx);
 
-    // Create CMake and Docs directories
-    snprintf(path, sizeof(path), "%s/CMake", root_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating CMake directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to move the finished staging directory to its final name
+int publish_staging(project_context *ctx);
 
-    snprintf(path, sizeof(path), "%s/CMake/Modules", root_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating CMake Modules directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to delete a staging directory after a failed generation
+void discard_staging(project_context *ctx);
 
-    snprintf(path, sizeof(path), "%s/CMake/Toolchains", root_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating CMake Toolchains directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to create a directory relative to the project root, without bookkeeping
+int make_directory_at(project_context *ctx, const char *path);
 
-    snprintf(path, sizeof(path), "%s/docs", root_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating docs directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to write raw bytes to a file relative to the project root, without bookkeeping
+int write_bytes_at(project_context *ctx, const char *path, const void *data, size_t length,
+                   struct stat *info);
 
-    snprintf(path, sizeof(path), "%s/tests", root_dir);
-    if (create_directory(path) != 0) {
-        perror("Error creating tests directory");
-        exit(EXIT_FAILURE);
-    }
+// Function to tell whether --io=uring works on this system; sets errno when it does not
+int io_uring_available(void);
 
-    // Create library header and source files
-    snprintf(path, sizeof(path), "%s/%s/%s.h", root_dir, lib_dir, lib_dir);
-    char lib_header_content[512];
-    snprintf(lib_header_content, sizeof(lib_header_content),
-             "#ifndef %s_H_\n"
-             "#define %s_H_\n"
-             "\n"
-             "void hello(void);\n"
-             "\n"
-             "#endif // !%s_H_\n",
-             LIB_DIR, LIB_DIR, LIB_DIR);
-    write_file(path, lib_header_content);
-
-    snprintf(path, sizeof(path), "%s/%s/%s.c", root_dir, lib_dir, lib_dir);
-    char lib_source_content[512];
-    snprintf(lib_source_content, sizeof(lib_source_content),
-             "#include <stdio.h>\n"
-             "#include \"%s.h\"\n"
-             "\n"
-             "void hello(void) {\n"
-             "    puts(\"hello!\");\n"
-             "}\n",
-             lib_dir);
-    write_file(path, lib_source_content);
-
-    snprintf(path, sizeof(path), "%s/tests/test.c", root_dir);
-    char test_source_content[512];
-    snprintf(test_source_content, sizeof(lib_source_content),
-             "#include <stdio.h>\n"
-             "#include \"%s.h\"\n"
-             "\n"
-             "void hello(void) {\n"
-             "    puts(\"hello!\");\n"
-             "}\n",
-             lib_dir);
-    write_file(path, test_source_content);
+// Function to submit the directory creations and writes queued by --io=uring and wait for them
+int flush_queued_writes(project_context *ctx);
 
-    // Create app source file
-    snprintf(path, sizeof(path), "%s/%s/%s.c", root_dir, app_dir, app_dir);
-    char app_source_content[512];
-    snprintf(app_source_content, sizeof(app_source_content),
-             "#include \"%s/%s.h\"\n"
-             "\n"
-             "int main(void) {\n"
-             "    hello();\n"
-             "    return 0;\n"
-             "}\n",
-             lib_dir, lib_dir);
-    write_file(path, app_source_content);
+// Function to release a project's io_uring queue
+void close_io_ring(project_context *ctx);
 
-    // Create CMakeLists.txt files
+// Function to create a directory (path relative to the project root)
+int create_directory(project_context *ctx, const char *path);
 
-    // Root CMakeLists.txt
-    snprintf(path, sizeof(path), "%s/CMakeLists.txt", root_dir);
-    char cmake_root_content[4096];
-    snprintf(cmake_root_content, sizeof(cmake_root_content),
-             "cmake_minimum_required(VERSION 3.26)\n"
-             "\n"
-             "set(CMAKE_C_STANDARD 11)\n"
-             "set(CMAKE_C_STANDARD_REQUIRED ON)\n"
-             "set(CMAKE_C_EXTENSIONS OFF)\n"
-             "\n"
-             "set(CMAKE_CXX_STANDARD 17)\n"
-             "set(CMAKE_CXX_STANDARD_REQUIRED ON)\n"
-             "set(CMAKE_CXX_EXTENSIONS OFF)\n"
-             "set(CMAKE_ARCHIVE_OUTPUT_DIRECTORY ${CMAKE_SOURCE_DIR}/lib)\n"
-             "set(CMAKE_LIBRARY_OUTPUT_DIRECTORY ${CMAKE_SOURCE_DIR}/lib)\n"
-             "set(CMAKE_RUNTIME_OUTPUT_DIRECTORY ${CMAKE_SOURCE_DIR}/bin)\n"
-             "\n"
-             "project(%s\n"
-             "  LANGUAGES C CXX\n"
-             "  VERSION 0.0.0.0\n"
-             ")\n"
-             "\n"
-             "# Compiler-specific warning flags\n"
-             "if (CMAKE_C_COMPILER_ID STREQUAL \"GNU\" OR CMAKE_C_COMPILER_ID STREQUAL \"Clang\")\n"
-             "  add_compile_options(-Wall -Wextra -Wpedantic)\n"
-             "elseif (CMAKE_C_COMPILER_ID STREQUAL \"MSVC\")\n"
-             "  add_compile_options(/W4)\n"
-             "endif()\n"
-             "\n"
-             "add_subdirectory(%s)\n"
-             "add_subdirectory(%s)\n"
-             "add_subdirectory(tests)\n"
-             "\n"
-             "enable_testing()\n",
-             root_dir, lib_dir, app_dir);
-    write_file(path, cmake_root_content);
+// Function to write a file (path relative to the project root); content must live as long as ctx
+int write_file(project_context *ctx, const char *path, const char *content, size_t length);
 
-    // Library CMakeLists.txt
-    snprintf(path, sizeof(path), "%s/%s/CMakeLists.txt", root_dir, lib_dir);
-    char cmake_lib_content[4096];
-    snprintf(cmake_lib_content, sizeof(cmake_lib_content),
-             "file(GLOB ROOT_SRC *.c *.cpp *.cc *.cxx *.c++)\n"
-             "\n"
-             "set(%s_SRC\n"
-             "  ${ROOT_SRC}\n"
-             ")\n"
-             "\n"
-             "# Platform-specific settings\n"
-             "if (WIN32)\n"
-             "elseif (UNIX AND NOT APPLE)\n"
-             "elseif (APPLE)\n"
-             "elseif (EMSCRIPTEN)\n"
-             "elseif (IOS)\n"
-             "elseif (ANDROID)\n"
-             "endif()\n"
-             "\n"
-             "add_library(%s STATIC ${%s_SRC})\n"
-             "target_include_directories(%s PUBLIC ${CMAKE_SOURCE_DIR})\n"
-             "\n"
-             "# Build configuration-specific definitions\n"
-             "target_compile_definitions(%s PUBLIC\n"
-             "  $<$<CONFIG:Debug>:%s_DEBUG>\n"
-             "  $<$<CONFIG:Release>:%s_RELEASE>\n"
-             ")\n",
-             LIB_DIR,
-             lib_dir, LIB_DIR,
-             lib_dir,
-             lib_dir,
-             LIB_DIR,
-             LIB_DIR);
-    write_file(path, cmake_lib_content);
+// Function to write a file whose content is the same in every project, through the --store if any;
+// only files nobody is meant to edit may become read-only hardlinks
+int write_shared_file(project_context *ctx, const char *path, const char *content, size_t length, int hardlink);
 
-    // Application CMakeLists.txt
-    snprintf(path, sizeof(path), "%s/%s/CMakeLists.txt", root_dir, app_dir);
-    char cmake_app_content[4096];
-    snprintf(cmake_app_content, sizeof(cmake_app_content),
-             "file(GLOB ROOT_SRC *.c *.cpp *.cc *.cxx *.c++)\n"
-             "\n"
-             "set(%s_SRC\n"
-             "  ${ROOT_SRC}\n"
-             ")\n"
-             "\n"
-             "# Platform-specific settings\n"
-             "if (WIN32)\n"
-             "elseif (UNIX AND NOT APPLE)\n"
-             "elseif (APPLE)\n"
-             "elseif (EMSCRIPTEN)\n"
-             "elseif (IOS)\n"
-             "elseif (ANDROID)\n"
-             "endif()\n"
-             "\n"
-             "add_executable(%s ${%s_SRC})\n"
-             "target_include_directories(%s PUBLIC ${CMAKE_SOURCE_DIR})\n"
-             "target_link_libraries(%s PUBLIC %s)\n"
-             "\n",
-             APP_DIR, app_dir, APP_DIR, app_dir, app_dir, lib_dir);
-    write_file(path, cmake_app_content);
+// Function to allocate from the project's arena
+void *arena_alloc(project_context *ctx, size_t size);
 
-    // Create test CMakeLists.txt
-    snprintf(path, sizeof(path), "%s/tests/CMakeLists.txt", root_dir);
-    char cmake_tests_content[4096];
-    snprintf(cmake_tests_content, sizeof(cmake_tests_content),
-             "file(GLOB TEST_SRC *.c *.cpp *.cc *.cxx *.c++)\n"
-             "\n"
-             "add_executable(tests ${TEST_SRC})\n"
-             "target_include_directories(tests PUBLIC ${CMAKE_SOURCE_DIR})\n"
-             "target_link_libraries(tests PUBLIC %s)\n"
-             "\n"
-             "enable_testing()\n"
-             "add_test(NAME RunTests COMMAND tests)\n",
-             lib_dir);
-    write_file(path, cmake_tests_content);
+// Function to split a template into literal and variable segment records
+int compile_template(const char *name, const char *source, byte_buffer *segments, size_t *segment_count,
+                     size_t *literal_length);
 
-    // Create .clang-format
-    create_clang_format(root_dir);
+// Function to build a template pack image from template sources
+int build_template_pack(const template_source *sources, size_t count, byte_buffer *pack);
 
-    // Create .clang-tidy
-    create_clang_tidy(root_dir);
+// Function to validate a template pack image and index its templates without copying them
+int open_template_pack(const char *name, const unsigned char *data, size_t size, pack_template **templates,
+                       size_t *count);
 
-    // Create markdown files
-    create_markdown(root_dir);
+// Function to resolve the templates in effect: the embedded pack plus the --templates pack, if any
+int load_templates(options *opts);
 
-    // Create license
-    create_license_file(root_dir);
+// Function to render a template text into the project's arena
+const char *render_template(project_context *ctx, const template_text *text, size_t *length);
 
-    // Initialize git repository
-    initialize_git_repository(root_dir);
-}
+// Function to build a template pack from a directory of template files, or a C header from the built-in ones
+int run_pack(int argc, char *argv[]);
 
-void create_clang_format(const char *root_dir) {
-    char path[512];
+// Function to write the built-in templates' segments as a C header
+int write_baked_templates(const char *path);
 
-    // Define the content for the .clang-format file
-    const char *clang_format_content =
-        "# Base style to use. Setting this to LLVM will apply LLVM's default formatting style.\n"
-        "BasedOnStyle: LLVM\n\n"
-        "# Number of spaces to use for indentation.\n"
-        "IndentWidth: 4\n\n"
-        "# Number of spaces per tab.\n"
-        "TabWidth: 4\n\n"
-        "# How to handle tabs.\n"
-        "# Options:\n"
-        "# - Never: Use spaces for indentation.\n"
-        "# - Always: Use tabs for indentation.\n"
-        "# - ForIndentation: Use tabs for indentation, spaces for alignment.\n"
-        "UseTab: Never\n\n"
-        "# Controls brace placement.\n"
-        "# Options:\n"
-        "# - Attach: Braces are attached to the statement.\n"
-        "# - Linux: Braces are placed on a new line, following Linux style.\n"
-        "# - Stroustrup: Braces follow Stroustrup's style.\n"
-        "# - Allman: Braces are placed on a new line, following Allman's style.\n"
-        "# - Custom: User-defined custom settings for brace wrapping.\n"
-        "BreakBeforeBraces: Custom\n"
-        "BraceWrapping:\n"
-        "  AfterEnum: false\n"
-        "  AfterFunction: false\n"
-        "  AfterNamespace: false\n"
-        "  AfterStruct: false\n"
-        "  AfterUnion: false\n"
-        "  BeforeCatch: false\n"
-        "  BeforeElse: false\n"
-        "  BeforeWhile: false\n\n"
-        "# Determines whether to break lines after the return type.\n"
-        "# Options:\n"
-        "# - None: Do not force line breaks.\n"
-        "# - AllDefinitions: Break lines after all function definitions.\n"
-        "AlwaysBreakAfterDefinitionReturnType: None\n\n"
-        "# Allows short functions to be on a single line.\n"
-        "# Options:\n"
-        "# - Empty: Allows single-line functions if the function body is empty.\n"
-        "# - All: Allows all short functions to be on a single line.\n"
-        "# - None: Disallows single-line functions.\n"
-        "AllowShortFunctionsOnASingleLine: Empty\n\n"
-        "# Allows short blocks (like if statements) to be on a single line.\n"
-        "# Options:\n"
-        "# - Empty: Allows single-line blocks if the block is empty.\n"
-        "# - All: Allows all short blocks to be on a single line.\n"
-        "# - None: Disallows single-line blocks.\n"
-        "AllowShortBlocksOnASingleLine: Empty\n\n"
-        "# Limits the number of characters per line. 0 disables this limit.\n"
-        "ColumnLimit: 0\n\n"
-        "# Style for braced initializers.\n"
-        "# Options:\n"
-        "# - false: Uses the default style.\n"
-        "# - true: Applies C++11 braced list style.\n"
-        "Cpp11BracedListStyle: false\n\n"
-        "# Determines where to place pointers.\n"
-        "# Options:\n"
-        "# - Left: Place the pointer on the left of the type (e.g., `int* ptr`).\n"
-        "# - Right: Place the pointer on the right of the type (e.g., `int *ptr`).\n"
-        "PointerAlignment: Right\n\n"
-        "# Controls spacing before parentheses.\n"
-        "# Options:\n"
-        "# - ControlStatements: Space before parentheses in control statements (e.g., if, while).\n"
-        "# - Always: Space before all parentheses.\n"
-        "# - Never: No space before parentheses.\n"
-        "SpaceBeforeParens: ControlStatements\n\n"
-        "# Number of spaces to use for indentation of continued lines.\n"
-        "ContinuationIndentWidth: 4\n\n"
-        "# Controls breaking lines before binary operators.\n"
-        "# Options:\n"
-        "# - NonAssignment: Break before non-assignment operators.\n"
-        "# - All: Break before all binary operators.\n"
-        "# - None: Do not break before binary operators.\n"
-        "BreakBeforeBinaryOperators: NonAssignment\n\n"
-        "# Adds a final newline at the end of the file.\n"
-        "InsertNewlineAtEOF: true\n\n"
-        "# Determines if includes should be sorted.\n"
-        "# Options:\n"
-        "# - false: Do not sort includes.\n"
-        "# - true: Sort includes.\n"
-        "SortIncludes: false\n\n"
-        "# Number of spaces before trailing comments.\n"
-        "SpacesBeforeTrailingComments: 1\n";
+// Function to fill in the template variables of a project
+int set_template_variables(project_context *ctx);
 
-    // Create the .clang-format file path
-    snprintf(path, sizeof(path), "%s/.clang-format", root_dir);
+// Function to render a built-in template and write it to its path
+int emit_template(project_context *ctx, template_id id);
 
-    // Write the content to the .clang-format file
-    write_file(path, clang_format_content);
-}
+// Function to create the missing parent directories of a path relative to the project root
+int make_parent_directories(project_context *ctx, const char *path);
 
-void create_clang_tidy(const char *root_dir) {
-    char path[512];
+// Function to render and write the templates a pack adds to the built-in ones
+int emit_extra_templates(project_context *ctx);
 
-    // Define the content for the .clang-tidy file
-    const char *clang_tidy_content =
-        "Checks: 'readability-identifier-naming, readability-namespace-comment, readability-function-size'\n"
-        "CheckOptions:\n"
-        "- key: readability-identifier-naming.VariableCase\n"
-        "value: lower_case\n"
-        "- key: readability-identifier-naming.LocalVariablePrefix\n"
-        "value: local_\n"
-        "- key: readability-identifier-naming.FunctionCase\n"
-        "value: lower_case\n"
-        "- key: readability-identifier-naming.MacroDefinitionCase\n"
-        "value: UPPER_CASE\n"
-        "- key: readability-identifier-naming.LocalConstantPrefix\n"
-        "value: local_\n"
-        "- key: readability-identifier-naming.LocalVariablePrefix\n"
-        "value: local_\n"
-        "- key: readability-identifier-naming.IgnoreMainLikeFunctions\n"
-        "value: true\n"
-        "- key: readability-identifier-naming.ConstantCase\n"
-        "value: UPPER_CASE\n"
-        "- key: readability-identifier-naming.EnumCase\n"
-        "value: PascalCase\n"
-        "- key: readability-identifier-naming.PointerParameterPrefix\n"
-        "value: ptr_\n"
-        "- key: readability-identifier-naming.StructCase\n"
-        "value: PascalCase\n"
-        "- key: readability-identifier-naming.UnionCase\n"
-        "value: PascalCase\n\n"
-        "WarningsAsErrors: ''\n"
-        "FormatStyle: file\n";
+// Function to create a .clang-format file
+int create_clang_format(project_context *ctx);
+int create_clang_tidy(project_context *ctx);
 
-    // Create the .clang-tidy file path
-    snprintf(path, sizeof(path), "%s/.clang-tidy", root_dir);
+// Function to create all the necessary md files
+int create_markdown(project_context *ctx);
 
-    // Write the content to the .clang-tidy file
-    write_file(path, clang_tidy_content);
+// Function to initialize a Git repository holding every file generated so far
+int initialize_git_repository(project_context *ctx);
+
+// Function to write the .git directory and the initial commit without the git binary
+int write_git_repository(project_context *ctx);
+
+// Function to create a LICENSE file with MIT license
+int create_license_file(project_context *ctx);
+
+// Function to create the whole project
+int create_project_structure(project_context *ctx);
+
+// Function to record the names and file hashes of a project in its .progen-manifest
+int write_project_manifest(project_context *ctx);
+
+// Function to re-sync existing projects with the current templates, using their .progen-manifest
+int run_update(int argc, char *argv[]);
+
+// Function to benchmark project generation and report latency, system calls and memory
+int run_bench(int argc, char *argv[]);
+
+// Function to generate projects with random names into memory and check every output
+int run_fuzz(int argc, char *argv[]);
+
+// Function to answer generation requests on a Unix socket until interrupted
+int run_serve(int argc, char *argv[]);
+
+// Main function
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "pack") == 0) {
+        return run_pack(argc, argv) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 2 && strcmp(argv[1], "update") == 0) {
+        return run_update(argc, argv) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return run_bench(argc, argv) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 2 && strcmp(argv[1], "fuzz") == 0) {
+        return run_fuzz(argc, argv) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        return run_serve(argc, argv) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    options opts;
+    if (parse_options(argc, argv, &opts) != 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (load_templates(&opts) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (opts.manifest_path == NULL && opts.workspace_path == NULL && opts.positional_count != 3) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (opts.output == OUTPUT_TAR && open_tar_output() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (opts.trace_path != NULL && open_trace(opts.trace_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (opts.manifest_path != NULL) {
+        int status = run_manifest(&opts) | close_tar_output();
+        return close_trace() == 0 && status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (opts.workspace_path != NULL) {
+        int status = run_workspace(&opts) | close_tar_output();
+        return close_trace() == 0 && status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const char *project_name = opts.positional[0];
+    const char *app_name = opts.positional[1];
+    const char *lib_name = opts.positional[2];
+
+    // Debug messages
+    printf("Creating project structure for '%s' with app '%s' and library '%s'.\n", project_name, app_name, lib_name);
+
+    project_context ctx;
+    init_project_context(&ctx, &opts, project_name, app_name, lib_name);
+    int status = create_project_structure(&ctx) | close_tar_output();
+    generation_stats stats = ctx.stats;
+    free_project_context(&ctx);
+    if (close_trace() != 0 || status != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Project '%s' with app '%s' and library '%s' created successfully!\n", project_name, app_name, lib_name);
+    print_store_summary(&opts, &stats);
+
+    return EXIT_SUCCESS;
+}
+
+// TEMPLATES
+
+// Paths and contents may use {{project}}, {{app}}, {{APP}}, {{lib}} and {{LIB}}; contents may also use
+// {{lib_sources}}, {{app_sources}}, {{test_sources}} and {{bench_sources}}, the C and C++ files the
+// templates put in each directory, one indented name per line, {{subdirectories}}, {{lib_kind}} and {{test_links}}.
+// The workspace target templates also get {{deps}}, {{links}}, {{dep_includes}} and {{dep_calls}}.
+static const template_source builtin_templates[TEMPLATE_COUNT] = {
+    [TEMPLATE_LIB_HEADER] = { "{{lib}}/{{lib}}.h",
+        "#ifndef {{LIB}}_H_\n"
+        "#define {{LIB}}_H_\n"
+        "\n"
+        "#include \"export.h\"\n"
+        "\n"
+        "{{LIB}}_API void hello(void);\n"
+        "\n"
+        "// A header-only build compiles the library into every file that includes it\n"
+        "#ifdef {{LIB}}_HEADER_ONLY\n"
+        "#include \"{{lib}}.c\"\n"
+        "#endif\n"
+        "\n"
+        "#endif // !{{LIB}}_H_\n" },
+    [TEMPLATE_LIB_EXPORT] = { "{{lib}}/export.h",
+        "#ifndef {{LIB}}_EXPORT_H_\n"
+        "#define {{LIB}}_EXPORT_H_\n"
+        "\n"
+        "// {{LIB}}_API marks the declarations that make up the library's interface. The library is\n"
+        "// compiled with hidden visibility, so in a shared build these are the only symbols it exports:\n"
+        "// the dynamic symbol table stays small, and calls between the library's own functions bind\n"
+        "// locally instead of going through the PLT. {{LIB}}_SHARED and {{LIB}}_HEADER_ONLY come from\n"
+        "// {{lib}}/CMakeLists.txt; CMake defines {{lib}}_EXPORTS while it builds the shared library.\n"
+        "#if defined({{LIB}}_HEADER_ONLY)\n"
+        "#define {{LIB}}_API static inline\n"
+        "#elif defined(_WIN32) && defined({{LIB}}_SHARED)\n"
+        "#ifdef {{lib}}_EXPORTS\n"
+        "#define {{LIB}}_API __declspec(dllexport)\n"
+        "#else\n"
+        "#define {{LIB}}_API __declspec(dllimport)\n"
+        "#endif\n"
+        "#elif defined(__GNUC__) && !defined(_WIN32)\n"
+        "#define {{LIB}}_API __attribute__((visibility(\"default\")))\n"
+        "#else\n"
+        "#define {{LIB}}_API\n"
+        "#endif\n"
+        "\n"
+        "#endif // !{{LIB}}_EXPORT_H_\n" },
+    [TEMPLATE_LIB_SOURCE] = { "{{lib}}/{{lib}}.c",
+        "#include <stdio.h>\n"
+        "#include \"{{lib}}.h\"\n"
+        "\n"
+        "void hello(void) {\n"
+        "    puts(\"hello!\");\n"
+        "}\n" },
+    [TEMPLATE_TEST_SOURCE] = { "tests/test_{{lib}}.c",
+        "#include \"{{lib}}/{{lib}}.h\"\n"
+        "\n"
+        "int main(void) {\n"
+        "    hello();\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_APP_SOURCE] = { "{{app}}/{{app}}.c",
+        "#include \"{{lib}}/{{lib}}.h\"\n"
+        "\n"
+        "int main(void) {\n"
+        "    hello();\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_CMAKE_ROOT] = { "CMakeLists.txt",
+        "cmake_minimum_required(VERSION 3.26)\n"
+        "\n"
+        "set(CMAKE_C_STANDARD 11)\n"
+        "set(CMAKE_C_STANDARD_REQUIRED ON)\n"
+        "set(CMAKE_C_EXTENSIONS OFF)\n"
+        "\n"
+        "set(CMAKE_CXX_STANDARD 17)\n"
+        "set(CMAKE_CXX_STANDARD_REQUIRED ON)\n"
+        "set(CMAKE_CXX_EXTENSIONS OFF)\n"
+        "set(CMAKE_ARCHIVE_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/lib)\n"
+        "set(CMAKE_LIBRARY_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/lib)\n"
+        "set(CMAKE_RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin)\n"
+        "set(CMAKE_EXPORT_COMPILE_COMMANDS ON)\n"
+        "\n"
+        "project({{project}}\n"
+        "  LANGUAGES C CXX\n"
+        "  VERSION 0.0.0.0\n"
+        ")\n"
+        "\n"
+        "list(APPEND CMAKE_MODULE_PATH ${CMAKE_SOURCE_DIR}/CMake/Modules)\n"
+        "\n"
+        "# Asan, Tsan and Profile build types, perf-record and perf-report targets\n"
+        "include(BuildTypes)\n"
+        "\n"
+        "# LTO, native-arch and PGO options; see CMakePresets.json\n"
+        "include(Optimization)\n"
+        "\n"
+        "# Unity builds, precompiled headers and ccache/sccache\n"
+        "include(BuildAcceleration)\n"
+        "\n"
+        "# Compile-time profiling and the build-profile-report target; see the build-profile preset\n"
+        "include(BuildProfile)\n"
+        "\n"
+        "# Compiler-specific warning flags\n"
+        "if (CMAKE_C_COMPILER_ID STREQUAL \"GNU\" OR CMAKE_C_COMPILER_ID STREQUAL \"Clang\")\n"
+        "  add_compile_options(-Wall -Wextra -Wpedantic)\n"
+        "elseif (CMAKE_C_COMPILER_ID STREQUAL \"MSVC\")\n"
+        "  add_compile_options(/W4)\n"
+        "endif()\n"
+        "\n"
+        "enable_testing()\n"
+        "\n"
+        "{{subdirectories}}" },
+    [TEMPLATE_CMAKE_LIB] = { "{{lib}}/CMakeLists.txt",
+        "set({{LIB}}_SRC\n"
+        "{{lib_sources}})\n"
+        "\n"
+        "# Platform-specific settings\n"
+        "if (WIN32)\n"
+        "elseif (UNIX AND NOT APPLE)\n"
+        "elseif (APPLE)\n"
+        "elseif (EMSCRIPTEN)\n"
+        "elseif (IOS)\n"
+        "elseif (ANDROID)\n"
+        "endif()\n"
+        "\n"
+        "# Library kind, chosen with progen --lib-kind: STATIC, SHARED, OBJECT, or INTERFACE for a\n"
+        "# header-only library. Only the declarations marked {{LIB}}_API (see export.h) are visible\n"
+        "# outside the library, so a shared build exports just those and calls the rest directly.\n"
+        "set({{LIB}}_KIND {{lib_kind}})\n"
+        "if ({{LIB}}_KIND STREQUAL \"INTERFACE\")\n"
+        "  # {{lib}}.h includes {{lib}}.c, whose functions {{LIB}}_API makes static inline\n"
+        "  add_library({{lib}} INTERFACE)\n"
+        "  target_compile_definitions({{lib}} INTERFACE {{LIB}}_HEADER_ONLY)\n"
+        "  set({{LIB}}_SCOPE INTERFACE)\n"
+        "else()\n"
+        "  add_library({{lib}} ${{{LIB}}_KIND} ${{{LIB}}_SRC})\n"
+        "  set_target_properties({{lib}} PROPERTIES\n"
+        "    C_VISIBILITY_PRESET hidden CXX_VISIBILITY_PRESET hidden VISIBILITY_INLINES_HIDDEN ON)\n"
+        "  set({{LIB}}_SCOPE PUBLIC)\n"
+        "endif()\n"
+        "target_include_directories({{lib}} ${{{LIB}}_SCOPE} ${CMAKE_SOURCE_DIR})\n"
+        "\n"
+        "if ({{LIB}}_KIND STREQUAL \"SHARED\")\n"
+        "  target_compile_definitions({{lib}} PUBLIC {{LIB}}_SHARED)\n"
+        "\n"
+        "  # Let calls to the exported functions from inside the library bind locally and be inlined;\n"
+        "  # nothing may interpose them (e.g. with LD_PRELOAD) for calls the library makes itself\n"
+        "  include(CheckCCompilerFlag)\n"
+        "  check_c_compiler_flag(-fno-semantic-interposition HAVE_NO_SEMANTIC_INTERPOSITION)\n"
+        "  if (HAVE_NO_SEMANTIC_INTERPOSITION)\n"
+        "    target_compile_options({{lib}} PRIVATE -fno-semantic-interposition)\n"
+        "  endif()\n"
+        "\n"
+        "  # exported-symbols lists the dynamic symbols of the library: the {{LIB}}_API functions and\n"
+        "  # nothing else, or a declaration is missing its annotation\n"
+        "  if (MSVC)\n"
+        "    set({{LIB}}_LIST_EXPORTS dumpbin /nologo /exports $<TARGET_FILE:{{lib}}>)\n"
+        "  elseif (APPLE)\n"
+        "    set({{LIB}}_LIST_EXPORTS ${CMAKE_NM} -gU $<TARGET_FILE:{{lib}}>)\n"
+        "  else()\n"
+        "    set({{LIB}}_LIST_EXPORTS ${CMAKE_NM} -D --defined-only $<TARGET_FILE:{{lib}}>)\n"
+        "  endif()\n"
+        "  add_custom_target(exported-symbols\n"
+        "    COMMAND ${{{LIB}}_LIST_EXPORTS}\n"
+        "    COMMENT \"Symbols exported by {{lib}}\"\n"
+        "    USES_TERMINAL\n"
+        "    VERBATIM)\n"
+        "  add_dependencies(exported-symbols {{lib}})\n"
+        "endif()\n"
+        "\n"
+        "# Optional modules, selected with progen --with=...\n"
+        "set({{LIB}}_MODULES {{modules}})\n"
+        "if (threads IN_LIST {{LIB}}_MODULES)\n"
+        "  find_package(Threads REQUIRED)\n"
+        "  target_link_libraries({{lib}} PUBLIC Threads::Threads)\n"
+        "  if (MSVC)\n"
+        "    target_compile_options({{lib}} PRIVATE /experimental:c11atomics)\n"
+        "  endif()\n"
+        "endif()\n"
+        "if (simd IN_LIST {{LIB}}_MODULES)\n"
+        "  # Each simd_<isa>.c is compiled for its instruction set; simd.c only calls into it on CPUs that\n"
+        "  # have it. Files with their own options stay out of unity batches and precompiled headers.\n"
+        "  if (CMAKE_C_COMPILER_ID MATCHES \"GNU|Clang\" AND CMAKE_SYSTEM_PROCESSOR MATCHES \"^(x86_64|AMD64|amd64|i.86|x86)$\")\n"
+        "    set_source_files_properties(simd_sse2.c PROPERTIES COMPILE_OPTIONS -msse2)\n"
+        "    set_source_files_properties(simd_avx2.c PROPERTIES COMPILE_OPTIONS \"-mavx2;-mfma\")\n"
+        "    set_source_files_properties(simd_avx512.c PROPERTIES COMPILE_OPTIONS -mavx512f)\n"
+        "  elseif (CMAKE_C_COMPILER_ID MATCHES \"GNU|Clang\" AND CMAKE_SYSTEM_PROCESSOR MATCHES \"^arm\")\n"
+        "    set_source_files_properties(simd_neon.c PROPERTIES COMPILE_OPTIONS -mfpu=neon)\n"
+        "  elseif (MSVC AND CMAKE_SYSTEM_PROCESSOR MATCHES \"AMD64|x86\")\n"
+        "    set_source_files_properties(simd_avx2.c PROPERTIES COMPILE_OPTIONS /arch:AVX2)\n"
+        "    set_source_files_properties(simd_avx512.c PROPERTIES COMPILE_OPTIONS /arch:AVX512)\n"
+        "  endif()\n"
+        "  set_source_files_properties(simd_sse2.c simd_avx2.c simd_avx512.c simd_neon.c PROPERTIES\n"
+        "    SKIP_UNITY_BUILD_INCLUSION ON SKIP_PRECOMPILE_HEADERS ON)\n"
+        "  if (MSVC)\n"
+        "    target_compile_options({{lib}} PRIVATE /experimental:c11atomics)\n"
+        "  endif()\n"
+        "endif()\n"
+        "\n"
+        "# Build configuration-specific definitions\n"
+        "target_compile_definitions({{lib}} ${{{LIB}}_SCOPE}\n"
+        "  $<$<CONFIG:Debug,Asan,Tsan>:{{LIB}}_DEBUG>\n"
+        "  $<$<CONFIG:Release,Profile>:{{LIB}}_RELEASE>\n"
+        ")\n"
+        "\n"
+        "# Every target linking the library gets its public header precompiled\n"
+        "if (ENABLE_PCH)\n"
+        "  target_precompile_headers({{lib}} ${{{LIB}}_SCOPE} $<BUILD_INTERFACE:${CMAKE_CURRENT_SOURCE_DIR}/{{lib}}.h>)\n"
+        "endif()\n" },
+    [TEMPLATE_CMAKE_APP] = { "{{app}}/CMakeLists.txt",
+        "set({{APP}}_SRC\n"
+        "{{app_sources}})\n"
+        "\n"
+        "# Platform-specific settings\n"
+        "if (WIN32)\n"
+        "elseif (UNIX AND NOT APPLE)\n"
+        "elseif (APPLE)\n"
+        "elseif (EMSCRIPTEN)\n"
+        "elseif (IOS)\n"
+        "elseif (ANDROID)\n"
+        "endif()\n"
+        "\n"
+        "add_executable({{app}} ${{{APP}}_SRC})\n"
+        "target_include_directories({{app}} PUBLIC ${CMAKE_SOURCE_DIR})\n"
+        "target_link_libraries({{app}} PUBLIC {{lib}})\n"
+        "\n" },
+    [TEMPLATE_CMAKE_TESTS] = { "tests/CMakeLists.txt",
+        "set(TEST_SRC\n"
+        "{{test_sources}})\n"
+        "\n"
+        "# One executable and one test per source file, named after it\n"
+        "foreach (TEST_SOURCE IN LISTS TEST_SRC)\n"
+        "  get_filename_component(TEST_NAME ${TEST_SOURCE} NAME_WE)\n"
+        "  add_executable(${TEST_NAME} ${TEST_SOURCE})\n"
+        "  target_include_directories(${TEST_NAME} PUBLIC ${CMAKE_SOURCE_DIR})\n"
+        "  target_link_libraries(${TEST_NAME} PUBLIC {{test_links}})\n"
+        "  add_test(NAME ${TEST_NAME} COMMAND ${TEST_NAME})\n"
+        "  set_tests_properties(${TEST_NAME} PROPERTIES LABELS unit)\n"
+        "endforeach()\n" },
+    [TEMPLATE_CMAKE_BENCH] = { "bench/CMakeLists.txt",
+        "set(BENCH_SRC\n"
+        "{{bench_sources}})\n"
+        "\n"
+        "# One executable per source file, all built by the 'bench' target. Run them with\n"
+        "# 'ctest -L bench'; 'ctest -LE \"bench|perf\"' runs everything else.\n"
+        "add_custom_target(bench)\n"
+        "set(BENCH_FILES)\n"
+        "foreach (BENCH_SOURCE IN LISTS BENCH_SRC)\n"
+        "  get_filename_component(BENCH_NAME ${BENCH_SOURCE} NAME_WE)\n"
+        "  add_executable(${BENCH_NAME} ${BENCH_SOURCE})\n"
+        "  target_include_directories(${BENCH_NAME} PRIVATE ${CMAKE_SOURCE_DIR} ${CMAKE_CURRENT_SOURCE_DIR})\n"
+        "  target_link_libraries(${BENCH_NAME} PRIVATE {{test_links}})\n"
+        "  add_dependencies(bench ${BENCH_NAME})\n"
+        "  add_test(NAME ${BENCH_NAME} COMMAND ${BENCH_NAME})\n"
+        "  set_tests_properties(${BENCH_NAME} PROPERTIES LABELS bench RUN_SERIAL TRUE)\n"
+        "  list(APPEND BENCH_FILES $<TARGET_FILE:${BENCH_NAME}>)\n"
+        "endforeach()\n"
+        "\n"
+        "# Performance gate: the perf-gate test (label perf) runs every benchmark PERF_GATE_RUNS times and\n"
+        "# compares the medians with perf-baseline.json, failing with a table of what got slower; the\n"
+        "# update-perf-baseline target records the current times there instead. Commit the baseline, and\n"
+        "# set \"tolerance_percent\" in an entry for benchmarks noisier than the rest. The test is skipped\n"
+        "# while there is no baseline and when the baseline comes from another build type.\n"
+        "set(PERF_GATE_RUNS 5 CACHE STRING \"Runs of every benchmark per perf-gate check, of which the median counts\")\n"
+        "set(PERF_GATE_TOLERANCE 10 CACHE STRING \"Slowdown in percent the perf gate accepts by default\")\n"
+        "set(PERF_GATE_MIN_DELTA_NS 2 CACHE STRING \"Slowdowns the perf gate ignores as noise, in nanoseconds\")\n"
+        "list(JOIN BENCH_FILES \"|\" PERF_GATE_BENCHES)\n"
+        "set(PERF_GATE_COMMAND \"${CMAKE_COMMAND}\"\n"
+        "  \"-DBENCHES=${PERF_GATE_BENCHES}\"\n"
+        "  \"-DBASELINE=${CMAKE_CURRENT_SOURCE_DIR}/perf-baseline.json\"\n"
+        "  \"-DRESULTS=${CMAKE_BINARY_DIR}/perf-results.json\"\n"
+        "  \"-DCONFIG=$<CONFIG>\"\n"
+        "  \"-DRUNS=${PERF_GATE_RUNS}\"\n"
+        "  \"-DTOLERANCE=${PERF_GATE_TOLERANCE}\"\n"
+        "  \"-DMIN_DELTA_NS=${PERF_GATE_MIN_DELTA_NS}\")\n"
+        "add_test(NAME perf-gate COMMAND ${PERF_GATE_COMMAND} -P \"${CMAKE_SOURCE_DIR}/CMake/Modules/PerfGate.cmake\")\n"
+        "set_tests_properties(perf-gate PROPERTIES LABELS perf RUN_SERIAL TRUE SKIP_REGULAR_EXPRESSION \"perf-gate: skipped\")\n"
+        "add_custom_target(update-perf-baseline\n"
+        "  COMMAND ${PERF_GATE_COMMAND} -DUPDATE=ON -P \"${CMAKE_SOURCE_DIR}/CMake/Modules/PerfGate.cmake\"\n"
+        "  COMMENT \"Recording benchmark times in ${CMAKE_CURRENT_SOURCE_DIR}/perf-baseline.json\"\n"
+        "  USES_TERMINAL\n"
+        "  VERBATIM)\n"
+        "add_dependencies(update-perf-baseline bench)\n" },
+    [TEMPLATE_BENCH_HARNESS] = { "bench/bench.h",
+        "#ifndef BENCH_H_\n"
+        "#define BENCH_H_\n"
+        "\n"
+        "// Minimal benchmark harness. Each benchmark is a function running a given number of iterations;\n"
+        "// the harness calibrates that number so one repetition takes at least min_rep_ns, runs warmup\n"
+        "// repetitions, then reports median, p99 and minimum time per iteration over the measured ones.\n"
+        "\n"
+        "#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)\n"
+        "#define _POSIX_C_SOURCE 199309L  // clock_gettime under strict ISO C; include this header first\n"
+        "#endif\n"
+        "#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)\n"
+        "#define _CRT_SECURE_NO_WARNINGS  // getenv, fopen\n"
+        "#endif\n"
+        "\n"
+        "#include <stdint.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n"
+        "#include <time.h>\n"
+        "\n"
+        "#if defined(_MSC_VER)\n"
+        "#include <intrin.h>\n"
+        "#endif\n"
+        "\n"
+        "// Keep the compiler from optimizing away a value, or the memory writes before this point\n"
+        "#if defined(__GNUC__) || defined(__clang__)\n"
+        "#define BENCH_DO_NOT_OPTIMIZE(value) __asm__ volatile(\"\" : : \"r,m\"(value) : \"memory\")\n"
+        "#define BENCH_CLOBBER_MEMORY() __asm__ volatile(\"\" : : : \"memory\")\n"
+        "#else\n"
+        "static volatile uintptr_t bench_sink;\n"
+        "#define BENCH_DO_NOT_OPTIMIZE(value) (bench_sink = (uintptr_t)(value))\n"
+        "#if defined(_MSC_VER)\n"
+        "#define BENCH_CLOBBER_MEMORY() _ReadWriteBarrier()\n"
+        "#else\n"
+        "#define BENCH_CLOBBER_MEMORY() ((void)0)\n"
+        "#endif\n"
+        "#endif\n"
+        "\n"
+        "// Monotonic time in nanoseconds\n"
+        "static inline uint64_t bench_now_ns(void) {\n"
+        "    struct timespec ts;\n"
+        "#if defined(_WIN32)\n"
+        "    timespec_get(&ts, TIME_UTC);\n"
+        "#else\n"
+        "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+        "#endif\n"
+        "    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;\n"
+        "}\n"
+        "\n"
+        "// Raw cycle counter where the CPU has a cheap one, 0 elsewhere. The TSC ticks at a constant\n"
+        "// rate on current x86 CPUs, so this counts reference cycles, not core clock cycles.\n"
+        "static inline uint64_t bench_cycles(void) {\n"
+        "#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))\n"
+        "    return __rdtsc();\n"
+        "#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))\n"
+        "    return __builtin_ia32_rdtsc();\n"
+        "#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)\n"
+        "    uint64_t value;\n"
+        "    __asm__ volatile(\"mrs %0, cntvct_el0\" : \"=r\"(value));\n"
+        "    return value;\n"
+        "#else\n"
+        "    return 0;\n"
+        "#endif\n"
+        "}\n"
+        "\n"
+        "typedef void (*bench_function)(void *arg, uint64_t iterations);\n"
+        "\n"
+        "typedef struct bench_options {\n"
+        "    int warmup;             // repetitions run and discarded before measuring\n"
+        "    int repetitions;        // measured repetitions\n"
+        "    uint64_t min_rep_ns;    // calibration target for one repetition\n"
+        "} bench_options;\n"
+        "\n"
+        "typedef struct bench_result {\n"
+        "    const char *name;\n"
+        "    uint64_t iterations;    // per repetition\n"
+        "    double median_ns;       // per iteration\n"
+        "    double p99_ns;\n"
+        "    double min_ns;\n"
+        "    double median_cycles;   // 0 without a cycle counter\n"
+        "} bench_result;\n"
+        "\n"
+        "static inline bench_options bench_default_options(void) {\n"
+        "    bench_options options = { 3, 31, 2000000 };\n"
+        "    return options;\n"
+        "}\n"
+        "\n"
+        "static inline int bench_compare_doubles(const void *left, const void *right) {\n"
+        "    double a = *(const double *)left, b = *(const double *)right;\n"
+        "    return (a > b) - (a < b);\n"
+        "}\n"
+        "\n"
+        "// With BENCH_JSON=<file> in the environment, append a result to that file as a line of JSON, for\n"
+        "// the perf gate. Times are in integer picoseconds, which CMake's integer math can compare.\n"
+        "static inline void bench_append_json(const bench_result *result, int repetitions) {\n"
+        "    const char *path = getenv(\"BENCH_JSON\");\n"
+        "    if (path == NULL || *path == '\\0') {\n"
+        "        return;\n"
+        "    }\n"
+        "    FILE *file = fopen(path, \"a\");\n"
+        "    if (file == NULL) {\n"
+        "        perror(path);\n"
+        "        return;\n"
+        "    }\n"
+        "    fputs(\"{\\\"name\\\": \\\"\", file);\n"
+        "    for (const char *c = result->name; *c != '\\0'; ++c) {\n"
+        "        if (*c == '\"' || *c == '\\\\') {\n"
+        "            fputc('\\\\', file);\n"
+        "        }\n"
+        "        fputc(*c, file);\n"
+        "    }\n"
+        "    fprintf(file, \"\\\", \\\"median_ps\\\": %.0f, \\\"p99_ps\\\": %.0f, \\\"min_ps\\\": %.0f, \\\"iterations\\\": %llu, \\\"repetitions\\\": %d}\\n\",\n"
+        "            result->median_ns * 1000.0, result->p99_ns * 1000.0, result->min_ns * 1000.0,\n"
+        "            (unsigned long long)result->iterations, repetitions);\n"
+        "    fclose(file);\n"
+        "}\n"
+        "\n"
+        "// Run one benchmark and print a line of results to stderr (and BENCH_JSON, if set)\n"
+        "static inline bench_result bench_run(const char *name, bench_function function, void *arg,\n"
+        "                                     const bench_options *options) {\n"
+        "    bench_result result = { name, 1, 0, 0, 0, 0 };\n"
+        "\n"
+        "    // Double the iteration count until one repetition is long enough to time reliably\n"
+        "    for (;;) {\n"
+        "        uint64_t start = bench_now_ns();\n"
+        "        function(arg, result.iterations);\n"
+        "        uint64_t elapsed = bench_now_ns() - start;\n"
+        "        if (elapsed >= options->min_rep_ns || result.iterations >= (UINT64_C(1) << 40)) {\n"
+        "            break;\n"
+        "        }\n"
+        "        result.iterations *= 2;\n"
+        "    }\n"
+        "\n"
+        "    for (int i = 0; i < options->warmup; ++i) {\n"
+        "        function(arg, result.iterations);\n"
+        "    }\n"
+        "\n"
+        "    int count = options->repetitions > 0 ? options->repetitions : 1;\n"
+        "    double *times = malloc(2 * (size_t)count * sizeof(*times));\n"
+        "    if (times == NULL) {\n"
+        "        fprintf(stderr, \"%s: out of memory\\n\", name);\n"
+        "        return result;\n"
+        "    }\n"
+        "    double *cycles = times + count;\n"
+        "    for (int i = 0; i < count; ++i) {\n"
+        "        uint64_t start_cycles = bench_cycles();\n"
+        "        uint64_t start = bench_now_ns();\n"
+        "        function(arg, result.iterations);\n"
+        "        uint64_t elapsed = bench_now_ns() - start;\n"
+        "        uint64_t elapsed_cycles = bench_cycles() - start_cycles;\n"
+        "        times[i] = (double)elapsed / (double)result.iterations;\n"
+        "        cycles[i] = (double)elapsed_cycles / (double)result.iterations;\n"
+        "    }\n"
+        "\n"
+        "    qsort(times, (size_t)count, sizeof(*times), bench_compare_doubles);\n"
+        "    qsort(cycles, (size_t)count, sizeof(*cycles), bench_compare_doubles);\n"
+        "    int p99 = (int)((double)count * 0.99 + 0.999999) - 1;\n"
+        "    result.median_ns = times[count / 2];\n"
+        "    result.p99_ns = times[p99 < 0 ? 0 : p99];\n"
+        "    result.min_ns = times[0];\n"
+        "    result.median_cycles = cycles[count / 2];\n"
+        "    free(times);\n"
+        "\n"
+        "    fprintf(stderr, \"%-24s %12.2f %12.2f %12.2f %10.1f %12llu x %d\\n\", name, result.median_ns, result.p99_ns,\n"
+        "            result.min_ns, result.median_cycles, (unsigned long long)result.iterations, count);\n"
+        "    bench_append_json(&result, count);\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "static inline void bench_print_header(void) {\n"
+        "    fprintf(stderr, \"%-24s %12s %12s %12s %10s %17s\\n\", \"benchmark\", \"median ns\", \"p99 ns\", \"min ns\", \"cycles\",\n"
+        "            \"iterations\");\n"
+        "}\n"
+        "\n"
+        "#endif // !BENCH_H_\n" },
+    [TEMPLATE_CMAKE_PERF_GATE] = { "CMake/Modules/PerfGate.cmake",
+        "# Performance regression gate, run as a script by the perf-gate test and the update-perf-baseline\n"
+        "# target (see bench/CMakeLists.txt):\n"
+        "#\n"
+        "#   cmake -DBENCHES=<exe>|<exe>... -DBASELINE=<json> -DRESULTS=<json> -DCONFIG=<build type>\n"
+        "#         [-DRUNS=5] [-DTOLERANCE=10] [-DMIN_DELTA_NS=2] [-DUPDATE=ON] -P PerfGate.cmake\n"
+        "#\n"
+        "# Each benchmark executable runs RUNS times with BENCH_JSON set (see bench.h), and a benchmark's\n"
+        "# time is the median of its per-run medians, so one run disturbed by other work does not count.\n"
+        "# The times go to RESULTS. The gate fails when a benchmark is slower than in BASELINE by more than\n"
+        "# its tolerance: the baseline entry's \"tolerance_percent\" if it has one, TOLERANCE percent\n"
+        "# otherwise. Slowdowns under MIN_DELTA_NS nanoseconds pass whatever their percentage, which keeps\n"
+        "# benchmarks of a few nanoseconds quiet. With UPDATE, the results become the new baseline; the\n"
+        "# tolerances set in the old one are kept.\n"
+        "\n"
+        "cmake_minimum_required(VERSION 3.26)\n"
+        "\n"
+        "foreach (VARIABLE BENCHES BASELINE RESULTS CONFIG)\n"
+        "  if (NOT DEFINED ${VARIABLE})\n"
+        "    message(FATAL_ERROR \"PerfGate.cmake needs -D${VARIABLE}=...\")\n"
+        "  endif()\n"
+        "endforeach()\n"
+        "if (NOT RUNS)\n"
+        "  set(RUNS 5)\n"
+        "endif()\n"
+        "if (NOT DEFINED TOLERANCE)\n"
+        "  set(TOLERANCE 10)\n"
+        "endif()\n"
+        "if (NOT DEFINED MIN_DELTA_NS)\n"
+        "  set(MIN_DELTA_NS 2)\n"
+        "endif()\n"
+        "math(EXPR MIN_DELTA_PS \"${MIN_DELTA_NS} * 1000\")\n"
+        "\n"
+        "# Pad text with spaces to a column width, on the right (LEFT alignment) or on the left\n"
+        "function(align OUTPUT TEXT WIDTH SIDE)\n"
+        "  string(LENGTH \"${TEXT}\" LENGTH)\n"
+        "  set(PADDING \"\")\n"
+        "  if (LENGTH LESS WIDTH)\n"
+        "    math(EXPR COUNT \"${WIDTH} - ${LENGTH}\")\n"
+        "    string(REPEAT \" \" ${COUNT} PADDING)\n"
+        "  endif()\n"
+        "  if (SIDE STREQUAL \"LEFT\")\n"
+        "    set(${OUTPUT} \"${TEXT}${PADDING}\" PARENT_SCOPE)\n"
+        "  else()\n"
+        "    set(${OUTPUT} \"${PADDING}${TEXT}\" PARENT_SCOPE)\n"
+        "  endif()\n"
+        "endfunction()\n"
+        "\n"
+        "# Picoseconds as nanoseconds with two decimals\n"
+        "function(format_ns OUTPUT PS)\n"
+        "  math(EXPR WHOLE \"${PS} / 1000\")\n"
+        "  math(EXPR HUNDREDTHS \"${PS} % 1000 / 10\")\n"
+        "  if (HUNDREDTHS LESS 10)\n"
+        "    set(HUNDREDTHS \"0${HUNDREDTHS}\")\n"
+        "  endif()\n"
+        "  set(${OUTPUT} \"${WHOLE}.${HUNDREDTHS}\" PARENT_SCOPE)\n"
+        "endfunction()\n"
+        "\n"
+        "# A change in tenths of a percent, as +12.3%\n"
+        "function(format_change OUTPUT PERMILLE)\n"
+        "  set(SIGN \"+\")\n"
+        "  if (PERMILLE LESS 0)\n"
+        "    set(SIGN \"-\")\n"
+        "    math(EXPR PERMILLE \"0 - ${PERMILLE}\")\n"
+        "  endif()\n"
+        "  math(EXPR WHOLE \"${PERMILLE} / 10\")\n"
+        "  math(EXPR TENTHS \"${PERMILLE} % 10\")\n"
+        "  set(${OUTPUT} \"${SIGN}${WHOLE}.${TENTHS}%\" PARENT_SCOPE)\n"
+        "endfunction()\n"
+        "\n"
+        "set(BASELINE_JSON \"\")\n"
+        "if (EXISTS \"${BASELINE}\")\n"
+        "  file(READ \"${BASELINE}\" BASELINE_JSON)\n"
+        "  string(JSON BASELINE_CONFIG ERROR_VARIABLE ERROR GET \"${BASELINE_JSON}\" config)\n"
+        "  if (ERROR)\n"
+        "    message(FATAL_ERROR \"perf-gate: ${BASELINE} is not a baseline: ${ERROR}\")\n"
+        "  endif()\n"
+        "endif()\n"
+        "if (NOT UPDATE)\n"
+        "  # The messages start the same way so that ctest reports the test as skipped rather than passed\n"
+        "  if (NOT BASELINE_JSON)\n"
+        "    message(STATUS \"perf-gate: skipped, there is no ${BASELINE} yet; build the update-perf-baseline target to record one\")\n"
+        "    return()\n"
+        "  elseif (NOT BASELINE_CONFIG STREQUAL CONFIG)\n"
+        "    message(STATUS \"perf-gate: skipped, the baseline was recorded with a ${BASELINE_CONFIG} build and this is ${CONFIG}\")\n"
+        "    return()\n"
+        "  endif()\n"
+        "endif()\n"
+        "\n"
+        "# Run everything RUNS times and collect each benchmark's medians\n"
+        "string(REPLACE \"|\" \";\" BENCHES \"${BENCHES}\")\n"
+        "set(RUN_JSON \"${RESULTS}.run\")\n"
+        "set(NAMES \"\")\n"
+        "foreach (RUN RANGE 1 ${RUNS})\n"
+        "  foreach (BENCH IN LISTS BENCHES)\n"
+        "    file(REMOVE \"${RUN_JSON}\")\n"
+        "    execute_process(COMMAND \"${CMAKE_COMMAND}\" -E env \"BENCH_JSON=${RUN_JSON}\" \"${BENCH}\"\n"
+        "      RESULT_VARIABLE STATUS OUTPUT_QUIET ERROR_VARIABLE OUTPUT)\n"
+        "    if (NOT STATUS EQUAL 0)\n"
+        "      message(FATAL_ERROR \"perf-gate: ${BENCH} failed (${STATUS}):\\n${OUTPUT}\")\n"
+        "    endif()\n"
+        "    file(STRINGS \"${RUN_JSON}\" LINES)\n"
+        "    foreach (LINE IN LISTS LINES)\n"
+        "      string(JSON NAME GET \"${LINE}\" name)\n"
+        "      string(JSON PS GET \"${LINE}\" median_ps)\n"
+        "      string(MD5 KEY \"${NAME}\")\n"
+        "      if (NOT DEFINED TIMES_${KEY})\n"
+        "        list(APPEND NAMES \"${NAME}\")\n"
+        "      endif()\n"
+        "      list(APPEND TIMES_${KEY} ${PS})\n"
+        "    endforeach()\n"
+        "  endforeach()\n"
+        "  message(STATUS \"perf-gate: run ${RUN} of ${RUNS} done\")\n"
+        "endforeach()\n"
+        "file(REMOVE \"${RUN_JSON}\")\n"
+        "\n"
+        "# One line per benchmark, sorted, so that baseline updates make readable diffs\n"
+        "list(SORT NAMES)\n"
+        "set(RESULTS_JSON \"{\\n  \\\"config\\\": \\\"${CONFIG}\\\",\\n  \\\"runs\\\": ${RUNS},\\n  \\\"benchmarks\\\": {\")\n"
+        "set(SEPARATOR \"\")\n"
+        "foreach (NAME IN LISTS NAMES)\n"
+        "  string(MD5 KEY \"${NAME}\")\n"
+        "  list(SORT TIMES_${KEY} COMPARE NATURAL)\n"
+        "  list(LENGTH TIMES_${KEY} COUNT)\n"
+        "  math(EXPR MIDDLE \"${COUNT} / 2\")\n"
+        "  list(GET TIMES_${KEY} ${MIDDLE} MEDIAN_${KEY})\n"
+        "  set(ENTRY \"\\\"median_ps\\\": ${MEDIAN_${KEY}}\")\n"
+        "  if (UPDATE AND BASELINE_JSON)\n"
+        "    string(JSON LIMIT ERROR_VARIABLE ERROR GET \"${BASELINE_JSON}\" benchmarks \"${NAME}\" tolerance_percent)\n"
+        "    if (NOT ERROR)\n"
+        "      string(APPEND ENTRY \", \\\"tolerance_percent\\\": ${LIMIT}\")\n"
+        "    endif()\n"
+        "  endif()\n"
+        "  string(REPLACE \"\\\\\" \"\\\\\\\\\" QUOTED \"${NAME}\")\n"
+        "  string(REPLACE \"\\\"\" \"\\\\\\\"\" QUOTED \"${QUOTED}\")\n"
+        "  string(APPEND RESULTS_JSON \"${SEPARATOR}\\n    \\\"${QUOTED}\\\": { ${ENTRY} }\")\n"
+        "  set(SEPARATOR \",\")\n"
+        "endforeach()\n"
+        "string(APPEND RESULTS_JSON \"\\n  }\\n}\")\n"
+        "if (UPDATE)\n"
+        "  file(WRITE \"${BASELINE}\" \"${RESULTS_JSON}\\n\")\n"
+        "  list(LENGTH NAMES COUNT)\n"
+        "  message(STATUS \"perf-gate: recorded ${COUNT} benchmarks in ${BASELINE}\")\n"
+        "  return()\n"
+        "endif()\n"
+        "\n"
+        "# Compare, over the benchmarks of both the baseline and this run\n"
+        "string(JSON COUNT LENGTH \"${BASELINE_JSON}\" benchmarks)\n"
+        "set(ALL_NAMES ${NAMES})\n"
+        "set(WIDTH 9)\n"
+        "if (COUNT GREATER 0)\n"
+        "  math(EXPR LAST \"${COUNT} - 1\")\n"
+        "  foreach (INDEX RANGE ${LAST})\n"
+        "    string(JSON NAME MEMBER \"${BASELINE_JSON}\" benchmarks ${INDEX})\n"
+        "    if (NOT NAME IN_LIST ALL_NAMES)\n"
+        "      list(APPEND ALL_NAMES \"${NAME}\")\n"
+        "    endif()\n"
+        "  endforeach()\n"
+        "endif()\n"
+        "list(SORT ALL_NAMES)\n"
+        "foreach (NAME IN LISTS ALL_NAMES)\n"
+        "  string(LENGTH \"${NAME}\" LENGTH)\n"
+        "  if (LENGTH GREATER WIDTH)\n"
+        "    set(WIDTH ${LENGTH})\n"
+        "  endif()\n"
+        "endforeach()\n"
+        "\n"
+        "align(TABLE \"benchmark\" ${WIDTH} LEFT)\n"
+        "string(APPEND TABLE \"   baseline ns    current ns    change   limit  status\\n\")\n"
+        "set(FAILURES 0)\n"
+        "foreach (NAME IN LISTS ALL_NAMES)\n"
+        "  string(MD5 KEY \"${NAME}\")\n"
+        "  string(JSON BASE ERROR_VARIABLE ERROR GET \"${BASELINE_JSON}\" benchmarks \"${NAME}\" median_ps)\n"
+        "  if (ERROR)\n"
+        "    set(BASE \"\")\n"
+        "  endif()\n"
+        "  string(JSON LIMIT ERROR_VARIABLE ERROR GET \"${BASELINE_JSON}\" benchmarks \"${NAME}\" tolerance_percent)\n"
+        "  if (ERROR)\n"
+        "    set(LIMIT ${TOLERANCE})\n"
+        "  endif()\n"
+        "  set(CURRENT \"${MEDIAN_${KEY}}\")\n"
+        "\n"
+        "  set(BASE_TEXT \"-\")\n"
+        "  set(CURRENT_TEXT \"-\")\n"
+        "  set(CHANGE_TEXT \"\")\n"
+        "  if (NOT BASE STREQUAL \"\")\n"
+        "    format_ns(BASE_TEXT ${BASE})\n"
+        "  endif()\n"
+        "  if (NOT CURRENT STREQUAL \"\")\n"
+        "    format_ns(CURRENT_TEXT ${CURRENT})\n"
+        "  endif()\n"
+        "  if (BASE STREQUAL \"\")\n"
+        "    set(STATUS \"new\")\n"
+        "  elseif (CURRENT STREQUAL \"\")\n"
+        "    set(STATUS \"missing\")\n"
+        "  else()\n"
+        "    math(EXPR DELTA \"${CURRENT} - ${BASE}\")\n"
+        "    if (BASE GREATER 0)\n"
+        "      math(EXPR PERMILLE \"${DELTA} * 1000 / ${BASE}\")\n"
+        "    else()\n"
+        "      set(PERMILLE 0)\n"
+        "    endif()\n"
+        "    format_change(CHANGE_TEXT ${PERMILLE})\n"
+        "    math(EXPR ALLOWED \"${BASE} * ${LIMIT} / 100\")\n"
+        "    math(EXPR NEGATIVE_DELTA \"0 - ${DELTA}\")\n"
+        "    if (DELTA GREATER ALLOWED AND DELTA GREATER MIN_DELTA_PS)\n"
+        "      set(STATUS \"SLOWER\")\n"
+        "      math(EXPR FAILURES \"${FAILURES} + 1\")\n"
+        "    elseif (NEGATIVE_DELTA GREATER ALLOWED AND NEGATIVE_DELTA GREATER MIN_DELTA_PS)\n"
+        "      set(STATUS \"faster\")\n"
+        "    else()\n"
+        "      set(STATUS \"ok\")\n"
+        "    endif()\n"
+        "  endif()\n"
+        "\n"
+        "  align(COLUMN \"${NAME}\" ${WIDTH} LEFT)\n"
+        "  string(APPEND TABLE \"${COLUMN}\")\n"
+        "  align(COLUMN \"${BASE_TEXT}\" 14 RIGHT)\n"
+        "  string(APPEND TABLE \"${COLUMN}\")\n"
+        "  align(COLUMN \"${CURRENT_TEXT}\" 14 RIGHT)\n"
+        "  string(APPEND TABLE \"${COLUMN}\")\n"
+        "  align(COLUMN \"${CHANGE_TEXT}\" 10 RIGHT)\n"
+        "  string(APPEND TABLE \"${COLUMN}\")\n"
+        "  align(COLUMN \"${LIMIT}%\" 8 RIGHT)\n"
+        "  string(APPEND TABLE \"${COLUMN}  ${STATUS}\\n\")\n"
+        "endforeach()\n"
+        "message(\"${TABLE}\")\n"
+        "\n"
+        "if (FAILURES GREATER 0)\n"
+        "  message(FATAL_ERROR \"perf-gate: ${FAILURES} benchmark(s) slower than the baseline beyond their tolerance. \"\n"
+        "                      \"If that is expected, accept the new times by building the update-perf-baseline target.\")\n"
+        "endif()\n"
+        "message(STATUS \"perf-gate: no benchmark slower than the baseline beyond its tolerance\")\n" },
+    [TEMPLATE_CMAKE_BUILD_PROFILE] = { "CMake/Modules/BuildProfile.cmake",
+        "# Compile-time profiling, with ENABLE_BUILD_PROFILE (the build-profile preset):\n"
+        "#   Clang  -ftime-trace writes a Chrome trace per translation unit next to its object file\n"
+        "#   GCC    -ftime-report, saved next to each object file as <object>.time-report by running\n"
+        "#          this file as the compiler launcher (cmake -P BuildProfile.cmake -- <compiler> <args>)\n"
+        "# The build-profile-report target then runs CMake/Scripts/build_profile_report.py over the build\n"
+        "# tree: the slowest translation units and, from Clang traces, the headers and template\n"
+        "# instantiations that cost the most. ccache is turned off meanwhile, since cache hits compile\n"
+        "# nothing. Profile a clean build ('cmake --workflow --preset build-profile' does), as\n"
+        "# traces of files that did not recompile are left over from earlier builds.\n"
+        "\n"
+        "if (CMAKE_SCRIPT_MODE_FILE)\n"
+        "  # Launcher mode: the arguments after \"--\" are the compiler command line\n"
+        "  set(COMMAND)\n"
+        "  set(OBJECT)\n"
+        "  set(IN_COMMAND FALSE)\n"
+        "  set(NEXT_IS_OBJECT FALSE)\n"
+        "  math(EXPR LAST \"${CMAKE_ARGC} - 1\")\n"
+        "  foreach (INDEX RANGE ${LAST})\n"
+        "    set(ARGUMENT \"${CMAKE_ARGV${INDEX}}\")\n"
+        "    if (IN_COMMAND)\n"
+        "      list(APPEND COMMAND \"${ARGUMENT}\")\n"
+        "      if (NEXT_IS_OBJECT)\n"
+        "        set(OBJECT \"${ARGUMENT}\")\n"
+        "      endif()\n"
+        "      string(COMPARE EQUAL \"${ARGUMENT}\" \"-o\" NEXT_IS_OBJECT)\n"
+        "    elseif (ARGUMENT STREQUAL \"--\")\n"
+        "      set(IN_COMMAND TRUE)\n"
+        "    endif()\n"
+        "  endforeach()\n"
+        "\n"
+        "  execute_process(COMMAND ${COMMAND} -ftime-report RESULT_VARIABLE STATUS ERROR_VARIABLE ERRORS)\n"
+        "  # GCC prints the report after any diagnostics, which still go to the build log\n"
+        "  string(FIND \"${ERRORS}\" \"\\nTime variable\" START)\n"
+        "  if (START LESS 0)\n"
+        "    set(DIAGNOSTICS \"${ERRORS}\")\n"
+        "  else()\n"
+        "    string(SUBSTRING \"${ERRORS}\" 0 ${START} DIAGNOSTICS)\n"
+        "    if (OBJECT)\n"
+        "      string(SUBSTRING \"${ERRORS}\" ${START} -1 REPORT)\n"
+        "      file(WRITE \"${OBJECT}.time-report\" \"${REPORT}\")\n"
+        "    endif()\n"
+        "  endif()\n"
+        "  string(STRIP \"${DIAGNOSTICS}\" DIAGNOSTICS)\n"
+        "  if (DIAGNOSTICS)\n"
+        "    message(NOTICE \"${DIAGNOSTICS}\")\n"
+        "  endif()\n"
+        "  if (NOT STATUS EQUAL 0)\n"
+        "    message(FATAL_ERROR \"compiler exited with ${STATUS}\")\n"
+        "  endif()\n"
+        "  return()\n"
+        "endif()\n"
+        "\n"
+        "include_guard(GLOBAL)\n"
+        "\n"
+        "option(ENABLE_BUILD_PROFILE \"Record the compile time of every translation unit\" OFF)\n"
+        "set(BUILD_PROFILE_TOP 20 CACHE STRING \"Entries per table of the build-profile-report target\")\n"
+        "set(BUILD_PROFILE_GRANULARITY 500 CACHE STRING \"Shortest event, in microseconds, Clang time traces record\")\n"
+        "\n"
+        "if (ENABLE_BUILD_PROFILE)\n"
+        "  set(CMAKE_C_COMPILER_LAUNCHER \"\")\n"
+        "  set(CMAKE_CXX_COMPILER_LAUNCHER \"\")\n"
+        "  if (CMAKE_C_COMPILER_ID MATCHES \"Clang\")\n"
+        "    add_compile_options(-ftime-trace -ftime-trace-granularity=${BUILD_PROFILE_GRANULARITY})\n"
+        "  elseif (CMAKE_C_COMPILER_ID STREQUAL \"GNU\")\n"
+        "    set(CMAKE_C_COMPILER_LAUNCHER \"${CMAKE_COMMAND}\" -P \"${CMAKE_CURRENT_LIST_FILE}\" --)\n"
+        "    set(CMAKE_CXX_COMPILER_LAUNCHER \"${CMAKE_COMMAND}\" -P \"${CMAKE_CURRENT_LIST_FILE}\" --)\n"
+        "  else()\n"
+        "    message(WARNING \"${CMAKE_C_COMPILER_ID} has no per-file compile time report; the build profile will only have Ninja's timings\")\n"
+        "  endif()\n"
+        "\n"
+        "  find_package(Python3 COMPONENTS Interpreter)\n"
+        "  if (Python3_FOUND)\n"
+        "    add_custom_target(build-profile-report\n"
+        "      COMMAND \"${Python3_EXECUTABLE}\" \"${CMAKE_SOURCE_DIR}/CMake/Scripts/build_profile_report.py\"\n"
+        "              \"${CMAKE_BINARY_DIR}\" --top ${BUILD_PROFILE_TOP}\n"
+        "      USES_TERMINAL\n"
+        "      VERBATIM)\n"
+        "  else()\n"
+        "    message(WARNING \"Python 3 not found: no build-profile-report target\")\n"
+        "  endif()\n"
+        "endif()\n" },
+    [TEMPLATE_BUILD_PROFILE_SCRIPT] = { "CMake/Scripts/build_profile_report.py",
+        "#!/usr/bin/env python3\n"
+        "\"\"\"Summarize the compile-time profile of a build tree (see CMake/Modules/BuildProfile.cmake).\n"
+        "\n"
+        "Reads the Clang -ftime-trace files (<object>.json) and the GCC -ftime-report files\n"
+        "(<object>.time-report) under the build directory, falling back to Ninja's .ninja_log for the\n"
+        "time of each translation unit, and prints:\n"
+        "  - the slowest translation units\n"
+        "  - the headers with the largest total parse time over all units, counting nested includes\n"
+        "    (Clang only)\n"
+        "  - the template instantiations with the largest total time (Clang only)\n"
+        "  - the time spent per compiler phase, and the most expensive passes such as preprocessing or\n"
+        "    template instantiation (GCC only)\n"
+        "\"\"\"\n"
+        "\n"
+        "import argparse\n"
+        "import collections\n"
+        "import json\n"
+        "import os\n"
+        "import re\n"
+        "import sys\n"
+        "\n"
+        "# \" phase parsing   :   0.02 ( 67%)   0.00 (  0%)   0.02 ( 50%)  1126k ( 45%)\": usr, sys, wall\n"
+        "GCC_LINE = re.compile(r\"^ (\\S.*?)\\s+:\\s+([\\d.]+)(?: \\(\\s*\\d+%\\))?\\s+([\\d.]+)(?: \\(\\s*\\d+%\\))?\\s+([\\d.]+)\")\n"
+        "TEMPLATE_EVENTS = (\"InstantiateClass\", \"InstantiateFunction\")\n"
+        "\n"
+        "\n"
+        "def unit_name(path, build_dir, suffix):\n"
+        "    return os.path.relpath(path, build_dir)[: -len(suffix)]\n"
+        "\n"
+        "\n"
+        "def read_clang_trace(path):\n"
+        "    \"\"\"Return (total microseconds, events) of a -ftime-trace file, or None if it is not one.\"\"\"\n"
+        "    try:\n"
+        "        with open(path, encoding=\"utf-8\") as file:\n"
+        "            trace = json.load(file)\n"
+        "    except (OSError, ValueError):\n"
+        "        return None\n"
+        "    if not isinstance(trace, dict) or \"traceEvents\" not in trace:\n"
+        "        return None\n"
+        "    events = [event for event in trace[\"traceEvents\"] if event.get(\"ph\") == \"X\"]\n"
+        "    total = max((event.get(\"dur\", 0) for event in events if event.get(\"name\") in (\"ExecuteCompiler\", \"Total ExecuteCompiler\")), default=0)\n"
+        "    return total, events\n"
+        "\n"
+        "\n"
+        "def read_gcc_report(path):\n"
+        "    \"\"\"Return {phase or pass: wall seconds} of a -ftime-report file.\"\"\"\n"
+        "    times = {}\n"
+        "    with open(path, encoding=\"utf-8\", errors=\"replace\") as file:\n"
+        "        for line in file:\n"
+        "            match = GCC_LINE.match(line)\n"
+        "            if match:\n"
+        "                times[match.group(1)] = float(match.group(4))\n"
+        "    return times\n"
+        "\n"
+        "\n"
+        "def read_ninja_log(build_dir):\n"
+        "    \"\"\"Return {output: milliseconds} from the last build of each output in .ninja_log.\"\"\"\n"
+        "    times = {}\n"
+        "    try:\n"
+        "        with open(os.path.join(build_dir, \".ninja_log\"), encoding=\"utf-8\") as file:\n"
+        "            for line in file:\n"
+        "                fields = line.rstrip(\"\\n\").split(\"\\t\")\n"
+        "                if len(fields) >= 4 and not line.startswith(\"#\"):\n"
+        "                    times[fields[3]] = int(fields[1]) - int(fields[0])\n"
+        "    except OSError:\n"
+        "        pass\n"
+        "    return times\n"
+        "\n"
+        "\n"
+        "def print_table(title, header, rows, top):\n"
+        "    print(f\"\\n{title}\")\n"
+        "    print(header)\n"
+        "    for row in rows[:top]:\n"
+        "        print(row)\n"
+        "    if len(rows) > top:\n"
+        "        print(f\"  ... {len(rows) - top} more\")\n"
+        "\n"
+        "\n"
+        "def main():\n"
+        "    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])\n"
+        "    parser.add_argument(\"build_dir\")\n"
+        "    parser.add_argument(\"--top\", type=int, default=20, help=\"entries per table (default 20)\")\n"
+        "    args = parser.parse_args()\n"
+        "    build_dir = os.path.abspath(args.build_dir)\n"
+        "\n"
+        "    units = {}  # translation unit -> milliseconds\n"
+        "    headers = collections.defaultdict(lambda: [0, set()])  # header -> [microseconds, units]\n"
+        "    templates = collections.defaultdict(lambda: [0, 0])  # instantiation -> [microseconds, count]\n"
+        "    phases = collections.Counter()  # GCC phase -> seconds\n"
+        "    passes = collections.Counter()  # GCC pass -> seconds\n"
+        "    source = None\n"
+        "\n"
+        "    for directory, _, files in os.walk(build_dir):\n"
+        "        for name in files:\n"
+        "            path = os.path.join(directory, name)\n"
+        "            if name.endswith(\".time-report\"):\n"
+        "                times = read_gcc_report(path)\n"
+        "                unit = unit_name(path, build_dir, \".time-report\")\n"
+        "                units[unit] = times.get(\"TOTAL\", 0.0) * 1000\n"
+        "                for phase, seconds in times.items():\n"
+        "                    if phase.startswith(\"phase \"):\n"
+        "                        phases[phase[len(\"phase \"):]] += seconds\n"
+        "                    elif phase != \"TOTAL\":\n"
+        "                        passes[phase] += seconds\n"
+        "                source = \"GCC -ftime-report\"\n"
+        "            elif name.endswith(\".json\") and \"CMakeFiles\" in directory:\n"
+        "                trace = read_clang_trace(path)\n"
+        "                if trace is None:\n"
+        "                    continue\n"
+        "                total, events = trace\n"
+        "                unit = unit_name(path, build_dir, \".json\")\n"
+        "                units[unit] = total / 1000\n"
+        "                for event in events:\n"
+        "                    detail = event.get(\"args\", {}).get(\"detail\")\n"
+        "                    if event.get(\"name\") == \"Source\" and detail:\n"
+        "                        headers[detail][0] += event.get(\"dur\", 0)\n"
+        "                        headers[detail][1].add(unit)\n"
+        "                    elif event.get(\"name\") in TEMPLATE_EVENTS and detail:\n"
+        "                        templates[detail][0] += event.get(\"dur\", 0)\n"
+        "                        templates[detail][1] += 1\n"
+        "                source = \"Clang -ftime-trace\"\n"
+        "\n"
+        "    if not units:\n"
+        "        units = {output: ms for output, ms in read_ninja_log(build_dir).items() if output.endswith((\".o\", \".obj\"))}\n"
+        "        source = \"Ninja's .ninja_log\"\n"
+        "    if not units:\n"
+        "        print(f\"No compile-time profile in {build_dir}: configure with -DENABLE_BUILD_PROFILE=ON \"\n"
+        "              \"(or the build-profile preset) and build first.\", file=sys.stderr)\n"
+        "        return 1\n"
+        "\n"
+        "    total = sum(units.values())\n"
+        "    print(f\"Build profile of {len(units)} translation units from {source}: {total / 1000:.2f} s of compilation\")\n"
+        "\n"
+        "    rows = [f\"{ms:10.0f} ms  {unit}\" for unit, ms in sorted(units.items(), key=lambda item: -item[1])]\n"
+        "    print_table(\"Slowest translation units\", f\"{'time':>13}  unit\", rows, args.top)\n"
+        "\n"
+        "    if headers:\n"
+        "        ranked = sorted(headers.items(), key=lambda item: -item[1][0])\n"
+        "        rows = [f\"{us / 1000:10.0f} ms {len(included):6} {us / 1000 / len(included):9.1f} ms  {header}\"\n"
+        "                for header, (us, included) in ranked]\n"
+        "        print_table(\"Most expensive headers (parse time including nested headers, summed over units)\",\n"
+        "                    f\"{'total':>13} {'units':>6} {'average':>12}  header\", rows, args.top)\n"
+        "\n"
+        "    if templates:\n"
+        "        ranked = sorted(templates.items(), key=lambda item: -item[1][0])\n"
+        "        rows = [f\"{us / 1000:10.1f} ms {count:6}  {name}\" for name, (us, count) in ranked]\n"
+        "        print_table(\"Slowest template instantiations (summed over units)\",\n"
+        "                    f\"{'total':>13} {'count':>6}  instantiation\", rows, args.top)\n"
+        "\n"
+        "    if phases:\n"
+        "        rows = [f\"{seconds * 1000:10.0f} ms {100 * seconds / max(sum(phases.values()), 1e-9):5.1f}%  {phase}\"\n"
+        "                for phase, seconds in phases.most_common()]\n"
+        "        print_table(\"Time per compiler phase (summed over units)\", f\"{'time':>13} {'share':>6}  phase\", rows, args.top)\n"
+        "        rows = [f\"{seconds * 1000:10.0f} ms  {name}\" for name, seconds in passes.most_common() if seconds > 0]\n"
+        "        print_table(\"Most expensive compiler passes (summed over units)\", f\"{'time':>13}  pass\", rows, args.top)\n"
+        "    return 0\n"
+        "\n"
+        "\n"
+        "if __name__ == \"__main__\":\n"
+        "    sys.exit(main())\n" },
+    [TEMPLATE_BENCH_SOURCE] = { "bench/bench_{{lib}}.c",
+        "#include \"bench.h\"\n"
+        "#include \"{{lib}}/{{lib}}.h\"\n"
+        "\n"
+        "#ifdef _WIN32\n"
+        "#define NULL_DEVICE \"NUL\"\n"
+        "#else\n"
+        "#define NULL_DEVICE \"/dev/null\"\n"
+        "#endif\n"
+        "\n"
+        "static void bench_hello(void *arg, uint64_t iterations) {\n"
+        "    (void)arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        hello();\n"
+        "        BENCH_CLOBBER_MEMORY();\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int main(int argc, char *argv[]) {\n"
+        "    bench_options options = bench_default_options();\n"
+        "    if (argc > 1) {\n"
+        "        options.repetitions = atoi(argv[1]);\n"
+        "    }\n"
+        "\n"
+        "    // hello() prints; send that to the null device so only the results (on stderr) remain\n"
+        "    if (freopen(NULL_DEVICE, \"w\", stdout) == NULL) {\n"
+        "        perror(\"freopen\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "\n"
+        "    bench_print_header();\n"
+        "    bench_run(\"hello\", bench_hello, NULL, &options);\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_CMAKE_PRESETS] = { "CMakePresets.json",
+        "{\n"
+        "  \"version\": 6,\n"
+        "  \"cmakeMinimumRequired\": { \"major\": 3, \"minor\": 25, \"patch\": 0 },\n"
+        "  \"configurePresets\": [\n"
+        "    {\n"
+        "      \"name\": \"base\",\n"
+        "      \"hidden\": true,\n"
+        "      \"generator\": \"Ninja\",\n"
+        "      \"binaryDir\": \"${sourceDir}/build/${presetName}\"\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"debug\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"Debug\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Debug\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"release\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"Release with LTO\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Release\", \"ENABLE_IPO\": \"ON\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"release-native\",\n"
+        "      \"inherits\": \"release\",\n"
+        "      \"displayName\": \"Release with LTO, tuned for this machine's CPU\",\n"
+        "      \"description\": \"Binaries may not run on other CPUs\",\n"
+        "      \"cacheVariables\": { \"ENABLE_NATIVE_ARCH\": \"ON\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"asan\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"AddressSanitizer and UndefinedBehaviorSanitizer\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Asan\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"tsan\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"ThreadSanitizer\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Tsan\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"profile\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"Optimized with frame pointers and debug info, for profiling\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Profile\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"build-profile\",\n"
+        "      \"inherits\": \"base\",\n"
+        "      \"displayName\": \"Release without LTO or ccache, recording how long every file takes to compile\",\n"
+        "      \"cacheVariables\": { \"CMAKE_BUILD_TYPE\": \"Release\", \"ENABLE_BUILD_PROFILE\": \"ON\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"ci\",\n"
+        "      \"inherits\": \"release\",\n"
+        "      \"displayName\": \"Release with LTO, unity builds and precompiled headers\",\n"
+        "      \"cacheVariables\": { \"ENABLE_UNITY_BUILD\": \"ON\", \"ENABLE_PCH\": \"ON\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"pgo-generate\",\n"
+        "      \"inherits\": \"release\",\n"
+        "      \"displayName\": \"PGO stage 1: instrumented build\",\n"
+        "      \"binaryDir\": \"${sourceDir}/build/pgo\",\n"
+        "      \"cacheVariables\": { \"PGO\": \"GENERATE\" }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"pgo-use\",\n"
+        "      \"inherits\": \"release\",\n"
+        "      \"displayName\": \"PGO stage 2: optimized with the collected profile\",\n"
+        "      \"binaryDir\": \"${sourceDir}/build/pgo\",\n"
+        "      \"cacheVariables\": { \"PGO\": \"USE\" }\n"
+        "    }\n"
+        "  ],\n"
+        "  \"buildPresets\": [\n"
+        "    { \"name\": \"debug\", \"configurePreset\": \"debug\" },\n"
+        "    { \"name\": \"release\", \"configurePreset\": \"release\" },\n"
+        "    { \"name\": \"release-native\", \"configurePreset\": \"release-native\" },\n"
+        "    { \"name\": \"asan\", \"configurePreset\": \"asan\" },\n"
+        "    { \"name\": \"tsan\", \"configurePreset\": \"tsan\" },\n"
+        "    { \"name\": \"profile\", \"configurePreset\": \"profile\" },\n"
+        "    { \"name\": \"perf-record\", \"configurePreset\": \"profile\", \"targets\": [ \"perf-record\" ] },\n"
+        "    { \"name\": \"update-perf-baseline\", \"configurePreset\": \"release\", \"targets\": [ \"update-perf-baseline\" ] },\n"
+        "    { \"name\": \"build-profile\", \"configurePreset\": \"build-profile\", \"cleanFirst\": true },\n"
+        "    { \"name\": \"build-profile-report\", \"configurePreset\": \"build-profile\", \"targets\": [ \"build-profile-report\" ] },\n"
+        "    { \"name\": \"ci\", \"configurePreset\": \"ci\" },\n"
+        "    { \"name\": \"pgo-generate\", \"configurePreset\": \"pgo-generate\" },\n"
+        "    { \"name\": \"pgo-train\", \"configurePreset\": \"pgo-generate\", \"targets\": [ \"pgo-train\" ] },\n"
+        "    { \"name\": \"pgo-use\", \"configurePreset\": \"pgo-use\" }\n"
+        "  ],\n"
+        "  \"testPresets\": [\n"
+        "    {\n"
+        "      \"name\": \"debug\",\n"
+        "      \"configurePreset\": \"debug\",\n"
+        "      \"output\": { \"outputOnFailure\": true },\n"
+        "      \"filter\": { \"exclude\": { \"label\": \"bench|perf\" } }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"release\",\n"
+        "      \"configurePreset\": \"release\",\n"
+        "      \"output\": { \"outputOnFailure\": true },\n"
+        "      \"filter\": { \"exclude\": { \"label\": \"bench|perf\" } }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"asan\",\n"
+        "      \"configurePreset\": \"asan\",\n"
+        "      \"output\": { \"outputOnFailure\": true },\n"
+        "      \"filter\": { \"exclude\": { \"label\": \"bench|perf\" } }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"tsan\",\n"
+        "      \"configurePreset\": \"tsan\",\n"
+        "      \"output\": { \"outputOnFailure\": true },\n"
+        "      \"filter\": { \"exclude\": { \"label\": \"bench|perf\" } }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"bench\",\n"
+        "      \"configurePreset\": \"release\",\n"
+        "      \"output\": { \"verbosity\": \"verbose\" },\n"
+        "      \"filter\": { \"include\": { \"label\": \"bench\" } }\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"perf-gate\",\n"
+        "      \"configurePreset\": \"release\",\n"
+        "      \"output\": { \"outputOnFailure\": true },\n"
+        "      \"filter\": { \"include\": { \"label\": \"perf\" } }\n"
+        "    }\n"
+        "  ],\n"
+        "  \"workflowPresets\": [\n"
+        "    {\n"
+        "      \"name\": \"build-profile\",\n"
+        "      \"steps\": [\n"
+        "        { \"type\": \"configure\", \"name\": \"build-profile\" },\n"
+        "        { \"type\": \"build\", \"name\": \"build-profile\" },\n"
+        "        { \"type\": \"build\", \"name\": \"build-profile-report\" }\n"
+        "      ]\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"pgo-generate\",\n"
+        "      \"steps\": [\n"
+        "        { \"type\": \"configure\", \"name\": \"pgo-generate\" },\n"
+        "        { \"type\": \"build\", \"name\": \"pgo-generate\" },\n"
+        "        { \"type\": \"build\", \"name\": \"pgo-train\" }\n"
+        "      ]\n"
+        "    },\n"
+        "    {\n"
+        "      \"name\": \"pgo-use\",\n"
+        "      \"steps\": [\n"
+        "        { \"type\": \"configure\", \"name\": \"pgo-use\" },\n"
+        "        { \"type\": \"build\", \"name\": \"pgo-use\" }\n"
+        "      ]\n"
+        "    }\n"
+        "  ]\n"
+        "}\n" },
+    [TEMPLATE_CMAKE_OPTIMIZATION] = { "CMake/Modules/Optimization.cmake",
+        "# Code generation options, normally set through the presets in CMakePresets.json:\n"
+        "#   ENABLE_IPO          link-time optimization, where the toolchain supports it\n"
+        "#   ENABLE_NATIVE_ARCH  tune for the CPU of the build machine\n"
+        "#   PGO                 profile-guided optimization stage: OFF, GENERATE or USE\n"
+        "#\n"
+        "# PGO workflow (GCC or Clang), both stages sharing one build directory:\n"
+        "#   cmake --workflow --preset pgo-generate   # instrumented build, then runs PGO_TRAINING_COMMAND\n"
+        "#   cmake --workflow --preset pgo-use        # rebuild using the collected profile\n"
+        "\n"
+        "include_guard(GLOBAL)\n"
+        "\n"
+        "option(ENABLE_IPO \"Enable interprocedural (link-time) optimization\" OFF)\n"
+        "option(ENABLE_NATIVE_ARCH \"Optimize for the build machine's CPU; binaries may not run elsewhere\" OFF)\n"
+        "set(PGO OFF CACHE STRING \"Profile-guided optimization stage: OFF, GENERATE or USE\")\n"
+        "set_property(CACHE PGO PROPERTY STRINGS OFF GENERATE USE)\n"
+        "set(PGO_DIR \"${CMAKE_BINARY_DIR}/pgo-profiles\" CACHE PATH \"Directory profiles are written to and read from\")\n"
+        "set(PGO_TRAINING_COMMAND \"$<TARGET_FILE:{{app}}>\" CACHE STRING\n"
+        "  \"Representative workload run by the pgo-train target (a ;-list; may use generator expressions)\")\n"
+        "\n"
+        "if (ENABLE_IPO)\n"
+        "  include(CheckIPOSupported)\n"
+        "  check_ipo_supported(RESULT IPO_SUPPORTED OUTPUT IPO_OUTPUT LANGUAGES C)\n"
+        "  if (IPO_SUPPORTED)\n"
+        "    set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)\n"
+        "  else()\n"
+        "    message(WARNING \"Link-time optimization is not supported: ${IPO_OUTPUT}\")\n"
+        "  endif()\n"
+        "endif()\n"
+        "\n"
+        "if (ENABLE_NATIVE_ARCH)\n"
+        "  include(CheckCCompilerFlag)\n"
+        "  check_c_compiler_flag(-march=native HAVE_MARCH_NATIVE)\n"
+        "  if (HAVE_MARCH_NATIVE)\n"
+        "    add_compile_options(-march=native)\n"
+        "  else()\n"
+        "    message(WARNING \"${CMAKE_C_COMPILER_ID} does not support -march=native\")\n"
+        "  endif()\n"
+        "endif()\n"
+        "\n"
+        "if (PGO STREQUAL \"GENERATE\")\n"
+        "  if (NOT CMAKE_C_COMPILER_ID MATCHES \"GNU|Clang\")\n"
+        "    message(FATAL_ERROR \"PGO is only set up for GCC and Clang\")\n"
+        "  endif()\n"
+        "  file(MAKE_DIRECTORY \"${PGO_DIR}\")\n"
+        "  add_compile_options(\"-fprofile-generate=${PGO_DIR}\")\n"
+        "  add_link_options(\"-fprofile-generate=${PGO_DIR}\")\n"
+        "  if (CMAKE_C_COMPILER_ID STREQUAL \"GNU\")\n"
+        "    add_compile_options(-fprofile-update=atomic)\n"
+        "  endif()\n"
+        "\n"
+        "  # Profiles accumulate across runs; start from a clean slate, then run the workload\n"
+        "  add_custom_target(pgo-train\n"
+        "    COMMAND \"${CMAKE_COMMAND}\" -E rm -rf \"${PGO_DIR}\"\n"
+        "    COMMAND \"${CMAKE_COMMAND}\" -E make_directory \"${PGO_DIR}\"\n"
+        "    COMMAND ${PGO_TRAINING_COMMAND}\n"
+        "    WORKING_DIRECTORY \"${CMAKE_BINARY_DIR}\"\n"
+        "    COMMENT \"Collecting profiles in ${PGO_DIR}\"\n"
+        "    VERBATIM)\n"
+        "elseif (PGO STREQUAL \"USE\")\n"
+        "  if (CMAKE_C_COMPILER_ID STREQUAL \"GNU\")\n"
+        "    # GCC finds each object's profile by its path, hence the shared build directory\n"
+        "    add_compile_options(\"-fprofile-use=${PGO_DIR}\" -fprofile-correction -Wno-missing-profile)\n"
+        "    add_link_options(\"-fprofile-use=${PGO_DIR}\")\n"
+        "  elseif (CMAKE_C_COMPILER_ID MATCHES \"Clang\")\n"
+        "    # Clang writes raw profiles that have to be merged first\n"
+        "    get_filename_component(COMPILER_DIR \"${CMAKE_C_COMPILER}\" DIRECTORY)\n"
+        "    find_program(LLVM_PROFDATA NAMES llvm-profdata HINTS \"${COMPILER_DIR}\" REQUIRED)\n"
+        "    file(GLOB PGO_RAW_PROFILES \"${PGO_DIR}/*.profraw\")\n"
+        "    if (NOT PGO_RAW_PROFILES)\n"
+        "      message(FATAL_ERROR \"No profiles in ${PGO_DIR}; run the pgo-generate workflow first\")\n"
+        "    endif()\n"
+        "    execute_process(\n"
+        "      COMMAND \"${LLVM_PROFDATA}\" merge \"-output=${PGO_DIR}/merged.profdata\" ${PGO_RAW_PROFILES}\n"
+        "      RESULT_VARIABLE PGO_MERGE_RESULT)\n"
+        "    if (NOT PGO_MERGE_RESULT EQUAL 0)\n"
+        "      message(FATAL_ERROR \"llvm-profdata could not merge the profiles in ${PGO_DIR}\")\n"
+        "    endif()\n"
+        "    add_compile_options(\"-fprofile-use=${PGO_DIR}/merged.profdata\" -Wno-profile-instr-unprofiled)\n"
+        "    add_link_options(\"-fprofile-use=${PGO_DIR}/merged.profdata\")\n"
+        "  else()\n"
+        "    message(FATAL_ERROR \"PGO is only set up for GCC and Clang\")\n"
+        "  endif()\n"
+        "elseif (NOT PGO STREQUAL \"OFF\")\n"
+        "  message(FATAL_ERROR \"PGO must be OFF, GENERATE or USE, not '${PGO}'\")\n"
+        "endif()\n" },
+    [TEMPLATE_CMAKE_ACCELERATION] = { "CMake/Modules/BuildAcceleration.cmake",
+        "# Build throughput options:\n"
+        "#   ENABLE_UNITY_BUILD        compile sources in batches of UNITY_BUILD_BATCH_SIZE files\n"
+        "#   ENABLE_PCH                precompile the library's public header for every target using it\n"
+        "#   ENABLE_COMPILER_LAUNCHER  use ccache or sccache when one is installed\n"
+        "#\n"
+        "# Source files are listed explicitly in each CMakeLists.txt (progen writes them, and\n"
+        "# 'progen update' keeps them in step with the templates), so configuring never re-globs.\n"
+        "\n"
+        "include_guard(GLOBAL)\n"
+        "\n"
+        "option(ENABLE_UNITY_BUILD \"Compile sources in unity batches\" OFF)\n"
+        "set(UNITY_BUILD_BATCH_SIZE 8 CACHE STRING \"Source files per unity batch (0 = one batch per target)\")\n"
+        "option(ENABLE_PCH \"Precompile the library's public header\" OFF)\n"
+        "option(ENABLE_COMPILER_LAUNCHER \"Use ccache or sccache when found\" ON)\n"
+        "\n"
+        "if (ENABLE_UNITY_BUILD)\n"
+        "  set(CMAKE_UNITY_BUILD ON)\n"
+        "  set(CMAKE_UNITY_BUILD_BATCH_SIZE ${UNITY_BUILD_BATCH_SIZE})\n"
+        "endif()\n"
+        "\n"
+        "# A launcher given on the command line (-DCMAKE_C_COMPILER_LAUNCHER=...) wins\n"
+        "if (ENABLE_COMPILER_LAUNCHER AND NOT CMAKE_C_COMPILER_LAUNCHER)\n"
+        "  find_program(COMPILER_LAUNCHER NAMES ccache sccache)\n"
+        "  if (COMPILER_LAUNCHER)\n"
+        "    message(STATUS \"Using compiler launcher ${COMPILER_LAUNCHER}\")\n"
+        "    set(CMAKE_C_COMPILER_LAUNCHER \"${COMPILER_LAUNCHER}\")\n"
+        "    set(CMAKE_CXX_COMPILER_LAUNCHER \"${COMPILER_LAUNCHER}\")\n"
+        "  endif()\n"
+        "endif()\n" },
+    [TEMPLATE_CMAKE_BUILD_TYPES] = { "CMake/Modules/BuildTypes.cmake",
+        "# Extra build types, next to Debug and Release:\n"
+        "#   Asan     AddressSanitizer and UndefinedBehaviorSanitizer, aborting on the first error\n"
+        "#   Tsan     ThreadSanitizer\n"
+        "#   Profile  optimized, with frame pointers and full debug info, for perf and other profilers\n"
+        "#\n"
+        "# With the Profile type, the perf-record target runs the application under 'perf record'\n"
+        "# (options in PERF_RECORD_OPTIONS) and perf-report opens the result.\n"
+        "\n"
+        "include_guard(GLOBAL)\n"
+        "\n"
+        "set(EXTRA_BUILD_TYPES Asan Tsan Profile)\n"
+        "get_property(IS_MULTI_CONFIG GLOBAL PROPERTY GENERATOR_IS_MULTI_CONFIG)\n"
+        "if (IS_MULTI_CONFIG)\n"
+        "  foreach (BUILD_TYPE IN LISTS EXTRA_BUILD_TYPES)\n"
+        "    if (NOT BUILD_TYPE IN_LIST CMAKE_CONFIGURATION_TYPES)\n"
+        "      list(APPEND CMAKE_CONFIGURATION_TYPES ${BUILD_TYPE})\n"
+        "    endif()\n"
+        "  endforeach()\n"
+        "else()\n"
+        "  set_property(CACHE CMAKE_BUILD_TYPE PROPERTY STRINGS Debug Release RelWithDebInfo MinSizeRel ${EXTRA_BUILD_TYPES})\n"
+        "endif()\n"
+        "\n"
+        "if (CMAKE_C_COMPILER_ID MATCHES \"GNU|Clang\")\n"
+        "  set(ASAN_FLAGS \"-O1 -g -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=all\")\n"
+        "  set(TSAN_FLAGS \"-O1 -g -fno-omit-frame-pointer -fsanitize=thread\")\n"
+        "  set(PROFILE_FLAGS \"-O2 -g -fno-omit-frame-pointer -DNDEBUG\")\n"
+        "  set(ASAN_LINK_FLAGS \"-fsanitize=address,undefined\")\n"
+        "  set(TSAN_LINK_FLAGS \"-fsanitize=thread\")\n"
+        "  set(PROFILE_LINK_FLAGS \"\")\n"
+        "elseif (CMAKE_C_COMPILER_ID STREQUAL \"MSVC\")\n"
+        "  set(ASAN_FLAGS \"/O1 /Zi /fsanitize=address\")\n"
+        "  set(TSAN_FLAGS \"\")\n"
+        "  set(PROFILE_FLAGS \"/O2 /Zi /DNDEBUG\")\n"
+        "  set(ASAN_LINK_FLAGS \"/DEBUG /INCREMENTAL:NO\")\n"
+        "  set(TSAN_LINK_FLAGS \"\")\n"
+        "  set(PROFILE_LINK_FLAGS \"/DEBUG /PROFILE\")\n"
+        "endif()\n"
+        "\n"
+        "# project() already created empty entries for the selected type; only fill in empty ones,\n"
+        "# so flags edited in the cache are kept\n"
+        "foreach (BUILD_TYPE IN LISTS EXTRA_BUILD_TYPES)\n"
+        "  string(TOUPPER ${BUILD_TYPE} TYPE)\n"
+        "  foreach (LANG C CXX)\n"
+        "    if (NOT CMAKE_${LANG}_FLAGS_${TYPE})\n"
+        "      set(CMAKE_${LANG}_FLAGS_${TYPE} \"${${TYPE}_FLAGS}\" CACHE STRING\n"
+        "        \"${LANG} flags for the ${BUILD_TYPE} build type\" FORCE)\n"
+        "    endif()\n"
+        "  endforeach()\n"
+        "  foreach (KIND EXE SHARED MODULE)\n"
+        "    if (NOT CMAKE_${KIND}_LINKER_FLAGS_${TYPE})\n"
+        "      set(CMAKE_${KIND}_LINKER_FLAGS_${TYPE} \"${${TYPE}_LINK_FLAGS}\" CACHE STRING\n"
+        "        \"${KIND} linker flags for the ${BUILD_TYPE} build type\" FORCE)\n"
+        "    endif()\n"
+        "  endforeach()\n"
+        "endforeach()\n"
+        "\n"
+        "if (CMAKE_BUILD_TYPE STREQUAL \"Tsan\" AND NOT TSAN_FLAGS)\n"
+        "  message(FATAL_ERROR \"${CMAKE_C_COMPILER_ID} has no ThreadSanitizer\")\n"
+        "endif()\n"
+        "\n"
+        "find_program(PERF_EXECUTABLE perf)\n"
+        "if (PERF_EXECUTABLE)\n"
+        "  set(PERF_RECORD_OPTIONS --call-graph=fp CACHE STRING \"Options for perf record; fp relies on the Profile type\")\n"
+        "  set(PERF_DATA \"${CMAKE_BINARY_DIR}/perf.data\")\n"
+        "  add_custom_target(perf-record\n"
+        "    COMMAND \"${PERF_EXECUTABLE}\" record ${PERF_RECORD_OPTIONS} -o \"${PERF_DATA}\" -- $<TARGET_FILE:{{app}}>\n"
+        "    DEPENDS {{app}}\n"
+        "    WORKING_DIRECTORY \"${CMAKE_BINARY_DIR}\"\n"
+        "    COMMENT \"Recording a profile of {{app}} in ${PERF_DATA}\"\n"
+        "    USES_TERMINAL\n"
+        "    VERBATIM)\n"
+        "  add_custom_target(perf-report\n"
+        "    COMMAND \"${PERF_EXECUTABLE}\" report -i \"${PERF_DATA}\"\n"
+        "    WORKING_DIRECTORY \"${CMAKE_BINARY_DIR}\"\n"
+        "    USES_TERMINAL\n"
+        "    VERBATIM)\n"
+        "endif()\n" },
+    [TEMPLATE_ALLOC_HEADER] = { "{{lib}}/alloc.h",
+        "#ifndef {{LIB}}_ALLOC_H_\n"
+        "#define {{LIB}}_ALLOC_H_\n"
+        "\n"
+        "// Allocators that keep malloc off hot paths:\n"
+        "// - mem_arena hands out memory by bumping a pointer through large blocks. There is no per-object\n"
+        "//   free: everything allocated since a mark is released at once with arena_rewind, or everything\n"
+        "//   with arena_reset.\n"
+        "// - mem_pool hands out objects of one size from chunks, with O(1) pool_alloc and pool_free\n"
+        "//   through a free list threaded through the released objects.\n"
+        "// Neither is thread-safe; give each thread its own or lock around them.\n"
+        "\n"
+        "#include <stddef.h>\n"
+        "#include \"export.h\"\n"
+        "\n"
+        "#define ALLOC_DEFAULT_ALIGNMENT 16\n"
+        "#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)\n"
+        "#define POOL_DEFAULT_CHUNK_OBJECTS 256\n"
+        "\n"
+        "// Debug builds fill new allocations with ALLOC_FILL_BYTE and released memory with\n"
+        "// ALLOC_POISON_BYTE, so uninitialized or stale reads stand out. Define ALLOC_NO_POISON to opt out.\n"
+        "#if defined({{LIB}}_DEBUG) && !defined(ALLOC_NO_POISON)\n"
+        "#define ALLOC_POISON 1\n"
+        "#else\n"
+        "#define ALLOC_POISON 0\n"
+        "#endif\n"
+        "#define ALLOC_FILL_BYTE 0xCD\n"
+        "#define ALLOC_POISON_BYTE 0xDD\n"
+        "\n"
+        "// Under AddressSanitizer, released memory is poisoned for ASan instead, which reports any access\n"
+        "#if defined(__SANITIZE_ADDRESS__)\n"
+        "#define ALLOC_ASAN 1\n"
+        "#elif defined(__has_feature)\n"
+        "#if __has_feature(address_sanitizer)\n"
+        "#define ALLOC_ASAN 1\n"
+        "#endif\n"
+        "#endif\n"
+        "#ifndef ALLOC_ASAN\n"
+        "#define ALLOC_ASAN 0\n"
+        "#endif\n"
+        "\n"
+        "typedef struct arena_block arena_block;\n"
+        "\n"
+        "typedef struct mem_arena {\n"
+        "    arena_block *head;      // block allocations come from; earlier blocks hang off it\n"
+        "    arena_block *spare;     // one released block kept for reuse, so reset loops stay off malloc\n"
+        "    size_t block_size;      // usable size of regular blocks; larger requests get a block of their own\n"
+        "} mem_arena;\n"
+        "\n"
+        "// Position in an arena, for arena_rewind\n"
+        "typedef struct arena_mark {\n"
+        "    arena_block *block;\n"
+        "    size_t used;\n"
+        "} arena_mark;\n"
+        "\n"
+        "// Initialize an empty arena; block_size 0 selects ARENA_DEFAULT_BLOCK_SIZE. Nothing is\n"
+        "// allocated before the first arena_alloc.\n"
+        "{{LIB}}_API void arena_init(mem_arena *arena, size_t block_size);\n"
+        "// Release every block\n"
+        "{{LIB}}_API void arena_destroy(mem_arena *arena);\n"
+        "// Allocate size bytes aligned to ALLOC_DEFAULT_ALIGNMENT; NULL when out of memory\n"
+        "{{LIB}}_API void *arena_alloc(mem_arena *arena, size_t size);\n"
+        "// Allocate size bytes aligned to alignment, a power of two; NULL when out of memory or misaligned\n"
+        "{{LIB}}_API void *arena_alloc_aligned(mem_arena *arena, size_t size, size_t alignment);\n"
+        "// Current position of the arena\n"
+        "{{LIB}}_API arena_mark arena_save(const mem_arena *arena);\n"
+        "// Release everything allocated since mark was saved. Marks saved after it become invalid.\n"
+        "{{LIB}}_API void arena_rewind(mem_arena *arena, arena_mark mark);\n"
+        "// Release everything, keeping one block for the next allocations\n"
+        "{{LIB}}_API void arena_reset(mem_arena *arena);\n"
+        "\n"
+        "typedef struct pool_chunk pool_chunk;\n"
+        "\n"
+        "typedef struct mem_pool {\n"
+        "    void *free_list;        // released objects, linked through their first bytes\n"
+        "    pool_chunk *chunks;     // every chunk, in allocation order; reused in that order after pool_reset\n"
+        "    pool_chunk *current;    // chunk new objects are carved from\n"
+        "    unsigned char *next;    // next never-used object of current\n"
+        "    unsigned char *end;\n"
+        "    size_t object_size;     // requested size, rounded up to the alignment\n"
+        "    size_t alignment;\n"
+        "    size_t chunk_objects;   // objects per chunk\n"
+        "} mem_pool;\n"
+        "\n"
+        "// Initialize an empty pool of object_size-byte objects. alignment 0 selects ALLOC_DEFAULT_ALIGNMENT\n"
+        "// and chunk_objects 0 POOL_DEFAULT_CHUNK_OBJECTS. Returns -1 if alignment is not a power of two\n"
+        "// or the sizes overflow.\n"
+        "{{LIB}}_API int pool_init(mem_pool *pool, size_t object_size, size_t alignment, size_t chunk_objects);\n"
+        "// Release every chunk\n"
+        "{{LIB}}_API void pool_destroy(mem_pool *pool);\n"
+        "// Allocate one object; NULL when out of memory\n"
+        "{{LIB}}_API void *pool_alloc(mem_pool *pool);\n"
+        "// Return an object from pool_alloc to the pool\n"
+        "{{LIB}}_API void pool_free(mem_pool *pool, void *object);\n"
+        "// Release every object at once, keeping the chunks\n"
+        "{{LIB}}_API void pool_reset(mem_pool *pool);\n"
+        "\n"
+        "#endif // !{{LIB}}_ALLOC_H_\n" },
+    [TEMPLATE_ALLOC_SOURCE] = { "{{lib}}/alloc.c",
+        "#include <stdint.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n"
+        "#include \"alloc.h\"\n"
+        "\n"
+        "#if ALLOC_ASAN\n"
+        "#include <sanitizer/asan_interface.h>\n"
+        "#define REGION_POISON(memory, size) ASAN_POISON_MEMORY_REGION(memory, size)\n"
+        "#define REGION_UNPOISON(memory, size) ASAN_UNPOISON_MEMORY_REGION(memory, size)\n"
+        "#else\n"
+        "#define REGION_POISON(memory, size) ((void)(memory), (void)(size))\n"
+        "#define REGION_UNPOISON(memory, size) ((void)(memory), (void)(size))\n"
+        "#endif\n"
+        "\n"
+        "struct arena_block {\n"
+        "    arena_block *prev;\n"
+        "    size_t capacity;\n"
+        "    size_t used;\n"
+        "    unsigned char data[];\n"
+        "};\n"
+        "\n"
+        "struct pool_chunk {\n"
+        "    pool_chunk *next;\n"
+        "    unsigned char *begin;   // first object, aligned\n"
+        "};\n"
+        "\n"
+        "static int is_power_of_two(size_t value) {\n"
+        "    return value != 0 && (value & (value - 1)) == 0;\n"
+        "}\n"
+        "\n"
+        "// Bytes to skip from address to reach the next multiple of alignment\n"
+        "static size_t align_padding(uintptr_t address, size_t alignment) {\n"
+        "    return (size_t)(0 - address) & (alignment - 1);\n"
+        "}\n"
+        "\n"
+        "// Memory being handed out\n"
+        "static void *hand_out(void *memory, size_t size) {\n"
+        "    REGION_UNPOISON(memory, size);\n"
+        "#if ALLOC_POISON\n"
+        "    memset(memory, ALLOC_FILL_BYTE, size);\n"
+        "#endif\n"
+        "    return memory;\n"
+        "}\n"
+        "\n"
+        "// Memory being released. Under ASan, parts of it (alignment padding) may already be poisoned.\n"
+        "static void take_back(void *memory, size_t size) {\n"
+        "#if ALLOC_POISON && !ALLOC_ASAN\n"
+        "    memset(memory, ALLOC_POISON_BYTE, size);\n"
+        "#endif\n"
+        "    REGION_POISON(memory, size);\n"
+        "}\n"
+        "\n"
+        "void arena_init(mem_arena *arena, size_t block_size) {\n"
+        "    arena->head = NULL;\n"
+        "    arena->spare = NULL;\n"
+        "    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;\n"
+        "}\n"
+        "\n"
+        "static void free_block(arena_block *block) {\n"
+        "    REGION_UNPOISON(block->data, block->capacity);\n"
+        "    free(block);\n"
+        "}\n"
+        "\n"
+        "void arena_destroy(mem_arena *arena) {\n"
+        "    arena_reset(arena);\n"
+        "    if (arena->spare != NULL) {\n"
+        "        free_block(arena->spare);\n"
+        "        arena->spare = NULL;\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "// Push a block with at least min_capacity bytes, the spare one if it is large enough\n"
+        "static arena_block *arena_grow(mem_arena *arena, size_t min_capacity) {\n"
+        "    arena_block *block = arena->spare;\n"
+        "    if (block != NULL && block->capacity >= min_capacity) {\n"
+        "        arena->spare = NULL;\n"
+        "    } else {\n"
+        "        size_t capacity = min_capacity > arena->block_size ? min_capacity : arena->block_size;\n"
+        "        if (capacity > SIZE_MAX - sizeof(arena_block)) {\n"
+        "            return NULL;\n"
+        "        }\n"
+        "        block = malloc(sizeof(arena_block) + capacity);\n"
+        "        if (block == NULL) {\n"
+        "            return NULL;\n"
+        "        }\n"
+        "        block->capacity = capacity;\n"
+        "        REGION_POISON(block->data, capacity);\n"
+        "    }\n"
+        "    block->used = 0;\n"
+        "    block->prev = arena->head;\n"
+        "    arena->head = block;\n"
+        "    return block;\n"
+        "}\n"
+        "\n"
+        "void *arena_alloc_aligned(mem_arena *arena, size_t size, size_t alignment) {\n"
+        "    if (!is_power_of_two(alignment)) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "\n"
+        "    arena_block *block = arena->head;\n"
+        "    if (block != NULL) {\n"
+        "        size_t offset = block->used + align_padding((uintptr_t)(block->data + block->used), alignment);\n"
+        "        if (offset <= block->capacity && size <= block->capacity - offset) {\n"
+        "            block->used = offset + size;\n"
+        "            return hand_out(block->data + offset, size);\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    // A new block with room for the worst-case padding\n"
+        "    if (size > SIZE_MAX - alignment) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    block = arena_grow(arena, size + alignment - 1);\n"
+        "    if (block == NULL) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    size_t offset = align_padding((uintptr_t)block->data, alignment);\n"
+        "    block->used = offset + size;\n"
+        "    return hand_out(block->data + offset, size);\n"
+        "}\n"
+        "\n"
+        "void *arena_alloc(mem_arena *arena, size_t size) {\n"
+        "    return arena_alloc_aligned(arena, size, ALLOC_DEFAULT_ALIGNMENT);\n"
+        "}\n"
+        "\n"
+        "arena_mark arena_save(const mem_arena *arena) {\n"
+        "    arena_mark mark = { arena->head, arena->head != NULL ? arena->head->used : 0 };\n"
+        "    return mark;\n"
+        "}\n"
+        "\n"
+        "void arena_rewind(mem_arena *arena, arena_mark mark) {\n"
+        "    while (arena->head != mark.block) {\n"
+        "        arena_block *block = arena->head;\n"
+        "        arena->head = block->prev;\n"
+        "        take_back(block->data, block->used);\n"
+        "        if (arena->spare == NULL && block->capacity == arena->block_size) {\n"
+        "            arena->spare = block;\n"
+        "        } else {\n"
+        "            free_block(block);\n"
+        "        }\n"
+        "    }\n"
+        "    if (mark.block != NULL) {\n"
+        "        take_back(mark.block->data + mark.used, mark.block->used - mark.used);\n"
+        "        mark.block->used = mark.used;\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "void arena_reset(mem_arena *arena) {\n"
+        "    arena_mark start = { NULL, 0 };\n"
+        "    arena_rewind(arena, start);\n"
+        "}\n"
+        "\n"
+        "int pool_init(mem_pool *pool, size_t object_size, size_t alignment, size_t chunk_objects) {\n"
+        "    memset(pool, 0, sizeof(*pool));\n"
+        "    alignment = alignment ? alignment : ALLOC_DEFAULT_ALIGNMENT;\n"
+        "    chunk_objects = chunk_objects ? chunk_objects : POOL_DEFAULT_CHUNK_OBJECTS;\n"
+        "    if (!is_power_of_two(alignment)) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "\n"
+        "    // Released objects hold the free-list link\n"
+        "    if (alignment < sizeof(void *)) {\n"
+        "        alignment = sizeof(void *);\n"
+        "    }\n"
+        "    if (object_size < sizeof(void *)) {\n"
+        "        object_size = sizeof(void *);\n"
+        "    }\n"
+        "    if (object_size > SIZE_MAX - alignment) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    object_size = (object_size + alignment - 1) & ~(alignment - 1);\n"
+        "    if (chunk_objects > (SIZE_MAX - sizeof(pool_chunk) - alignment) / object_size) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "\n"
+        "    pool->object_size = object_size;\n"
+        "    pool->alignment = alignment;\n"
+        "    pool->chunk_objects = chunk_objects;\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "void pool_destroy(mem_pool *pool) {\n"
+        "    size_t bytes = pool->chunk_objects * pool->object_size;\n"
+        "    pool_chunk *chunk = pool->chunks;\n"
+        "    while (chunk != NULL) {\n"
+        "        pool_chunk *next = chunk->next;\n"
+        "        REGION_UNPOISON(chunk->begin, bytes);\n"
+        "        free(chunk);\n"
+        "        chunk = next;\n"
+        "    }\n"
+        "    memset(pool, 0, sizeof(*pool));\n"
+        "}\n"
+        "\n"
+        "// Carve new objects from the next chunk, allocating it if the pool has none left\n"
+        "static int pool_next_chunk(mem_pool *pool) {\n"
+        "    size_t bytes = pool->chunk_objects * pool->object_size;\n"
+        "    pool_chunk *chunk = pool->current != NULL ? pool->current->next : pool->chunks;\n"
+        "    if (chunk == NULL) {\n"
+        "        chunk = malloc(sizeof(pool_chunk) + pool->alignment - 1 + bytes);\n"
+        "        if (chunk == NULL) {\n"
+        "            return -1;\n"
+        "        }\n"
+        "        unsigned char *data = (unsigned char *)(chunk + 1);\n"
+        "        chunk->begin = data + align_padding((uintptr_t)data, pool->alignment);\n"
+        "        chunk->next = NULL;\n"
+        "        REGION_POISON(chunk->begin, bytes);\n"
+        "        if (pool->current != NULL) {\n"
+        "            pool->current->next = chunk;\n"
+        "        } else {\n"
+        "            pool->chunks = chunk;\n"
+        "        }\n"
+        "    }\n"
+        "    pool->current = chunk;\n"
+        "    pool->next = chunk->begin;\n"
+        "    pool->end = chunk->begin + bytes;\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "void *pool_alloc(mem_pool *pool) {\n"
+        "    void *object = pool->free_list;\n"
+        "    if (object != NULL) {\n"
+        "        memcpy(&pool->free_list, object, sizeof(void *));\n"
+        "        return hand_out(object, pool->object_size);\n"
+        "    }\n"
+        "\n"
+        "    if (pool->next == pool->end && pool_next_chunk(pool) != 0) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    object = pool->next;\n"
+        "    pool->next += pool->object_size;\n"
+        "    return hand_out(object, pool->object_size);\n"
+        "}\n"
+        "\n"
+        "void pool_free(mem_pool *pool, void *object) {\n"
+        "    if (object == NULL) {\n"
+        "        return;\n"
+        "    }\n"
+        "    // The link stays addressable; the rest of the object is poisoned\n"
+        "    memcpy(object, &pool->free_list, sizeof(void *));\n"
+        "    take_back((unsigned char *)object + sizeof(void *), pool->object_size - sizeof(void *));\n"
+        "    pool->free_list = object;\n"
+        "}\n"
+        "\n"
+        "void pool_reset(mem_pool *pool) {\n"
+        "    size_t bytes = pool->chunk_objects * pool->object_size;\n"
+        "    for (pool_chunk *chunk = pool->chunks; chunk != NULL; chunk = chunk->next) {\n"
+        "        take_back(chunk->begin, bytes);\n"
+        "    }\n"
+        "    pool->free_list = NULL;\n"
+        "    pool->current = NULL;\n"
+        "    pool->next = NULL;\n"
+        "    pool->end = NULL;\n"
+        "}\n" },
+    [TEMPLATE_ALLOC_TEST] = { "tests/test_alloc.c",
+        "#include <stdint.h>\n"
+        "#include <stdio.h>\n"
+        "#include <string.h>\n"
+        "#include \"{{lib}}/alloc.h\"\n"
+        "\n"
+        "#if ALLOC_ASAN\n"
+        "#include <sanitizer/asan_interface.h>\n"
+        "#endif\n"
+        "\n"
+        "static int failures;\n"
+        "\n"
+        "#define CHECK(condition)                                                                  \\\n"
+        "    do {                                                                                  \\\n"
+        "        if (!(condition)) {                                                               \\\n"
+        "            fprintf(stderr, \"%s:%d: check failed: %s\\n\", __FILE__, __LINE__, #condition); \\\n"
+        "            failures++;                                                                   \\\n"
+        "        }                                                                                 \\\n"
+        "    } while (0)\n"
+        "\n"
+        "static int is_aligned(const void *memory, size_t alignment) {\n"
+        "    return ((uintptr_t)memory & (alignment - 1)) == 0;\n"
+        "}\n"
+        "\n"
+        "// Released memory must not be read back, except through the debug poisoning checks\n"
+        "static void check_released(const unsigned char *memory) {\n"
+        "#if ALLOC_ASAN\n"
+        "    CHECK(__asan_address_is_poisoned(memory));\n"
+        "#elif ALLOC_POISON\n"
+        "    CHECK(*memory == ALLOC_POISON_BYTE);\n"
+        "#else\n"
+        "    (void)memory;\n"
+        "#endif\n"
+        "}\n"
+        "\n"
+        "static void test_arena_alignment(void) {\n"
+        "    mem_arena arena;\n"
+        "    arena_init(&arena, 1024);\n"
+        "    for (size_t alignment = 1; alignment <= 4096; alignment *= 2) {\n"
+        "        char *odd = arena_alloc_aligned(&arena, 1, 1);\n"
+        "        void *memory = arena_alloc_aligned(&arena, 24, alignment);\n"
+        "        CHECK(odd != NULL && memory != NULL);\n"
+        "        CHECK(is_aligned(memory, alignment));\n"
+        "    }\n"
+        "    CHECK(is_aligned(arena_alloc(&arena, 3), ALLOC_DEFAULT_ALIGNMENT));\n"
+        "    CHECK(arena_alloc_aligned(&arena, 8, 24) == NULL);\n"
+        "    arena_destroy(&arena);\n"
+        "}\n"
+        "\n"
+        "static void test_arena_blocks(void) {\n"
+        "    mem_arena arena;\n"
+        "    arena_init(&arena, 256);\n"
+        "\n"
+        "    // Spread over several blocks, plus one larger than a block; nothing may overlap\n"
+        "    unsigned char *chunks[64];\n"
+        "    for (int i = 0; i < 64; ++i) {\n"
+        "        size_t size = i == 40 ? 1000 : 48;\n"
+        "        chunks[i] = arena_alloc(&arena, size);\n"
+        "        CHECK(chunks[i] != NULL);\n"
+        "        memset(chunks[i], i, size);\n"
+        "    }\n"
+        "    for (int i = 0; i < 64; ++i) {\n"
+        "        size_t size = i == 40 ? 1000 : 48;\n"
+        "        for (size_t j = 0; j < size; ++j) {\n"
+        "            if (chunks[i][j] != (unsigned char)i) {\n"
+        "                CHECK(chunks[i][j] == (unsigned char)i);\n"
+        "                break;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    arena_destroy(&arena);\n"
+        "}\n"
+        "\n"
+        "static void test_arena_rewind(void) {\n"
+        "    mem_arena arena;\n"
+        "    arena_init(&arena, 256);\n"
+        "    unsigned char *kept = arena_alloc(&arena, 32);\n"
+        "    memset(kept, 0x11, 32);\n"
+        "\n"
+        "    arena_mark mark = arena_save(&arena);\n"
+        "    unsigned char *first = arena_alloc(&arena, 64);\n"
+        "    for (int i = 0; i < 20; ++i) {\n"
+        "        CHECK(arena_alloc(&arena, 100) != NULL);\n"
+        "    }\n"
+        "    arena_rewind(&arena, mark);\n"
+        "    check_released(first);\n"
+        "    CHECK(arena_alloc(&arena, 64) == first);\n"
+        "    CHECK(kept[0] == 0x11 && kept[31] == 0x11);\n"
+        "\n"
+        "    // After a reset the kept block serves the next allocations\n"
+        "    arena_reset(&arena);\n"
+        "    unsigned char *again = arena_alloc(&arena, 16);\n"
+        "    CHECK(again != NULL);\n"
+        "#if ALLOC_POISON\n"
+        "    CHECK(again[0] == ALLOC_FILL_BYTE && again[15] == ALLOC_FILL_BYTE);\n"
+        "#endif\n"
+        "    arena_destroy(&arena);\n"
+        "    CHECK(arena.head == NULL && arena.spare == NULL);\n"
+        "}\n"
+        "\n"
+        "static void test_pool(void) {\n"
+        "    mem_pool pool;\n"
+        "    CHECK(pool_init(&pool, 24, 3, 0) == -1);\n"
+        "    CHECK(pool_init(&pool, 24, 64, 8) == 0);\n"
+        "\n"
+        "    // Several chunks' worth of distinct, aligned objects\n"
+        "    unsigned char *objects[100];\n"
+        "    for (int i = 0; i < 100; ++i) {\n"
+        "        objects[i] = pool_alloc(&pool);\n"
+        "        CHECK(objects[i] != NULL && is_aligned(objects[i], 64));\n"
+        "        memset(objects[i], i, 24);\n"
+        "    }\n"
+        "    for (int i = 0; i < 100; ++i) {\n"
+        "        CHECK(objects[i][0] == (unsigned char)i && objects[i][23] == (unsigned char)i);\n"
+        "    }\n"
+        "\n"
+        "    // Released objects come back first, most recent first\n"
+        "    pool_free(&pool, objects[10]);\n"
+        "    pool_free(&pool, objects[20]);\n"
+        "    check_released(objects[20] + sizeof(void *));\n"
+        "    CHECK(pool_alloc(&pool) == objects[20]);\n"
+        "    CHECK(pool_alloc(&pool) == objects[10]);\n"
+        "\n"
+        "    // A reset reuses the chunks from the first one\n"
+        "    pool_reset(&pool);\n"
+        "    CHECK(pool_alloc(&pool) == objects[0]);\n"
+        "    pool_destroy(&pool);\n"
+        "}\n"
+        "\n"
+        "int main(void) {\n"
+        "    test_arena_alignment();\n"
+        "    test_arena_blocks();\n"
+        "    test_arena_rewind();\n"
+        "    test_pool();\n"
+        "    if (failures != 0) {\n"
+        "        fprintf(stderr, \"%d check%s failed\\n\", failures, failures == 1 ? \"\" : \"s\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_ALLOC_BENCH] = { "bench/bench_alloc.c",
+        "#include \"bench.h\"\n"
+        "#include \"{{lib}}/alloc.h\"\n"
+        "\n"
+        "// Each iteration allocates and releases one object; objects are taken in batches, so the\n"
+        "// allocator sees BATCH live objects at a time rather than a trivial alloc/free ping-pong\n"
+        "#define BATCH 64\n"
+        "#define OBJECT_SIZE 48\n"
+        "\n"
+        "static void bench_malloc(void *arg, uint64_t iterations) {\n"
+        "    (void)arg;\n"
+        "    void *objects[BATCH];\n"
+        "    for (uint64_t done = 0; done < iterations; done += BATCH) {\n"
+        "        for (int i = 0; i < BATCH; ++i) {\n"
+        "            objects[i] = malloc(OBJECT_SIZE);\n"
+        "            BENCH_DO_NOT_OPTIMIZE(objects[i]);\n"
+        "        }\n"
+        "        for (int i = 0; i < BATCH; ++i) {\n"
+        "            free(objects[i]);\n"
+        "        }\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void bench_arena(void *arg, uint64_t iterations) {\n"
+        "    mem_arena *arena = arg;\n"
+        "    for (uint64_t done = 0; done < iterations; done += BATCH) {\n"
+        "        for (int i = 0; i < BATCH; ++i) {\n"
+        "            void *object = arena_alloc(arena, OBJECT_SIZE);\n"
+        "            BENCH_DO_NOT_OPTIMIZE(object);\n"
+        "        }\n"
+        "        arena_reset(arena);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void bench_pool(void *arg, uint64_t iterations) {\n"
+        "    mem_pool *pool = arg;\n"
+        "    void *objects[BATCH];\n"
+        "    for (uint64_t done = 0; done < iterations; done += BATCH) {\n"
+        "        for (int i = 0; i < BATCH; ++i) {\n"
+        "            objects[i] = pool_alloc(pool);\n"
+        "            BENCH_DO_NOT_OPTIMIZE(objects[i]);\n"
+        "        }\n"
+        "        for (int i = 0; i < BATCH; ++i) {\n"
+        "            pool_free(pool, objects[i]);\n"
+        "        }\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int main(int argc, char *argv[]) {\n"
+        "    bench_options options = bench_default_options();\n"
+        "    if (argc > 1) {\n"
+        "        options.repetitions = atoi(argv[1]);\n"
+        "    }\n"
+        "\n"
+        "    mem_arena arena;\n"
+        "    mem_pool pool;\n"
+        "    arena_init(&arena, 0);\n"
+        "    if (pool_init(&pool, OBJECT_SIZE, 0, 0) != 0) {\n"
+        "        fprintf(stderr, \"pool_init failed\\n\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "\n"
+        "    bench_print_header();\n"
+        "    bench_run(\"malloc/free\", bench_malloc, NULL, &options);\n"
+        "    bench_run(\"arena_alloc/reset\", bench_arena, &arena, &options);\n"
+        "    bench_run(\"pool_alloc/free\", bench_pool, &pool, &options);\n"
+        "\n"
+        "    arena_destroy(&arena);\n"
+        "    pool_destroy(&pool);\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_THREADS_HEADER] = { "{{lib}}/thread_pool.h",
+        "#ifndef {{LIB}}_THREAD_POOL_H_\n"
+        "#define {{LIB}}_THREAD_POOL_H_\n"
+        "\n"
+        "// Work-stealing thread pool. Every worker owns a deque: tasks a worker submits go to the bottom\n"
+        "// of its own deque and it takes them back from there (newest first, while they are hot in\n"
+        "// cache); idle workers steal from the top of the others' deques (oldest first, the largest\n"
+        "// pieces of work). Tasks submitted from outside the pool go through a shared queue.\n"
+        "// Waiting threads run queued tasks instead of blocking while there are any.\n"
+        "\n"
+        "#include <stddef.h>\n"
+        "#include \"export.h\"\n"
+        "\n"
+        "typedef struct thread_pool thread_pool;\n"
+        "\n"
+        "typedef void (*thread_pool_task)(void *arg);\n"
+        "\n"
+        "// Loop body of thread_pool_parallel_for, called with [begin, end) subranges\n"
+        "typedef void (*thread_pool_range)(void *arg, size_t begin, size_t end);\n"
+        "\n"
+        "// Start a pool with the given number of worker threads, 0 for one per online core; NULL on failure\n"
+        "{{LIB}}_API thread_pool *thread_pool_create(int workers);\n"
+        "// Run the remaining tasks, stop the workers and free the pool\n"
+        "{{LIB}}_API void thread_pool_destroy(thread_pool *pool);\n"
+        "// Number of worker threads\n"
+        "{{LIB}}_API int thread_pool_size(const thread_pool *pool);\n"
+        "// Queue task(arg) to run on a worker; -1 when out of memory, in which case the task does not run\n"
+        "{{LIB}}_API int thread_pool_submit(thread_pool *pool, thread_pool_task task, void *arg);\n"
+        "// Wait until every task submitted so far, and every task they submitted, has run. Must not be\n"
+        "// called from inside a task, which would wait for itself.\n"
+        "{{LIB}}_API void thread_pool_wait(thread_pool *pool);\n"
+        "// Call body over [begin, end) split into subranges of about grain items (0 picks a size that\n"
+        "// gives every worker several), in parallel, and return once all have run. May be nested.\n"
+        "{{LIB}}_API void thread_pool_parallel_for(thread_pool *pool, size_t begin, size_t end, size_t grain,\n"
+        "        thread_pool_range body, void *arg);\n"
+        "\n"
+        "#endif // !{{LIB}}_THREAD_POOL_H_\n" },
+    [TEMPLATE_THREADS_SOURCE] = { "{{lib}}/thread_pool.c",
+        "#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)\n"
+        "#define _POSIX_C_SOURCE 200809L\n"
+        "#endif\n"
+        "#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)\n"
+        "#define _DARWIN_C_SOURCE  // _SC_NPROCESSORS_ONLN\n"
+        "#endif\n"
+        "\n"
+        "#include <stdatomic.h>\n"
+        "#include <stdint.h>\n"
+        "#include <stdlib.h>\n"
+        "#include \"thread_pool.h\"\n"
+        "\n"
+        "#ifdef _WIN32\n"
+        "#include <windows.h>\n"
+        "typedef HANDLE os_thread;\n"
+        "typedef SRWLOCK os_mutex;\n"
+        "typedef CONDITION_VARIABLE os_cond;\n"
+        "#define os_mutex_init(mutex) (InitializeSRWLock(mutex), 0)\n"
+        "#define os_mutex_destroy(mutex) ((void)(mutex))\n"
+        "#define os_mutex_lock(mutex) AcquireSRWLockExclusive(mutex)\n"
+        "#define os_mutex_unlock(mutex) ReleaseSRWLockExclusive(mutex)\n"
+        "#define os_cond_init(cond) (InitializeConditionVariable(cond), 0)\n"
+        "#define os_cond_destroy(cond) ((void)(cond))\n"
+        "#define os_cond_wait(cond, mutex) SleepConditionVariableSRW(cond, mutex, INFINITE, 0)\n"
+        "#define os_cond_signal(cond) WakeConditionVariable(cond)\n"
+        "#define os_cond_broadcast(cond) WakeAllConditionVariable(cond)\n"
+        "#define THREAD_LOCAL __declspec(thread)\n"
+        "#else\n"
+        "#include <pthread.h>\n"
+        "#include <unistd.h>\n"
+        "typedef pthread_t os_thread;\n"
+        "typedef pthread_mutex_t os_mutex;\n"
+        "typedef pthread_cond_t os_cond;\n"
+        "#define os_mutex_init(mutex) pthread_mutex_init(mutex, NULL)\n"
+        "#define os_mutex_destroy(mutex) pthread_mutex_destroy(mutex)\n"
+        "#define os_mutex_lock(mutex) pthread_mutex_lock(mutex)\n"
+        "#define os_mutex_unlock(mutex) pthread_mutex_unlock(mutex)\n"
+        "#define os_cond_init(cond) pthread_cond_init(cond, NULL)\n"
+        "#define os_cond_destroy(cond) pthread_cond_destroy(cond)\n"
+        "#define os_cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)\n"
+        "#define os_cond_signal(cond) pthread_cond_signal(cond)\n"
+        "#define os_cond_broadcast(cond) pthread_cond_broadcast(cond)\n"
+        "#define THREAD_LOCAL _Thread_local\n"
+        "#endif\n"
+        "\n"
+        "#define DEQUE_CAPACITY 4096     // tasks per worker deque, a power of two; the overflow goes to the shared queue\n"
+        "#define CACHE_LINE 64\n"
+        "\n"
+        "typedef struct pool_task {\n"
+        "    thread_pool_task function;\n"
+        "    void *arg;\n"
+        "    atomic_size_t *pending;     // counter of the tasks a waiter is waiting for\n"
+        "    struct pool_task *next;     // link in the shared queue\n"
+        "    int owned;                  // allocated by thread_pool_submit, freed once run\n"
+        "} pool_task;\n"
+        "\n"
+        "// A chunk of a parallel for\n"
+        "typedef struct range_task {\n"
+        "    pool_task task;\n"
+        "    thread_pool_range body;\n"
+        "    void *arg;\n"
+        "    size_t begin;\n"
+        "    size_t end;\n"
+        "} range_task;\n"
+        "\n"
+        "// A worker and its deque (Chase and Lev, \"Dynamic Circular Work-Stealing Deque\", with the\n"
+        "// memory orderings of Le et al., \"Correct and Efficient Work-Stealing for Weak Memory Models\").\n"
+        "// Only the owner pushes and pops at the bottom; thieves take from the top. The fences of the\n"
+        "// paper are folded into sequentially consistent accesses, which ThreadSanitizer understands.\n"
+        "typedef struct worker {\n"
+        "    thread_pool *pool;\n"
+        "    os_thread thread;\n"
+        "    atomic_llong top;\n"
+        "    char top_padding[CACHE_LINE];   // keep thieves' writes to top off the owner's cache line\n"
+        "    atomic_llong bottom;\n"
+        "    char bottom_padding[CACHE_LINE];\n"
+        "    _Atomic(pool_task *) slots[DEQUE_CAPACITY];\n"
+        "} worker;\n"
+        "\n"
+        "struct thread_pool {\n"
+        "    worker *workers;\n"
+        "    int worker_count;\n"
+        "    atomic_size_t queued;       // tasks in the deques and the shared queue\n"
+        "    atomic_size_t pending;      // tasks from thread_pool_submit not finished yet\n"
+        "    atomic_size_t shared_count; // tasks in the shared queue, to skip the lock when it is empty\n"
+        "    atomic_int sleepers;        // threads blocked, or about to block, on wake\n"
+        "    atomic_int stopping;\n"
+        "    os_mutex lock;              // guards the shared queue and the sleep/wake handshake\n"
+        "    os_cond wake;               // a task was queued, a wait finished, or the pool is stopping\n"
+        "    pool_task *shared_head;     // tasks from outside the pool and deque overflow, oldest first\n"
+        "    pool_task *shared_tail;\n"
+        "};\n"
+        "\n"
+        "static THREAD_LOCAL worker *current_worker;\n"
+        "static THREAD_LOCAL unsigned int steal_seed;\n"
+        "\n"
+        "static int deque_push(worker *self, pool_task *task) {\n"
+        "    long long bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed);\n"
+        "    long long top = atomic_load_explicit(&self->top, memory_order_acquire);\n"
+        "    if (bottom - top >= DEQUE_CAPACITY) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    atomic_store_explicit(&self->slots[bottom & (DEQUE_CAPACITY - 1)], task, memory_order_relaxed);\n"
+        "    atomic_store_explicit(&self->bottom, bottom + 1, memory_order_release);\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "static pool_task *deque_pop(worker *self) {\n"
+        "    long long bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed) - 1;\n"
+        "    atomic_store_explicit(&self->bottom, bottom, memory_order_seq_cst);\n"
+        "    long long top = atomic_load_explicit(&self->top, memory_order_seq_cst);\n"
+        "    if (top > bottom) {\n"
+        "        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_release);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    pool_task *task = atomic_load_explicit(&self->slots[bottom & (DEQUE_CAPACITY - 1)], memory_order_relaxed);\n"
+        "    if (top == bottom) {\n"
+        "        // Last task: race the thieves for it\n"
+        "        if (!atomic_compare_exchange_strong_explicit(&self->top, &top, top + 1, memory_order_seq_cst,\n"
+        "                                                     memory_order_relaxed)) {\n"
+        "            task = NULL;\n"
+        "        }\n"
+        "        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_release);\n"
+        "    }\n"
+        "    return task;\n"
+        "}\n"
+        "\n"
+        "static pool_task *deque_steal(worker *victim) {\n"
+        "    long long top = atomic_load_explicit(&victim->top, memory_order_seq_cst);\n"
+        "    long long bottom = atomic_load_explicit(&victim->bottom, memory_order_seq_cst);\n"
+        "    if (top >= bottom) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    pool_task *task = atomic_load_explicit(&victim->slots[top & (DEQUE_CAPACITY - 1)], memory_order_relaxed);\n"
+        "    if (!atomic_compare_exchange_strong_explicit(&victim->top, &top, top + 1, memory_order_seq_cst,\n"
+        "                                                 memory_order_relaxed)) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    return task;\n"
+        "}\n"
+        "\n"
+        "static void push_task(thread_pool *pool, pool_task *task) {\n"
+        "    // Counted before it is visible, so the count never drops below the tasks a thread can find\n"
+        "    atomic_fetch_add(&pool->queued, 1);\n"
+        "    worker *self = current_worker;\n"
+        "    if (self == NULL || self->pool != pool || deque_push(self, task) != 0) {\n"
+        "        task->next = NULL;\n"
+        "        os_mutex_lock(&pool->lock);\n"
+        "        if (pool->shared_tail != NULL) {\n"
+        "            pool->shared_tail->next = task;\n"
+        "        } else {\n"
+        "            pool->shared_head = task;\n"
+        "        }\n"
+        "        pool->shared_tail = task;\n"
+        "        atomic_fetch_add(&pool->shared_count, 1);\n"
+        "        os_mutex_unlock(&pool->lock);\n"
+        "    }\n"
+        "\n"
+        "    // Sleepers register before checking queued, so one of the two sides always sees the other\n"
+        "    if (atomic_load(&pool->sleepers) > 0) {\n"
+        "        os_mutex_lock(&pool->lock);\n"
+        "        os_cond_signal(&pool->wake);\n"
+        "        os_mutex_unlock(&pool->lock);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static pool_task *take_shared_task(thread_pool *pool) {\n"
+        "    if (atomic_load(&pool->shared_count) == 0) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    os_mutex_lock(&pool->lock);\n"
+        "    pool_task *task = pool->shared_head;\n"
+        "    if (task != NULL) {\n"
+        "        pool->shared_head = task->next;\n"
+        "        if (pool->shared_head == NULL) {\n"
+        "            pool->shared_tail = NULL;\n"
+        "        }\n"
+        "        atomic_fetch_sub(&pool->shared_count, 1);\n"
+        "    }\n"
+        "    os_mutex_unlock(&pool->lock);\n"
+        "    return task;\n"
+        "}\n"
+        "\n"
+        "// Find a task to run: own deque, shared queue, then the other workers' deques from a random one\n"
+        "static pool_task *find_task(thread_pool *pool, worker *self) {\n"
+        "    pool_task *task = self != NULL ? deque_pop(self) : NULL;\n"
+        "    if (task == NULL) {\n"
+        "        task = take_shared_task(pool);\n"
+        "    }\n"
+        "    if (task == NULL) {\n"
+        "        if (steal_seed == 0) {\n"
+        "            steal_seed = (unsigned int)(uintptr_t)&steal_seed | 1;\n"
+        "        }\n"
+        "        steal_seed ^= steal_seed << 13;\n"
+        "        steal_seed ^= steal_seed >> 17;\n"
+        "        steal_seed ^= steal_seed << 5;\n"
+        "        int start = (int)(steal_seed % (unsigned int)pool->worker_count);\n"
+        "        for (int i = 0; i < pool->worker_count && task == NULL; ++i) {\n"
+        "            worker *victim = &pool->workers[(start + i) % pool->worker_count];\n"
+        "            if (victim != self) {\n"
+        "                task = deque_steal(victim);\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    if (task != NULL) {\n"
+        "        atomic_fetch_sub(&pool->queued, 1);\n"
+        "    }\n"
+        "    return task;\n"
+        "}\n"
+        "\n"
+        "static void run_task(thread_pool *pool, pool_task *task) {\n"
+        "    // The task may live in the waiter's memory, which is gone once the count reaches zero\n"
+        "    atomic_size_t *pending = task->pending;\n"
+        "    if (task->owned) {\n"
+        "        pool_task copy = *task;\n"
+        "        free(task);\n"
+        "        copy.function(copy.arg);\n"
+        "    } else {\n"
+        "        task->function(task->arg);\n"
+        "    }\n"
+        "    if (atomic_fetch_sub(pending, 1) == 1 && atomic_load(&pool->sleepers) > 0) {\n"
+        "        os_mutex_lock(&pool->lock);\n"
+        "        os_cond_broadcast(&pool->wake);\n"
+        "        os_mutex_unlock(&pool->lock);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "// Run tasks until *pending drops to zero, sleeping while there is nothing to run\n"
+        "static void wait_for(thread_pool *pool, atomic_size_t *pending) {\n"
+        "    worker *self = current_worker != NULL && current_worker->pool == pool ? current_worker : NULL;\n"
+        "    while (atomic_load(pending) != 0) {\n"
+        "        pool_task *task = find_task(pool, self);\n"
+        "        if (task != NULL) {\n"
+        "            run_task(pool, task);\n"
+        "            continue;\n"
+        "        }\n"
+        "        os_mutex_lock(&pool->lock);\n"
+        "        atomic_fetch_add(&pool->sleepers, 1);\n"
+        "        while (atomic_load(pending) != 0 && atomic_load(&pool->queued) == 0) {\n"
+        "            os_cond_wait(&pool->wake, &pool->lock);\n"
+        "        }\n"
+        "        atomic_fetch_sub(&pool->sleepers, 1);\n"
+        "        os_mutex_unlock(&pool->lock);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void worker_main(worker *self) {\n"
+        "    thread_pool *pool = self->pool;\n"
+        "    current_worker = self;\n"
+        "    for (;;) {\n"
+        "        pool_task *task = find_task(pool, self);\n"
+        "        if (task != NULL) {\n"
+        "            run_task(pool, task);\n"
+        "            continue;\n"
+        "        }\n"
+        "        os_mutex_lock(&pool->lock);\n"
+        "        atomic_fetch_add(&pool->sleepers, 1);\n"
+        "        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stopping)) {\n"
+        "            os_cond_wait(&pool->wake, &pool->lock);\n"
+        "        }\n"
+        "        atomic_fetch_sub(&pool->sleepers, 1);\n"
+        "        int done = atomic_load(&pool->stopping) && atomic_load(&pool->queued) == 0;\n"
+        "        os_mutex_unlock(&pool->lock);\n"
+        "        if (done) {\n"
+        "            return;\n"
+        "        }\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "#ifdef _WIN32\n"
+        "static DWORD WINAPI worker_entry(LPVOID arg) {\n"
+        "    worker_main(arg);\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "static int os_thread_start(os_thread *thread, worker *self) {\n"
+        "    *thread = CreateThread(NULL, 0, worker_entry, self, 0, NULL);\n"
+        "    return *thread != NULL ? 0 : -1;\n"
+        "}\n"
+        "\n"
+        "static void os_thread_join(os_thread thread) {\n"
+        "    WaitForSingleObject(thread, INFINITE);\n"
+        "    CloseHandle(thread);\n"
+        "}\n"
+        "\n"
+        "static int online_cores(void) {\n"
+        "    SYSTEM_INFO info;\n"
+        "    GetSystemInfo(&info);\n"
+        "    return (int)info.dwNumberOfProcessors;\n"
+        "}\n"
+        "#else\n"
+        "static void *worker_entry(void *arg) {\n"
+        "    worker_main(arg);\n"
+        "    return NULL;\n"
+        "}\n"
+        "\n"
+        "static int os_thread_start(os_thread *thread, worker *self) {\n"
+        "    return pthread_create(thread, NULL, worker_entry, self) == 0 ? 0 : -1;\n"
+        "}\n"
+        "\n"
+        "static void os_thread_join(os_thread thread) {\n"
+        "    pthread_join(thread, NULL);\n"
+        "}\n"
+        "\n"
+        "static int online_cores(void) {\n"
+        "    long cores = sysconf(_SC_NPROCESSORS_ONLN);\n"
+        "    return cores > 0 ? (int)cores : 1;\n"
+        "}\n"
+        "#endif\n"
+        "\n"
+        "// Stop and join the first started workers, then free the pool\n"
+        "static void stop_workers(thread_pool *pool, int started) {\n"
+        "    os_mutex_lock(&pool->lock);\n"
+        "    atomic_store(&pool->stopping, 1);\n"
+        "    os_cond_broadcast(&pool->wake);\n"
+        "    os_mutex_unlock(&pool->lock);\n"
+        "    for (int i = 0; i < started; ++i) {\n"
+        "        os_thread_join(pool->workers[i].thread);\n"
+        "    }\n"
+        "    os_cond_destroy(&pool->wake);\n"
+        "    os_mutex_destroy(&pool->lock);\n"
+        "    free(pool->workers);\n"
+        "    free(pool);\n"
+        "}\n"
+        "\n"
+        "thread_pool *thread_pool_create(int workers) {\n"
+        "    if (workers <= 0) {\n"
+        "        workers = online_cores();\n"
+        "    }\n"
+        "    thread_pool *pool = calloc(1, sizeof(*pool));\n"
+        "    if (pool == NULL) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    pool->workers = calloc((size_t)workers, sizeof(*pool->workers));\n"
+        "    if (pool->workers == NULL || os_mutex_init(&pool->lock) != 0) {\n"
+        "        free(pool->workers);\n"
+        "        free(pool);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    if (os_cond_init(&pool->wake) != 0) {\n"
+        "        os_mutex_destroy(&pool->lock);\n"
+        "        free(pool->workers);\n"
+        "        free(pool);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    pool->worker_count = workers;\n"
+        "    atomic_init(&pool->queued, 0);\n"
+        "    atomic_init(&pool->pending, 0);\n"
+        "    atomic_init(&pool->shared_count, 0);\n"
+        "    atomic_init(&pool->sleepers, 0);\n"
+        "    atomic_init(&pool->stopping, 0);\n"
+        "    for (int i = 0; i < workers; ++i) {\n"
+        "        pool->workers[i].pool = pool;\n"
+        "        atomic_init(&pool->workers[i].top, 0);\n"
+        "        atomic_init(&pool->workers[i].bottom, 0);\n"
+        "    }\n"
+        "\n"
+        "    for (int i = 0; i < workers; ++i) {\n"
+        "        if (os_thread_start(&pool->workers[i].thread, &pool->workers[i]) != 0) {\n"
+        "            stop_workers(pool, i);\n"
+        "            return NULL;\n"
+        "        }\n"
+        "    }\n"
+        "    return pool;\n"
+        "}\n"
+        "\n"
+        "void thread_pool_destroy(thread_pool *pool) {\n"
+        "    if (pool != NULL) {\n"
+        "        stop_workers(pool, pool->worker_count);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int thread_pool_size(const thread_pool *pool) {\n"
+        "    return pool->worker_count;\n"
+        "}\n"
+        "\n"
+        "int thread_pool_submit(thread_pool *pool, thread_pool_task function, void *arg) {\n"
+        "    pool_task *task = malloc(sizeof(*task));\n"
+        "    if (task == NULL) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    task->function = function;\n"
+        "    task->arg = arg;\n"
+        "    task->pending = &pool->pending;\n"
+        "    task->owned = 1;\n"
+        "    atomic_fetch_add(&pool->pending, 1);\n"
+        "    push_task(pool, task);\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "void thread_pool_wait(thread_pool *pool) {\n"
+        "    wait_for(pool, &pool->pending);\n"
+        "}\n"
+        "\n"
+        "static void run_range(void *arg) {\n"
+        "    range_task *range = arg;\n"
+        "    range->body(range->arg, range->begin, range->end);\n"
+        "}\n"
+        "\n"
+        "void thread_pool_parallel_for(thread_pool *pool, size_t begin, size_t end, size_t grain,\n"
+        "                              thread_pool_range body, void *arg) {\n"
+        "    if (begin >= end) {\n"
+        "        return;\n"
+        "    }\n"
+        "    size_t count = end - begin;\n"
+        "    if (grain == 0) {\n"
+        "        grain = count / ((size_t)pool->worker_count * 8);\n"
+        "        grain = grain ? grain : 1;\n"
+        "    }\n"
+        "    size_t chunks = count / grain + (count % grain != 0);\n"
+        "    range_task *ranges = chunks > 1 ? malloc((chunks - 1) * sizeof(*ranges)) : NULL;\n"
+        "    if (ranges == NULL) {\n"
+        "        body(arg, begin, end);\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    // Queue every chunk but the first, which the caller runs before helping with the others\n"
+        "    atomic_size_t pending;\n"
+        "    atomic_init(&pending, chunks - 1);\n"
+        "    for (size_t i = 1; i < chunks; ++i) {\n"
+        "        range_task *range = &ranges[i - 1];\n"
+        "        range->task.function = run_range;\n"
+        "        range->task.arg = range;\n"
+        "        range->task.pending = &pending;\n"
+        "        range->task.owned = 0;\n"
+        "        range->body = body;\n"
+        "        range->arg = arg;\n"
+        "        range->begin = begin + i * grain;\n"
+        "        range->end = i + 1 < chunks ? range->begin + grain : end;\n"
+        "        push_task(pool, &range->task);\n"
+        "    }\n"
+        "    body(arg, begin, begin + grain);\n"
+        "    wait_for(pool, &pending);\n"
+        "    free(ranges);\n"
+        "}\n" },
+    [TEMPLATE_THREADS_TEST] = { "tests/test_thread_pool.c",
+        "#include <stdatomic.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include \"{{lib}}/thread_pool.h\"\n"
+        "\n"
+        "// Stress test, meant to be run under the Tsan build type as well: many tiny tasks, tasks that\n"
+        "// submit tasks, nested parallel loops and pools destroyed with work still queued\n"
+        "\n"
+        "static int failures;\n"
+        "\n"
+        "#define CHECK(condition)                                                                  \\\n"
+        "    do {                                                                                  \\\n"
+        "        if (!(condition)) {                                                               \\\n"
+        "            fprintf(stderr, \"%s:%d: check failed: %s\\n\", __FILE__, __LINE__, #condition); \\\n"
+        "            failures++;                                                                   \\\n"
+        "        }                                                                                 \\\n"
+        "    } while (0)\n"
+        "\n"
+        "typedef struct tree {\n"
+        "    thread_pool *pool;\n"
+        "    atomic_long leaves;\n"
+        "    int depth;\n"
+        "} tree;\n"
+        "\n"
+        "static void count_task(void *arg) {\n"
+        "    atomic_fetch_add((atomic_long *)arg, 1);\n"
+        "}\n"
+        "\n"
+        "static void test_submit(thread_pool *pool) {\n"
+        "    atomic_long counter;\n"
+        "    atomic_init(&counter, 0);\n"
+        "    for (int i = 0; i < 20000; ++i) {\n"
+        "        CHECK(thread_pool_submit(pool, count_task, &counter) == 0);\n"
+        "    }\n"
+        "    thread_pool_wait(pool);\n"
+        "    CHECK(atomic_load(&counter) == 20000);\n"
+        "}\n"
+        "\n"
+        "// A node submits its two children; the leaves count themselves\n"
+        "typedef struct node {\n"
+        "    tree *tree;\n"
+        "    int depth;\n"
+        "} node;\n"
+        "\n"
+        "static void node_task(void *arg) {\n"
+        "    node *self = arg;\n"
+        "    if (self->depth == self->tree->depth) {\n"
+        "        atomic_fetch_add(&self->tree->leaves, 1);\n"
+        "        free(self);\n"
+        "        return;\n"
+        "    }\n"
+        "    for (int i = 0; i < 2; ++i) {\n"
+        "        node *child = malloc(sizeof(*child));\n"
+        "        if (child == NULL) {\n"
+        "            abort();\n"
+        "        }\n"
+        "        child->tree = self->tree;\n"
+        "        child->depth = self->depth + 1;\n"
+        "        if (thread_pool_submit(self->tree->pool, node_task, child) != 0) {\n"
+        "            abort();\n"
+        "        }\n"
+        "    }\n"
+        "    free(self);\n"
+        "}\n"
+        "\n"
+        "static void test_nested_submit(thread_pool *pool) {\n"
+        "    tree work = { pool, 0, 12 };\n"
+        "    node *root = malloc(sizeof(*root));\n"
+        "    CHECK(root != NULL);\n"
+        "    root->tree = &work;\n"
+        "    root->depth = 0;\n"
+        "    CHECK(thread_pool_submit(pool, node_task, root) == 0);\n"
+        "    thread_pool_wait(pool);\n"
+        "    CHECK(atomic_load(&work.leaves) == 1L << 12);\n"
+        "}\n"
+        "\n"
+        "typedef struct loop {\n"
+        "    thread_pool *pool;\n"
+        "    unsigned char *visits;\n"
+        "    size_t inner;\n"
+        "} loop;\n"
+        "\n"
+        "static void visit(void *arg, size_t begin, size_t end) {\n"
+        "    loop *self = arg;\n"
+        "    for (size_t i = begin; i < end; ++i) {\n"
+        "        self->visits[i]++;\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void visit_rows(void *arg, size_t begin, size_t end) {\n"
+        "    loop *self = arg;\n"
+        "    for (size_t row = begin; row < end; ++row) {\n"
+        "        loop inner = { self->pool, self->visits + row * self->inner, 0 };\n"
+        "        thread_pool_parallel_for(self->pool, 0, self->inner, 7, visit, &inner);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static int visited_once(const unsigned char *visits, size_t count) {\n"
+        "    for (size_t i = 0; i < count; ++i) {\n"
+        "        if (visits[i] != 1) {\n"
+        "            return 0;\n"
+        "        }\n"
+        "    }\n"
+        "    return 1;\n"
+        "}\n"
+        "\n"
+        "static void test_parallel_for(thread_pool *pool) {\n"
+        "    enum { ROWS = 64, COLUMNS = 1000 };\n"
+        "    unsigned char *visits = calloc(ROWS * COLUMNS, 1);\n"
+        "    CHECK(visits != NULL);\n"
+        "\n"
+        "    loop flat = { pool, visits, 0 };\n"
+        "    thread_pool_parallel_for(pool, 0, ROWS * COLUMNS, 0, visit, &flat);\n"
+        "    CHECK(visited_once(visits, ROWS * COLUMNS));\n"
+        "\n"
+        "    // Nested loops, each subrange visited by exactly one chunk\n"
+        "    loop nested = { pool, calloc(ROWS * COLUMNS, 1), COLUMNS };\n"
+        "    CHECK(nested.visits != NULL);\n"
+        "    thread_pool_parallel_for(pool, 0, ROWS, 1, visit_rows, &nested);\n"
+        "    CHECK(visited_once(nested.visits, ROWS * COLUMNS));\n"
+        "\n"
+        "    // Empty and single-item ranges\n"
+        "    thread_pool_parallel_for(pool, 5, 5, 0, visit, &flat);\n"
+        "    thread_pool_parallel_for(pool, 0, 1, 0, visit, &flat);\n"
+        "    CHECK(visits[0] == 2 && visits[1] == 1);\n"
+        "\n"
+        "    free(nested.visits);\n"
+        "    free(visits);\n"
+        "}\n"
+        "\n"
+        "static void test_destroy_with_queued_tasks(void) {\n"
+        "    for (int round = 0; round < 20; ++round) {\n"
+        "        atomic_long counter;\n"
+        "        atomic_init(&counter, 0);\n"
+        "        thread_pool *pool = thread_pool_create(round % 4 + 1);\n"
+        "        CHECK(pool != NULL);\n"
+        "        for (int i = 0; i < 500; ++i) {\n"
+        "            thread_pool_submit(pool, count_task, &counter);\n"
+        "        }\n"
+        "        thread_pool_destroy(pool);\n"
+        "        CHECK(atomic_load(&counter) == 500);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int main(void) {\n"
+        "    // One worker per core, and more workers than cores so that small machines see contention too\n"
+        "    int sizes[] = { 0, 8 };\n"
+        "    for (int i = 0; i < 2; ++i) {\n"
+        "        thread_pool *pool = thread_pool_create(sizes[i]);\n"
+        "        CHECK(pool != NULL);\n"
+        "        if (pool == NULL) {\n"
+        "            return 1;\n"
+        "        }\n"
+        "        CHECK(thread_pool_size(pool) > 0 && (sizes[i] == 0 || thread_pool_size(pool) == sizes[i]));\n"
+        "        for (int round = 0; round < 5; ++round) {\n"
+        "            test_submit(pool);\n"
+        "            test_nested_submit(pool);\n"
+        "            test_parallel_for(pool);\n"
+        "        }\n"
+        "        thread_pool_destroy(pool);\n"
+        "    }\n"
+        "    test_destroy_with_queued_tasks();\n"
+        "\n"
+        "    if (failures != 0) {\n"
+        "        fprintf(stderr, \"%d check%s failed\\n\", failures, failures == 1 ? \"\" : \"s\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_THREADS_BENCH] = { "bench/bench_thread_pool.c",
+        "#include \"bench.h\"\n"
+        "#include \"{{lib}}/thread_pool.h\"\n"
+        "\n"
+        "// Scaling of thread_pool_parallel_for over a compute-bound loop with 1, 2, 4, ... workers up to\n"
+        "// one per core, and the cost of submitting and waiting for an empty task\n"
+        "\n"
+        "#define ITEMS (1 << 18)\n"
+        "#define ROUNDS 32\n"
+        "\n"
+        "typedef struct kernel {\n"
+        "    thread_pool *pool;\n"
+        "    uint32_t *data;\n"
+        "} kernel;\n"
+        "\n"
+        "static void mix(void *arg, size_t begin, size_t end) {\n"
+        "    uint32_t *data = arg;\n"
+        "    for (size_t i = begin; i < end; ++i) {\n"
+        "        uint32_t value = data[i];\n"
+        "        for (int round = 0; round < ROUNDS; ++round) {\n"
+        "            value ^= value << 13;\n"
+        "            value ^= value >> 17;\n"
+        "            value ^= value << 5;\n"
+        "        }\n"
+        "        data[i] = value;\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void bench_parallel_for(void *arg, uint64_t iterations) {\n"
+        "    kernel *self = arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        thread_pool_parallel_for(self->pool, 0, ITEMS, 0, mix, self->data);\n"
+        "        BENCH_CLOBBER_MEMORY();\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void empty_task(void *arg) {\n"
+        "    (void)arg;\n"
+        "}\n"
+        "\n"
+        "static void bench_submit(void *arg, uint64_t iterations) {\n"
+        "    thread_pool *pool = arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        thread_pool_submit(pool, empty_task, NULL);\n"
+        "    }\n"
+        "    thread_pool_wait(pool);\n"
+        "}\n"
+        "\n"
+        "int main(int argc, char *argv[]) {\n"
+        "    bench_options options = bench_default_options();\n"
+        "    if (argc > 1) {\n"
+        "        options.repetitions = atoi(argv[1]);\n"
+        "    }\n"
+        "\n"
+        "    kernel work = { NULL, malloc(ITEMS * sizeof(uint32_t)) };\n"
+        "    thread_pool *all = thread_pool_create(0);\n"
+        "    if (work.data == NULL || all == NULL) {\n"
+        "        fprintf(stderr, \"out of memory\\n\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    for (size_t i = 0; i < ITEMS; ++i) {\n"
+        "        work.data[i] = (uint32_t)i + 1;\n"
+        "    }\n"
+        "    int cores = thread_pool_size(all);\n"
+        "\n"
+        "    bench_print_header();\n"
+        "    bench_run(\"submit+wait\", bench_submit, all, &options);\n"
+        "    thread_pool_destroy(all);\n"
+        "\n"
+        "    double single = 0;\n"
+        "    for (int workers = 1;; workers = workers * 2 < cores ? workers * 2 : cores) {\n"
+        "        char name[32];\n"
+        "        snprintf(name, sizeof(name), \"parallel_for/%d\", workers);\n"
+        "        work.pool = thread_pool_create(workers);\n"
+        "        if (work.pool == NULL) {\n"
+        "            fprintf(stderr, \"thread_pool_create failed\\n\");\n"
+        "            return 1;\n"
+        "        }\n"
+        "        bench_result result = bench_run(name, bench_parallel_for, &work, &options);\n"
+        "        thread_pool_destroy(work.pool);\n"
+        "        if (workers == 1) {\n"
+        "            single = result.median_ns;\n"
+        "        } else {\n"
+        "            fprintf(stderr, \"%-24s %12.2fx\\n\", \"  speedup\", single / result.median_ns);\n"
+        "        }\n"
+        "        if (workers == cores) {\n"
+        "            break;\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    free(work.data);\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_SIMD_HEADER] = { "{{lib}}/simd.h",
+        "#ifndef {{LIB}}_SIMD_H_\n"
+        "#define {{LIB}}_SIMD_H_\n"
+        "\n"
+        "// Numeric kernels with one implementation per instruction set. The first kernel call picks the\n"
+        "// best variant the CPU supports (cpuid on x86, getauxval on 32-bit ARM Linux; AArch64 always has\n"
+        "// NEON), unless the {{LIB}}_SIMD environment variable names another supported one, e.g.\n"
+        "// {{LIB}}_SIMD=avx2 on CPUs that clock down under AVX-512. Each variant lives in its own\n"
+        "// simd_<isa>.c, compiled with that instruction set enabled; simd.c holds the dispatch and the\n"
+        "// scalar reference the others are tested against.\n"
+        "\n"
+        "#include <stddef.h>\n"
+        "#include \"export.h\"\n"
+        "\n"
+        "typedef enum simd_variant {\n"
+        "    SIMD_SCALAR,    // portable C, the reference\n"
+        "    SIMD_SSE2,\n"
+        "    SIMD_AVX2,      // with FMA\n"
+        "    SIMD_AVX512,    // AVX-512F\n"
+        "    SIMD_NEON,\n"
+        "    SIMD_VARIANT_COUNT\n"
+        "} simd_variant;\n"
+        "\n"
+        "// Sum of a[i] * b[i]\n"
+        "{{LIB}}_API float simd_dot(const float *a, const float *b, size_t count);\n"
+        "// y[i] += alpha * x[i]\n"
+        "{{LIB}}_API void simd_saxpy(float alpha, const float *x, float *y, size_t count);\n"
+        "\n"
+        "// Is the variant built into the library and supported by this CPU?\n"
+        "{{LIB}}_API int simd_supported(simd_variant variant);\n"
+        "// Run the kernels of a supported variant from now on; -1 if it is not supported\n"
+        "{{LIB}}_API int simd_select(simd_variant variant);\n"
+        "// Variant the kernels run, picking one first if none is selected yet\n"
+        "{{LIB}}_API simd_variant simd_active(void);\n"
+        "// Name of a variant as {{LIB}}_SIMD takes it: scalar, sse2, avx2, avx512 or neon\n"
+        "{{LIB}}_API const char *simd_name(simd_variant variant);\n"
+        "\n"
+        "#endif // !{{LIB}}_SIMD_H_\n" },
+    [TEMPLATE_SIMD_KERNELS] = { "{{lib}}/simd_kernels.h",
+        "#ifndef {{LIB}}_SIMD_KERNELS_H_\n"
+        "#define {{LIB}}_SIMD_KERNELS_H_\n"
+        "\n"
+        "// Kernel table of one variant, private to the library\n"
+        "\n"
+        "#include <stddef.h>\n"
+        "#include \"simd.h\"\n"
+        "\n"
+        "typedef struct simd_kernels {\n"
+        "    simd_variant variant;\n"
+        "    float (*dot)(const float *a, const float *b, size_t count);\n"
+        "    void (*saxpy)(float alpha, const float *x, float *y, size_t count);\n"
+        "} simd_kernels;\n"
+        "\n"
+        "// Tables of the simd_<isa>.c files, NULL when the compiler did not enable the instruction set for\n"
+        "// the file. The compiler may use the instruction set anywhere in such a file, the table getter\n"
+        "// included, so simd.c calls it only once the CPU is known to support it.\n"
+        "const simd_kernels *simd_sse2_kernels(void);\n"
+        "const simd_kernels *simd_avx2_kernels(void);\n"
+        "const simd_kernels *simd_avx512_kernels(void);\n"
+        "const simd_kernels *simd_neon_kernels(void);\n"
+        "\n"
+        "#endif // !{{LIB}}_SIMD_KERNELS_H_\n" },
+    [TEMPLATE_SIMD_SOURCE] = { "{{lib}}/simd.c",
+        "#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)\n"
+        "#define _CRT_SECURE_NO_WARNINGS  // getenv\n"
+        "#endif\n"
+        "\n"
+        "#include <stdatomic.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n"
+        "#include \"simd_kernels.h\"\n"
+        "\n"
+        "#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)\n"
+        "#define SIMD_X86 1\n"
+        "#ifdef _MSC_VER\n"
+        "#include <intrin.h>\n"
+        "#else\n"
+        "#include <cpuid.h>\n"
+        "#endif\n"
+        "#elif defined(__arm__) && defined(__linux__)\n"
+        "#include <sys/auxv.h>\n"
+        "#define SIMD_HWCAP_NEON (1u << 12)\n"
+        "#endif\n"
+        "\n"
+        "static float scalar_dot(const float *a, const float *b, size_t count) {\n"
+        "    float sum = 0.0f;\n"
+        "    for (size_t i = 0; i < count; ++i) {\n"
+        "        sum += a[i] * b[i];\n"
+        "    }\n"
+        "    return sum;\n"
+        "}\n"
+        "\n"
+        "static void scalar_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    for (size_t i = 0; i < count; ++i) {\n"
+        "        y[i] += alpha * x[i];\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels scalar_kernels = { SIMD_SCALAR, scalar_dot, scalar_saxpy };\n"
+        "\n"
+        "static const char *const variant_names[SIMD_VARIANT_COUNT] = { \"scalar\", \"sse2\", \"avx2\", \"avx512\", \"neon\" };\n"
+        "\n"
+        "// Kernels in use, NULL until the first call picks them\n"
+        "static _Atomic(const simd_kernels *) active_kernels;\n"
+        "\n"
+        "#ifdef SIMD_X86\n"
+        "static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4]) {\n"
+        "#ifdef _MSC_VER\n"
+        "    int values[4];\n"
+        "    __cpuidex(values, (int)leaf, (int)subleaf);\n"
+        "    for (int i = 0; i < 4; ++i) {\n"
+        "        registers[i] = (unsigned int)values[i];\n"
+        "    }\n"
+        "#else\n"
+        "    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);\n"
+        "#endif\n"
+        "}\n"
+        "\n"
+        "// Register state the operating system saves on context switches (XCR0)\n"
+        "static unsigned long long enabled_state(void) {\n"
+        "#ifdef _MSC_VER\n"
+        "    return _xgetbv(0);\n"
+        "#else\n"
+        "    unsigned int low, high;\n"
+        "    __asm__ volatile(\"xgetbv\" : \"=a\"(low), \"=d\"(high) : \"c\"(0));\n"
+        "    return (unsigned long long)high << 32 | low;\n"
+        "#endif\n"
+        "}\n"
+        "#endif\n"
+        "\n"
+        "// Variants the CPU (and OS) can run, as a bit set\n"
+        "static unsigned int detect_cpu(void) {\n"
+        "    unsigned int variants = 1u << SIMD_SCALAR;\n"
+        "#ifdef SIMD_X86\n"
+        "    unsigned int leaf0[4], leaf1[4], leaf7[4] = { 0, 0, 0, 0 };\n"
+        "    cpuid(0, 0, leaf0);\n"
+        "    cpuid(1, 0, leaf1);\n"
+        "    if (leaf0[0] >= 7) {\n"
+        "        cpuid(7, 0, leaf7);\n"
+        "    }\n"
+        "    // AVX registers are only usable when the OS saves them: XMM and YMM state for AVX2, opmask and\n"
+        "    // ZMM state as well for AVX-512\n"
+        "    unsigned long long state = (leaf1[2] >> 27 & 1) ? enabled_state() : 0;\n"
+        "    int avx = (leaf1[2] >> 28 & 1) && (state & 0x6) == 0x6;\n"
+        "    if (leaf1[3] >> 26 & 1) {\n"
+        "        variants |= 1u << SIMD_SSE2;\n"
+        "    }\n"
+        "    if (avx && (leaf1[2] >> 12 & 1) && (leaf7[1] >> 5 & 1)) {\n"
+        "        variants |= 1u << SIMD_AVX2;\n"
+        "    }\n"
+        "    if (avx && (state & 0xE6) == 0xE6 && (leaf7[1] >> 16 & 1)) {\n"
+        "        variants |= 1u << SIMD_AVX512;\n"
+        "    }\n"
+        "#elif defined(__aarch64__) || defined(_M_ARM64)\n"
+        "    variants |= 1u << SIMD_NEON;\n"
+        "#elif defined(__arm__) && defined(__linux__)\n"
+        "    if (getauxval(AT_HWCAP) & SIMD_HWCAP_NEON) {\n"
+        "        variants |= 1u << SIMD_NEON;\n"
+        "    }\n"
+        "#endif\n"
+        "    return variants;\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels *variant_kernels(simd_variant variant) {\n"
+        "    // Detected once; racing first calls store the same value\n"
+        "    static atomic_uint cpu_variants;\n"
+        "    unsigned int variants = atomic_load_explicit(&cpu_variants, memory_order_relaxed);\n"
+        "    if (variants == 0) {\n"
+        "        variants = detect_cpu();\n"
+        "        atomic_store_explicit(&cpu_variants, variants, memory_order_relaxed);\n"
+        "    }\n"
+        "    if ((unsigned int)variant >= SIMD_VARIANT_COUNT || !(variants & 1u << variant)) {\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    switch (variant) {\n"
+        "    case SIMD_SSE2:\n"
+        "        return simd_sse2_kernels();\n"
+        "    case SIMD_AVX2:\n"
+        "        return simd_avx2_kernels();\n"
+        "    case SIMD_AVX512:\n"
+        "        return simd_avx512_kernels();\n"
+        "    case SIMD_NEON:\n"
+        "        return simd_neon_kernels();\n"
+        "    default:\n"
+        "        return &scalar_kernels;\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "// Pick the variant named by {{LIB}}_SIMD if it is supported, the widest supported one otherwise\n"
+        "static const simd_kernels *pick_kernels(void) {\n"
+        "    const char *name = getenv(\"{{LIB}}_SIMD\");\n"
+        "    for (int i = 0; name != NULL && i < SIMD_VARIANT_COUNT; ++i) {\n"
+        "        if (strcmp(name, variant_names[i]) == 0 && variant_kernels((simd_variant)i) != NULL) {\n"
+        "            return variant_kernels((simd_variant)i);\n"
+        "        }\n"
+        "    }\n"
+        "    for (int i = SIMD_VARIANT_COUNT - 1; i > SIMD_SCALAR; --i) {\n"
+        "        if (variant_kernels((simd_variant)i) != NULL) {\n"
+        "            return variant_kernels((simd_variant)i);\n"
+        "        }\n"
+        "    }\n"
+        "    return &scalar_kernels;\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels *kernels(void) {\n"
+        "    const simd_kernels *current = atomic_load_explicit(&active_kernels, memory_order_acquire);\n"
+        "    if (current == NULL) {\n"
+        "        current = pick_kernels();\n"
+        "        atomic_store_explicit(&active_kernels, current, memory_order_release);\n"
+        "    }\n"
+        "    return current;\n"
+        "}\n"
+        "\n"
+        "float simd_dot(const float *a, const float *b, size_t count) {\n"
+        "    return kernels()->dot(a, b, count);\n"
+        "}\n"
+        "\n"
+        "void simd_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    kernels()->saxpy(alpha, x, y, count);\n"
+        "}\n"
+        "\n"
+        "int simd_supported(simd_variant variant) {\n"
+        "    return variant_kernels(variant) != NULL;\n"
+        "}\n"
+        "\n"
+        "int simd_select(simd_variant variant) {\n"
+        "    const simd_kernels *selected = variant_kernels(variant);\n"
+        "    if (selected == NULL) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    atomic_store_explicit(&active_kernels, selected, memory_order_release);\n"
+        "    return 0;\n"
+        "}\n"
+        "\n"
+        "simd_variant simd_active(void) {\n"
+        "    return kernels()->variant;\n"
+        "}\n"
+        "\n"
+        "const char *simd_name(simd_variant variant) {\n"
+        "    return (unsigned int)variant < SIMD_VARIANT_COUNT ? variant_names[variant] : \"unknown\";\n"
+        "}\n" },
+    [TEMPLATE_SIMD_SSE2] = { "{{lib}}/simd_sse2.c",
+        "#include \"simd_kernels.h\"\n"
+        "\n"
+        "// Built with -msse2 where SSE2 is not the baseline (32-bit x86); see CMakeLists.txt\n"
+        "#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)\n"
+        "#include <emmintrin.h>\n"
+        "\n"
+        "static float sse2_dot(const float *a, const float *b, size_t count) {\n"
+        "    // Two accumulators hide the latency of the additions\n"
+        "    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 8 <= count; i += 8) {\n"
+        "        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));\n"
+        "        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));\n"
+        "    }\n"
+        "    __m128 sum = _mm_add_ps(sum0, sum1);\n"
+        "    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));\n"
+        "    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));\n"
+        "    float result = _mm_cvtss_f32(sum);\n"
+        "    for (; i < count; ++i) {\n"
+        "        result += a[i] * b[i];\n"
+        "    }\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "static void sse2_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    __m128 scale = _mm_set1_ps(alpha);\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 4 <= count; i += 4) {\n"
+        "        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(scale, _mm_loadu_ps(x + i))));\n"
+        "    }\n"
+        "    for (; i < count; ++i) {\n"
+        "        y[i] += alpha * x[i];\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels sse2_kernels = { SIMD_SSE2, sse2_dot, sse2_saxpy };\n"
+        "#endif\n"
+        "\n"
+        "const simd_kernels *simd_sse2_kernels(void) {\n"
+        "#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)\n"
+        "    return &sse2_kernels;\n"
+        "#else\n"
+        "    return NULL;\n"
+        "#endif\n"
+        "}\n" },
+    [TEMPLATE_SIMD_AVX2] = { "{{lib}}/simd_avx2.c",
+        "#include \"simd_kernels.h\"\n"
+        "\n"
+        "// Built with -mavx2 -mfma (/arch:AVX2 with MSVC, which implies FMA); see CMakeLists.txt\n"
+        "#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))\n"
+        "#include <immintrin.h>\n"
+        "\n"
+        "static float avx2_dot(const float *a, const float *b, size_t count) {\n"
+        "    // Four accumulators keep two FMA units busy despite their four-cycle latency\n"
+        "    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();\n"
+        "    __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 32 <= count; i += 32) {\n"
+        "        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);\n"
+        "        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);\n"
+        "        sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), sum2);\n"
+        "        sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), sum3);\n"
+        "    }\n"
+        "    for (; i + 8 <= count; i += 8) {\n"
+        "        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);\n"
+        "    }\n"
+        "    __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));\n"
+        "    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));\n"
+        "    half = _mm_add_ps(half, _mm_movehl_ps(half, half));\n"
+        "    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));\n"
+        "    float result = _mm_cvtss_f32(half);\n"
+        "    for (; i < count; ++i) {\n"
+        "        result += a[i] * b[i];\n"
+        "    }\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "static void avx2_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    __m256 scale = _mm256_set1_ps(alpha);\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 8 <= count; i += 8) {\n"
+        "        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(scale, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));\n"
+        "    }\n"
+        "    for (; i < count; ++i) {\n"
+        "        y[i] += alpha * x[i];\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels avx2_kernels = { SIMD_AVX2, avx2_dot, avx2_saxpy };\n"
+        "#endif\n"
+        "\n"
+        "const simd_kernels *simd_avx2_kernels(void) {\n"
+        "#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))\n"
+        "    return &avx2_kernels;\n"
+        "#else\n"
+        "    return NULL;\n"
+        "#endif\n"
+        "}\n" },
+    [TEMPLATE_SIMD_AVX512] = { "{{lib}}/simd_avx512.c",
+        "#include \"simd_kernels.h\"\n"
+        "\n"
+        "// Built with -mavx512f (/arch:AVX512 with MSVC); see CMakeLists.txt\n"
+        "#ifdef __AVX512F__\n"
+        "#include <immintrin.h>\n"
+        "\n"
+        "static float avx512_dot(const float *a, const float *b, size_t count) {\n"
+        "    __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 32 <= count; i += 32) {\n"
+        "        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);\n"
+        "        sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum1);\n"
+        "    }\n"
+        "    // Masked loads handle the tail without a scalar loop\n"
+        "    for (; i < count; i += 16) {\n"
+        "        __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);\n"
+        "        sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), sum0);\n"
+        "    }\n"
+        "    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));\n"
+        "}\n"
+        "\n"
+        "static void avx512_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    __m512 scale = _mm512_set1_ps(alpha);\n"
+        "    for (size_t i = 0; i < count; i += 16) {\n"
+        "        __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);\n"
+        "        __m512 result = _mm512_fmadd_ps(scale, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));\n"
+        "        _mm512_mask_storeu_ps(y + i, mask, result);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels avx512_kernels = { SIMD_AVX512, avx512_dot, avx512_saxpy };\n"
+        "#endif\n"
+        "\n"
+        "const simd_kernels *simd_avx512_kernels(void) {\n"
+        "#ifdef __AVX512F__\n"
+        "    return &avx512_kernels;\n"
+        "#else\n"
+        "    return NULL;\n"
+        "#endif\n"
+        "}\n" },
+    [TEMPLATE_SIMD_NEON] = { "{{lib}}/simd_neon.c",
+        "#include \"simd_kernels.h\"\n"
+        "\n"
+        "// Always built on AArch64; built with -mfpu=neon on 32-bit ARM, see CMakeLists.txt\n"
+        "#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)\n"
+        "#include <arm_neon.h>\n"
+        "\n"
+        "static float neon_dot(const float *a, const float *b, size_t count) {\n"
+        "    float32x4_t sum0 = vdupq_n_f32(0.0f), sum1 = vdupq_n_f32(0.0f);\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 8 <= count; i += 8) {\n"
+        "#if defined(__aarch64__) || defined(_M_ARM64)\n"
+        "        sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));\n"
+        "        sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));\n"
+        "#else\n"
+        "        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));\n"
+        "        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));\n"
+        "#endif\n"
+        "    }\n"
+        "    float32x4_t sum = vaddq_f32(sum0, sum1);\n"
+        "#if defined(__aarch64__) || defined(_M_ARM64)\n"
+        "    float result = vaddvq_f32(sum);\n"
+        "#else\n"
+        "    float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));\n"
+        "    float result = vget_lane_f32(vpadd_f32(pair, pair), 0);\n"
+        "#endif\n"
+        "    for (; i < count; ++i) {\n"
+        "        result += a[i] * b[i];\n"
+        "    }\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "static void neon_saxpy(float alpha, const float *x, float *y, size_t count) {\n"
+        "    size_t i = 0;\n"
+        "    for (; i + 4 <= count; i += 4) {\n"
+        "#if defined(__aarch64__) || defined(_M_ARM64)\n"
+        "        vst1q_f32(y + i, vfmaq_n_f32(vld1q_f32(y + i), vld1q_f32(x + i), alpha));\n"
+        "#else\n"
+        "        vst1q_f32(y + i, vmlaq_n_f32(vld1q_f32(y + i), vld1q_f32(x + i), alpha));\n"
+        "#endif\n"
+        "    }\n"
+        "    for (; i < count; ++i) {\n"
+        "        y[i] += alpha * x[i];\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static const simd_kernels neon_kernels = { SIMD_NEON, neon_dot, neon_saxpy };\n"
+        "#endif\n"
+        "\n"
+        "const simd_kernels *simd_neon_kernels(void) {\n"
+        "#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)\n"
+        "    return &neon_kernels;\n"
+        "#else\n"
+        "    return NULL;\n"
+        "#endif\n"
+        "}\n" },
+    [TEMPLATE_SIMD_TEST] = { "tests/test_simd.c",
+        "#include <float.h>\n"
+        "#include <stdint.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include \"{{lib}}/simd.h\"\n"
+        "\n"
+        "// Every variant this CPU supports against the scalar reference, over lengths around the vector\n"
+        "// widths and misaligned starts. Results may differ by rounding: the variants add in another order\n"
+        "// and may fuse multiplies and additions, so they are compared within the error bound of the sums.\n"
+        "\n"
+        "static int failures;\n"
+        "\n"
+        "#define CHECK(condition)                                                                  \\\n"
+        "    do {                                                                                  \\\n"
+        "        if (!(condition)) {                                                               \\\n"
+        "            fprintf(stderr, \"%s:%d: check failed: %s\\n\", __FILE__, __LINE__, #condition); \\\n"
+        "            failures++;                                                                   \\\n"
+        "        }                                                                                 \\\n"
+        "    } while (0)\n"
+        "\n"
+        "#define MAX_COUNT 4099\n"
+        "#define MAX_OFFSET 3\n"
+        "\n"
+        "static uint32_t random_state = 12345;\n"
+        "\n"
+        "static float random_float(void) {\n"
+        "    random_state ^= random_state << 13;\n"
+        "    random_state ^= random_state >> 17;\n"
+        "    random_state ^= random_state << 5;\n"
+        "    return (float)(random_state >> 8) / (float)(1u << 23) - 1.0f;\n"
+        "}\n"
+        "\n"
+        "// fabs without libm\n"
+        "static double absolute(double value) {\n"
+        "    return value < 0 ? -value : value;\n"
+        "}\n"
+        "\n"
+        "static void check_variant(simd_variant variant, const float *a, const float *b, size_t count) {\n"
+        "    float *reference = malloc((count + 1) * sizeof(float));\n"
+        "    float *result = malloc((count + 1) * sizeof(float));\n"
+        "    CHECK(reference != NULL && result != NULL);\n"
+        "    if (reference == NULL || result == NULL) {\n"
+        "        free(reference);\n"
+        "        free(result);\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    // Both errors are below count * FLT_EPSILON times the sum of the magnitudes of the products\n"
+        "    double magnitude = 0.0;\n"
+        "    for (size_t i = 0; i < count; ++i) {\n"
+        "        magnitude += absolute((double)a[i] * b[i]);\n"
+        "    }\n"
+        "    simd_select(SIMD_SCALAR);\n"
+        "    float expected = simd_dot(a, b, count);\n"
+        "    simd_select(variant);\n"
+        "    float actual = simd_dot(a, b, count);\n"
+        "    if (absolute((double)actual - expected) > 2.0 * (double)(count + 1) * FLT_EPSILON * magnitude) {\n"
+        "        fprintf(stderr, \"%s: simd_dot of %zu items: %g, expected %g\\n\", simd_name(variant), count, actual, expected);\n"
+        "        failures++;\n"
+        "    }\n"
+        "\n"
+        "    // A fused multiply-add rounds once instead of twice; the extra slot catches writes past the end\n"
+        "    const float alpha = 0.75f;\n"
+        "    for (size_t i = 0; i <= count; ++i) {\n"
+        "        reference[i] = result[i] = b[i];\n"
+        "    }\n"
+        "    simd_select(SIMD_SCALAR);\n"
+        "    simd_saxpy(alpha, a, reference, count);\n"
+        "    simd_select(variant);\n"
+        "    simd_saxpy(alpha, a, result, count);\n"
+        "    for (size_t i = 0; i < count; ++i) {\n"
+        "        double bound = 2.0 * FLT_EPSILON * (absolute((double)alpha * a[i]) + absolute((double)b[i]));\n"
+        "        if (absolute((double)result[i] - reference[i]) > bound) {\n"
+        "            fprintf(stderr, \"%s: simd_saxpy of %zu items: y[%zu] = %g, expected %g\\n\", simd_name(variant), count, i,\n"
+        "                    result[i], reference[i]);\n"
+        "            failures++;\n"
+        "            break;\n"
+        "        }\n"
+        "    }\n"
+        "    CHECK(result[count] == b[count]);\n"
+        "\n"
+        "    free(reference);\n"
+        "    free(result);\n"
+        "}\n"
+        "\n"
+        "int main(void) {\n"
+        "    float *a = malloc((MAX_COUNT + MAX_OFFSET + 1) * sizeof(float));\n"
+        "    float *b = malloc((MAX_COUNT + MAX_OFFSET + 1) * sizeof(float));\n"
+        "    CHECK(a != NULL && b != NULL);\n"
+        "    if (a == NULL || b == NULL) {\n"
+        "        return 1;\n"
+        "    }\n"
+        "    for (size_t i = 0; i < MAX_COUNT + MAX_OFFSET + 1; ++i) {\n"
+        "        a[i] = random_float();\n"
+        "        b[i] = random_float();\n"
+        "    }\n"
+        "\n"
+        "    CHECK(simd_supported(SIMD_SCALAR));\n"
+        "    CHECK(!simd_supported(SIMD_VARIANT_COUNT));\n"
+        "    CHECK(simd_select(SIMD_VARIANT_COUNT) == -1);\n"
+        "    simd_variant picked = simd_active();\n"
+        "    CHECK(simd_supported(picked));\n"
+        "\n"
+        "    for (int variant = 0; variant < SIMD_VARIANT_COUNT; ++variant) {\n"
+        "        if (!simd_supported((simd_variant)variant)) {\n"
+        "            printf(\"%-8s not supported here, skipped\\n\", simd_name((simd_variant)variant));\n"
+        "            CHECK(simd_select((simd_variant)variant) == -1);\n"
+        "            continue;\n"
+        "        }\n"
+        "        for (size_t count = 0; count <= 67; ++count) {\n"
+        "            for (size_t offset = 0; offset <= MAX_OFFSET; ++offset) {\n"
+        "                check_variant((simd_variant)variant, a + offset, b + MAX_OFFSET - offset, count);\n"
+        "            }\n"
+        "        }\n"
+        "        check_variant((simd_variant)variant, a, b, 1000);\n"
+        "        check_variant((simd_variant)variant, a + 1, b, MAX_COUNT);\n"
+        "        CHECK(simd_active() == (simd_variant)variant);\n"
+        "        printf(\"%-8s checked against scalar\\n\", simd_name((simd_variant)variant));\n"
+        "    }\n"
+        "    printf(\"picked   %s\\n\", simd_name(picked));\n"
+        "\n"
+        "    free(a);\n"
+        "    free(b);\n"
+        "    if (failures != 0) {\n"
+        "        fprintf(stderr, \"%d check%s failed\\n\", failures, failures == 1 ? \"\" : \"s\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_SIMD_BENCH] = { "bench/bench_simd.c",
+        "#include \"bench.h\"\n"
+        "#include \"{{lib}}/simd.h\"\n"
+        "\n"
+        "// simd_dot and simd_saxpy with every variant this CPU supports, on vectors that fit in L1 and on\n"
+        "// vectors that stream from memory, with the speedup over the scalar reference\n"
+        "\n"
+        "typedef struct vectors {\n"
+        "    float *x;\n"
+        "    float *y;\n"
+        "    size_t count;\n"
+        "} vectors;\n"
+        "\n"
+        "static void bench_dot(void *arg, uint64_t iterations) {\n"
+        "    vectors *self = arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        float sum = simd_dot(self->x, self->y, self->count);\n"
+        "        BENCH_DO_NOT_OPTIMIZE(sum);\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "static void bench_saxpy(void *arg, uint64_t iterations) {\n"
+        "    vectors *self = arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        // Alternating signs keep the values bounded\n"
+        "        simd_saxpy((i & 1) ? -0.5f : 0.5f, self->x, self->y, self->count);\n"
+        "        BENCH_CLOBBER_MEMORY();\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int main(int argc, char *argv[]) {\n"
+        "    bench_options options = bench_default_options();\n"
+        "    if (argc > 1) {\n"
+        "        options.repetitions = atoi(argv[1]);\n"
+        "    }\n"
+        "\n"
+        "    const size_t counts[] = { 2048, 1 << 22 };\n"
+        "    vectors data = { malloc(counts[1] * sizeof(float)), malloc(counts[1] * sizeof(float)), 0 };\n"
+        "    if (data.x == NULL || data.y == NULL) {\n"
+        "        fprintf(stderr, \"out of memory\\n\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    for (size_t i = 0; i < counts[1]; ++i) {\n"
+        "        data.x[i] = (float)(i % 97) * 0.01f;\n"
+        "        data.y[i] = (float)(i % 89) * 0.01f;\n"
+        "    }\n"
+        "\n"
+        "    bench_print_header();\n"
+        "    const struct {\n"
+        "        const char *name;\n"
+        "        bench_function function;\n"
+        "    } kernels[] = { { \"dot\", bench_dot }, { \"saxpy\", bench_saxpy } };\n"
+        "    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {\n"
+        "        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {\n"
+        "            data.count = counts[c];\n"
+        "            double scalar = 0;\n"
+        "            for (int variant = 0; variant < SIMD_VARIANT_COUNT; ++variant) {\n"
+        "                if (simd_select((simd_variant)variant) != 0) {\n"
+        "                    continue;\n"
+        "                }\n"
+        "                char name[48];\n"
+        "                snprintf(name, sizeof(name), \"%s/%zu/%s\", kernels[k].name, counts[c], simd_name((simd_variant)variant));\n"
+        "                bench_result result = bench_run(name, kernels[k].function, &data, &options);\n"
+        "                if (variant == SIMD_SCALAR) {\n"
+        "                    scalar = result.median_ns;\n"
+        "                } else {\n"
+        "                    fprintf(stderr, \"%-24s %12.2fx\\n\", \"  speedup\", scalar / result.median_ns);\n"
+        "                }\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    free(data.x);\n"
+        "    free(data.y);\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_WORKSPACE_LIB_HEADER] = { "{{lib}}/{{lib}}.h",
+        "#ifndef {{LIB}}_H_\n"
+        "#define {{LIB}}_H_\n"
+        "\n"
+        "// Initialize the library, after everything it depends on; only the first call does anything\n"
+        "void {{lib}}_init(void);\n"
+        "\n"
+        "#endif // !{{LIB}}_H_\n" },
+    [TEMPLATE_WORKSPACE_LIB_SOURCE] = { "{{lib}}/{{lib}}.c",
+        "#include <stdio.h>\n"
+        "#include \"{{lib}}.h\"\n"
+        "{{dep_includes}}"
+        "\n"
+        "void {{lib}}_init(void) {\n"
+        "    static int initialized;\n"
+        "    if (initialized) {\n"
+        "        return;\n"
+        "    }\n"
+        "    initialized = 1;\n"
+        "{{dep_calls}}"
+        "    puts(\"{{lib}}\");\n"
+        "}\n" },
+    [TEMPLATE_WORKSPACE_CMAKE_LIB] = { "{{lib}}/CMakeLists.txt",
+        "# Object library: compiled once, its objects linked straight into every app that uses it\n"
+        "add_library({{lib}} OBJECT {{lib}}.c)\n"
+        "target_include_directories({{lib}} PUBLIC ${CMAKE_SOURCE_DIR})\n"
+        "target_link_libraries({{lib}} PUBLIC {{deps}})\n"
+        "\n"
+        "# Build configuration-specific definitions\n"
+        "target_compile_definitions({{lib}} PUBLIC\n"
+        "  $<$<CONFIG:Debug,Asan,Tsan>:{{LIB}}_DEBUG>\n"
+        "  $<$<CONFIG:Release,Profile>:{{LIB}}_RELEASE>\n"
+        ")\n"
+        "\n"
+        "if (ENABLE_PCH)\n"
+        "  target_precompile_headers({{lib}} PUBLIC $<BUILD_INTERFACE:${CMAKE_CURRENT_SOURCE_DIR}/{{lib}}.h>)\n"
+        "endif()\n" },
+    [TEMPLATE_WORKSPACE_LIB_TEST] = { "tests/test_{{lib}}.c",
+        "#include \"{{lib}}/{{lib}}.h\"\n"
+        "\n"
+        "int main(void) {\n"
+        "    {{lib}}_init();\n"
+        "    {{lib}}_init(); // does nothing the second time\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_WORKSPACE_LIB_BENCH] = { "bench/bench_{{lib}}.c",
+        "#include \"bench.h\"\n"
+        "#include \"{{lib}}/{{lib}}.h\"\n"
+        "\n"
+        "#ifdef _WIN32\n"
+        "#define NULL_DEVICE \"NUL\"\n"
+        "#else\n"
+        "#define NULL_DEVICE \"/dev/null\"\n"
+        "#endif\n"
+        "\n"
+        "static void bench_{{lib}}_init(void *arg, uint64_t iterations) {\n"
+        "    (void)arg;\n"
+        "    for (uint64_t i = 0; i < iterations; ++i) {\n"
+        "        {{lib}}_init();\n"
+        "        BENCH_CLOBBER_MEMORY();\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "int main(int argc, char *argv[]) {\n"
+        "    bench_options options = bench_default_options();\n"
+        "    if (argc > 1) {\n"
+        "        options.repetitions = atoi(argv[1]);\n"
+        "    }\n"
+        "\n"
+        "    // The first {{lib}}_init() prints; send that to the null device so only the results (on stderr) remain\n"
+        "    if (freopen(NULL_DEVICE, \"w\", stdout) == NULL) {\n"
+        "        perror(\"freopen\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "\n"
+        "    bench_print_header();\n"
+        "    bench_run(\"{{lib}}_init\", bench_{{lib}}_init, NULL, &options);\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_WORKSPACE_APP_SOURCE] = { "{{app}}/{{app}}.c",
+        "#include <stdio.h>\n"
+        "{{dep_includes}}"
+        "\n"
+        "int main(void) {\n"
+        "{{dep_calls}}"
+        "    puts(\"{{app}}\");\n"
+        "    return 0;\n"
+        "}\n" },
+    [TEMPLATE_WORKSPACE_CMAKE_APP] = { "{{app}}/CMakeLists.txt",
+        "add_executable({{app}} {{app}}.c)\n"
+        "target_include_directories({{app}} PRIVATE ${CMAKE_SOURCE_DIR})\n"
+        "\n"
+        "# Object files do not propagate through target_link_libraries, so the app links every\n"
+        "# library it depends on, directly or not\n"
+        "target_link_libraries({{app}} PRIVATE {{links}})\n" },
+    [TEMPLATE_README] = { "README.md",
+        "# {{project}}\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## 🗨️ PRESENTATION\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## 🖥️ SUPPORTED PLATFORMS\n"
+        "\n"
+        "- [ ] Windows\n"
+        "- [ ] Linux\n"
+        "- [ ] macOS\n"
+        "- [ ] Web\n"
+        "- [ ] iOS\n"
+        "- [ ] Android\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## ✅ PREREQUISITES\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## ❓ HOW TO USE\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## 📋 TODO\n"
+        "\n"
+        "---\n"
+        "\n"
+        "## ↩️ REFERENCES\n" },
+    [TEMPLATE_CONTRIBUTING] = { "CONTRIBUTING.md",
+        "# Contributing to {{project}}\n"
+        "\n"
+        "## How to Contribute\n"
+        "\n"
+        "We welcome contributions to this project! Here are a few ways you can help:\n"
+        "\n"
+        "1. **Report Bugs**: If you find a bug, please open an issue on our GitHub repository.\n"
+        "2. **Suggest Features**: If you have an idea for a new feature, let us know by opening an issue or a pull request.\n"
+        "3. **Contribute Code**: Fork the repository, make your changes, and submit a pull request. Please ensure that your code follows our coding standards and includes appropriate tests.\n"
+        "\n"
+        "## Coding Standards\n"
+        "\n"
+        "- Use descriptive variable names.\n"
+        "- Write clear and concise comments.\n"
+        "- Follow the coding style outlined in our `.clang-format` file.\n"
+        "\n"
+        "## Testing\n"
+        "\n"
+        "Please ensure that all tests pass before submitting a pull request. To run the tests, use:\n"
+        "\n"
+        "```bash\n"
+        "cd build\n"
+        "cmake ..\n"
+        "make\n"
+        "ctest\n"
+        "```\n"
+        "\n"
+        "## Code Review\n"
+        "\n"
+        "All pull requests will be reviewed by the project maintainers. We may request changes before merging your pull request.\n"
+        "\n"
+        "Thank you for contributing!\n" },
+    [TEMPLATE_CODE_OF_CONDUCT] = { "CODE_OF_CONDUCT.md",
+        "# Code of Conduct\n"
+        "\n"
+        "## Our Pledge\n"
+        "\n"
+        "We as members, contributors, and maintainers pledge to make participation in our project and our community a harassment-free experience for everyone, regardless of age, body size, disability, ethnicity, sex characteristics, gender identity and expression, level of experience, education, socio-economic status, nationality, personal appearance, race, religion, or sexual identity and orientation.\n"
+        "\n"
+        "## Our Standards\n"
+        "\n"
+        "Examples of behavior that contributes to creating a positive environment include:\n"
+        "\n"
+        "- Using welcoming and inclusive language\n"
+        "- Being respectful of differing viewpoints and experiences\n"
+        "- Gracefully accepting constructive criticism\n"
+        "- Focusing on what is best for the community\n"
+        "- Showing empathy towards other community members\n"
+        "\n"
+        "## Enforcement\n"
+        "\n"
+        "Instances of abusive, harassing, or otherwise unacceptable behavior may be reported by contacting the project team at [your email]. All complaints will be reviewed and investigated promptly and fairly.\n"
+        "\n"
+        "## Attribution\n"
+        "\n"
+        "This Code of Conduct is adapted from the Contributor Covenant (http://contributor-covenant.org), version 1.4.\n" },
+    [TEMPLATE_CHANGELOG] = { "CHANGELOG.md",
+        "# Changelog\n"
+        "\n"
+        "## [Unreleased]\n"
+        "\n"
+        "### Added\n"
+        "- Initial project setup with CMake, Git, and documentation.\n"
+        "\n"
+        "### Changed\n"
+        "- Added testing framework integration with CTest.\n"
+        "\n"
+        "## [1.0.0] - YYYY-MM-DD\n"
+        "\n"
+        "### Added\n"
+        "- First stable release of the project.\n" },
+    [TEMPLATE_GITIGNORE] = { ".gitignore",
+        "# Ignore specific directories\n"
+        ".vs/\n"
+        ".vscode/\n"
+        ".cache/\n"
+        "[Bb]in/\n"
+        "[Oo]bj/\n"
+        "[Tt]mp/\n"
+        "[Bb]uild/\n"
+        "[Cc]ache/\n"
+        "\n"
+        "# Ignore executable files\n"
+        "*.exe\n"
+        "*.out\n"
+        "*.app\n"
+        "*.dmg\n"
+        "*.pkg\n"
+        "\n"
+        "# Ignore object files\n"
+        "*.o\n"
+        "*.obj\n"
+        "*.a\n"
+        "*.so\n"
+        "*.lib\n"
+        "*.dll\n"
+        "\n"
+        "# Optional: Ignore other common temporary files\n"
+        "*.log\n"
+        "*.tmp\n"
+        "*.swp\n"
+        "*.swo\n"
+        "*.bak\n"
+        "*.backup\n" },
+    [TEMPLATE_LICENSE] = { "LICENSE",
+        "MIT License\n"
+        "\n"
+        "Copyright (c) 2024 ItsJustGalileo\n"
+        "\n"
+        "Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the \"Software\"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, subject to the following conditions:\n"
+        "\n"
+        "1. The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.\n"
+        "\n"
+        "2. THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.\n" },
+    [TEMPLATE_CLANG_FORMAT] = { ".clang-format",
+        "# Base style to use. Setting this to LLVM will apply LLVM's default formatting style.\n"
+        "BasedOnStyle: LLVM\n\n"
+        "# Number of spaces to use for indentation.\n"
+        "IndentWidth: 4\n\n"
+        "# Number of spaces per tab.\n"
+        "TabWidth: 4\n\n"
+        "# How to handle tabs.\n"
+        "# Options:\n"
+        "# - Never: Use spaces for indentation.\n"
+        "# - Always: Use tabs for indentation.\n"
+        "# - ForIndentation: Use tabs for indentation, spaces for alignment.\n"
+        "UseTab: Never\n\n"
+        "# Controls brace placement.\n"
+        "# Options:\n"
+        "# - Attach: Braces are attached to the statement.\n"
+        "# - Linux: Braces are placed on a new line, following Linux style.\n"
+        "# - Stroustrup: Braces follow Stroustrup's style.\n"
+        "# - Allman: Braces are placed on a new line, following Allman's style.\n"
+        "# - Custom: User-defined custom settings for brace wrapping.\n"
+        "BreakBeforeBraces: Custom\n"
+        "BraceWrapping:\n"
+        "  AfterEnum: false\n"
+        "  AfterFunction: false\n"
+        "  AfterNamespace: false\n"
+        "  AfterStruct: false\n"
+        "  AfterUnion: false\n"
+        "  BeforeCatch: false\n"
+        "  BeforeElse: false\n"
+        "  BeforeWhile: false\n\n"
+        "# Determines whether to break lines after the return type.\n"
+        "# Options:\n"
+        "# - None: Do not force line breaks.\n"
+        "# - AllDefinitions: Break lines after all function definitions.\n"
+        "AlwaysBreakAfterDefinitionReturnType: None\n\n"
+        "# Allows short functions to be on a single line.\n"
+        "# Options:\n"
+        "# - Empty: Allows single-line functions if the function body is empty.\n"
+        "# - All: Allows all short functions to be on a single line.\n"
+        "# - None: Disallows single-line functions.\n"
+        "AllowShortFunctionsOnASingleLine: Empty\n\n"
+        "# Allows short blocks (like if statements) to be on a single line.\n"
+        "# Options:\n"
+        "# - Empty: Allows single-line blocks if the block is empty.\n"
+        "# - All: Allows all short blocks to be on a single line.\n"
+        "# - None: Disallows single-line blocks.\n"
+        "AllowShortBlocksOnASingleLine: Empty\n\n"
+        "# Limits the number of characters per line. 0 disables this limit.\n"
+        "ColumnLimit: 0\n\n"
+        "# Style for braced initializers.\n"
+        "# Options:\n"
+        "# - false: Uses the default style.\n"
+        "# - true: Applies C++11 braced list style.\n"
+        "Cpp11BracedListStyle: false\n\n"
+        "# Determines where to place pointers.\n"
+        "# Options:\n"
+        "# - Left: Place the pointer on the left of the type (e.g., `int* ptr`).\n"
+        "# - Right: Place the pointer on the right of the type (e.g., `int *ptr`).\n"
+        "PointerAlignment: Right\n\n"
+        "# Controls spacing before parentheses.\n"
+        "# Options:\n"
+        "# - ControlStatements: Space before parentheses in control statements (e.g., if, while).\n"
+        "# - Always: Space before all parentheses.\n"
+        "# - Never: No space before parentheses.\n"
+        "SpaceBeforeParens: ControlStatements\n\n"
+        "# Number of spaces to use for indentation of continued lines.\n"
+        "ContinuationIndentWidth: 4\n\n"
+        "# Controls breaking lines before binary operators.\n"
+        "# Options:\n"
+        "# - NonAssignment: Break before non-assignment operators.\n"
+        "# - All: Break before all binary operators.\n"
+        "# - None: Do not break before binary operators.\n"
+        "BreakBeforeBinaryOperators: NonAssignment\n\n"
+        "# Adds a final newline at the end of the file.\n"
+        "InsertNewlineAtEOF: true\n\n"
+        "# Determines if includes should be sorted.\n"
+        "# Options:\n"
+        "# - false: Do not sort includes.\n"
+        "# - true: Sort includes.\n"
+        "SortIncludes: false\n\n"
+        "# Number of spaces before trailing comments.\n"
+        "SpacesBeforeTrailingComments: 1\n" },
+    [TEMPLATE_CLANG_TIDY] = { ".clang-tidy",
+        "Checks: 'readability-identifier-naming, readability-namespace-comment, readability-function-size'\n"
+        "CheckOptions:\n"
+        "- key: readability-identifier-naming.VariableCase\n"
+        "value: lower_case\n"
+        "- key: readability-identifier-naming.LocalVariablePrefix\n"
+        "value: local_\n"
+        "- key: readability-identifier-naming.FunctionCase\n"
+        "value: lower_case\n"
+        "- key: readability-identifier-naming.MacroDefinitionCase\n"
+        "value: UPPER_CASE\n"
+        "- key: readability-identifier-naming.LocalConstantPrefix\n"
+        "value: local_\n"
+        "- key: readability-identifier-naming.LocalVariablePrefix\n"
+        "value: local_\n"
+        "- key: readability-identifier-naming.IgnoreMainLikeFunctions\n"
+        "value: true\n"
+        "- key: readability-identifier-naming.ConstantCase\n"
+        "value: UPPER_CASE\n"
+        "- key: readability-identifier-naming.EnumCase\n"
+        "value: PascalCase\n"
+        "- key: readability-identifier-naming.PointerParameterPrefix\n"
+        "value: ptr_\n"
+        "- key: readability-identifier-naming.StructCase\n"
+        "value: PascalCase\n"
+        "- key: readability-identifier-naming.UnionCase\n"
+        "value: PascalCase\n\n"
+        "WarningsAsErrors: ''\n"
+        "FormatStyle: file\n" },
+};
+
+// Module each built-in template belongs to; 0 for the templates every project gets
+static const unsigned int template_features[TEMPLATE_COUNT] = {
+    [TEMPLATE_ALLOC_HEADER] = FEATURE_BIT(FEATURE_ALLOC),
+    [TEMPLATE_ALLOC_SOURCE] = FEATURE_BIT(FEATURE_ALLOC),
+    [TEMPLATE_ALLOC_TEST] = FEATURE_BIT(FEATURE_ALLOC),
+    [TEMPLATE_ALLOC_BENCH] = FEATURE_BIT(FEATURE_ALLOC),
+    [TEMPLATE_THREADS_HEADER] = FEATURE_BIT(FEATURE_THREADS),
+    [TEMPLATE_THREADS_SOURCE] = FEATURE_BIT(FEATURE_THREADS),
+    [TEMPLATE_THREADS_TEST] = FEATURE_BIT(FEATURE_THREADS),
+    [TEMPLATE_THREADS_BENCH] = FEATURE_BIT(FEATURE_THREADS),
+    [TEMPLATE_SIMD_HEADER] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_KERNELS] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_SOURCE] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_SSE2] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_AVX2] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_AVX512] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_NEON] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_TEST] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_SIMD_BENCH] = FEATURE_BIT(FEATURE_SIMD),
+    [TEMPLATE_WORKSPACE_LIB_HEADER] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_LIB_SOURCE] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_CMAKE_LIB] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_LIB_TEST] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_LIB_BENCH] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_APP_SOURCE] = FEATURE_BIT(FEATURE_WORKSPACE),
+    [TEMPLATE_WORKSPACE_CMAKE_APP] = FEATURE_BIT(FEATURE_WORKSPACE),
+};
+
+// Built-in templates whose files are kept as generated, refreshed by 'progen update' rather than
+// edited; --store may hardlink these, which leaves them read-only
+static const unsigned char template_read_only[TEMPLATE_COUNT] = {
+    [TEMPLATE_CMAKE_OPTIMIZATION] = 1,
+    [TEMPLATE_CMAKE_ACCELERATION] = 1,
+    [TEMPLATE_CMAKE_BUILD_TYPES] = 1,
+    [TEMPLATE_CMAKE_PERF_GATE] = 1,
+    [TEMPLATE_CMAKE_BUILD_PROFILE] = 1,
+    [TEMPLATE_BUILD_PROFILE_SCRIPT] = 1,
+    [TEMPLATE_CODE_OF_CONDUCT] = 1,
+    [TEMPLATE_LICENSE] = 1,
+    [TEMPLATE_CLANG_FORMAT] = 1,
+    [TEMPLATE_CLANG_TIDY] = 1,
+};
+
+static const char *const feature_names[FEATURE_COUNT] = {
+    [FEATURE_ALLOC] = "alloc",
+    [FEATURE_THREADS] = "threads",
+    [FEATURE_SIMD] = "simd",
+};
+
+static const char *const lib_kind_names[LIB_KIND_COUNT] = {
+    [LIB_STATIC] = "static",
+    [LIB_SHARED] = "shared",
+    [LIB_HEADER_ONLY] = "header-only",
+    [LIB_OBJECT] = "object",
+};
+
+// add_library() type of each kind, the value of {{lib_kind}}
+static const char *const lib_kind_types[LIB_KIND_COUNT] = {
+    [LIB_STATIC] = "STATIC",
+    [LIB_SHARED] = "SHARED",
+    [LIB_HEADER_ONLY] = "INTERFACE",
+    [LIB_OBJECT] = "OBJECT",
+};
+
+// IMPLEMENTATION
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s <project> <app> <lib>\n", program);
+    fprintf(stderr, "       %s --manifest <file> [--jobs <n>]\n", program);
+    fprintf(stderr, "       %s --workspace <spec>\n", program);
+    fprintf(stderr, "       %s pack <dir>|--builtin [-o <file>]\n", program);
+    fprintf(stderr, "       %s update [--templates <pack>] [--with=<module>,...] [--lib-kind=<kind>] [--dry-run]\n"
+                    "             <project-dir>...\n", program);
+    fprintf(stderr, "       %s bench [-n <projects>] [--dir <scratch>] [--git=<mode>,...] [--io=<mode>,...]\n"
+                    "             [--json <file>]\n", program);
+    fprintf(stderr, "       %s fuzz [-n <generations>] [--seed <n>] [--git=none|native]\n", program);
+    fprintf(stderr, "       %s serve --socket <path> [--jobs <n>] [options]\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --git=<mode>         native: write .git directly (default), system: run git, none: no repository\n");
+    fprintf(stderr, "  --output=<kind>      dir: write the project to disk (default), tar: stream it to stdout as a tar\n");
+    fprintf(stderr, "  --io=<mode>          sync: one file system call at a time (default), uring: batch them\n");
+    fprintf(stderr, "  --durable            sync the generated tree to disk before publishing it\n");
+    fprintf(stderr, "  --store <dir>        share files that are identical across projects via reflinks, or\n");
+    fprintf(stderr, "                       read-only hardlinks for files not meant to be edited (LICENSE, CMake/...)\n");
+    fprintf(stderr, "  --templates <pack>   use templates from a pack built with '%s pack'\n", program);
+    fprintf(stderr, "  --trace=<file>       write a Chrome trace of every generation phase and summarize it\n");
+    fprintf(stderr, "  --with=<module>,...  add optional library modules: alloc (arena and pool allocators),\n");
+    fprintf(stderr, "                       threads (work-stealing thread pool),\n");
+    fprintf(stderr, "                       simd (SSE2/AVX2/AVX-512/NEON kernels dispatched at run time)\n");
+    fprintf(stderr, "  --lib-kind=<kind>    static (default), shared, header-only or object library\n");
+}
+
+int parse_features(const char *list, unsigned int *features) {
+    while (*list != '\0') {
+        size_t length = strcspn(list, ",");
+        int found = 0;
+        for (int i = 0; i < FEATURE_COUNT && !found; ++i) {
+            if (strlen(feature_names[i]) == length && strncmp(list, feature_names[i], length) == 0) {
+                *features |= FEATURE_BIT(i);
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown module '%.*s'.\n", (int)length, list);
+            return -1;
+        }
+        list += length + (list[length] == ',');
+    }
+    return 0;
+}
+
+int parse_lib_kind(const char *name, lib_kind *kind) {
+    for (int i = 0; i < LIB_KIND_COUNT; ++i) {
+        if (strcmp(name, lib_kind_names[i]) == 0) {
+            *kind = (lib_kind)i;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown library kind '%s'.\n", name);
+    return -1;
+}
+
+int parse_options(int argc, char *argv[], options *opts) {
+    memset(opts, 0, sizeof(*opts));
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--manifest") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file after --manifest.\n");
+                return -1;
+            }
+            opts->manifest_path = argv[i];
+        } else if (strcmp(arg, "--workspace") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file after --workspace.\n");
+                return -1;
+            }
+            opts->workspace_path = argv[i];
+        } else if (strcmp(arg, "--jobs") == 0 || strcmp(arg, "-j") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing count after %s.\n", arg);
+                return -1;
+            }
+            char *end;
+            errno = 0;
+            opts->jobs = strtol(argv[i], &end, 10);
+            if (errno != 0 || *end != '\0' || opts->jobs < 0) {
+                fprintf(stderr, "Invalid job count '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(arg, "--git=native") == 0) {
+            opts->git = GIT_NATIVE;
+        } else if (strcmp(arg, "--git=system") == 0) {
+            opts->git = GIT_SYSTEM;
+        } else if (strcmp(arg, "--git=none") == 0) {
+            opts->git = GIT_NONE;
+        } else if (strcmp(arg, "--output=dir") == 0) {
+            opts->output = OUTPUT_DIRECTORY;
+        } else if (strcmp(arg, "--output=tar") == 0) {
+            opts->output = OUTPUT_TAR;
+        } else if (strcmp(arg, "--io=sync") == 0) {
+            opts->io = IO_SYNC;
+        } else if (strcmp(arg, "--io=uring") == 0) {
+            opts->io = IO_URING;
+        } else if (strcmp(arg, "--templates") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file after --templates.\n");
+                return -1;
+            }
+            opts->templates_path = argv[i];
+        } else if (strcmp(arg, "--store") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing directory after --store.\n");
+                return -1;
+            }
+            opts->store_path = argv[i];
+        } else if (strcmp(arg, "--durable") == 0) {
+            opts->durable = 1;
+        } else if (strncmp(arg, "--trace=", 8) == 0 && arg[8] != '\0') {
+            opts->trace_path = arg + 8;
+        } else if (strncmp(arg, "--with=", 7) == 0) {
+            if (parse_features(arg + 7, &opts->features) != 0) {
+                return -1;
+            }
+        } else if (strncmp(arg, "--lib-kind=", 11) == 0) {
+            if (parse_lib_kind(arg + 11, &opts->lib_kind) != 0) {
+                return -1;
+            }
+        } else if (strncmp(arg, "--", 2) == 0) {
+            fprintf(stderr, "Unknown option '%s'.\n", arg);
+            return -1;
+        } else {
+            if (opts->positional_count == 3) {
+                fprintf(stderr, "Too many arguments.\n");
+                return -1;
+            }
+            opts->positional[opts->positional_count++] = arg;
+        }
+    }
+
+    if (opts->manifest_path != NULL && opts->positional_count != 0) {
+        fprintf(stderr, "--manifest does not take <project> <app> <lib> arguments.\n");
+        return -1;
+    }
+
+    if (opts->workspace_path != NULL && (opts->manifest_path != NULL || opts->positional_count != 0 ||
+                                         opts->features != 0 || opts->lib_kind != LIB_STATIC)) {
+        fprintf(stderr, "--workspace does not take --manifest, --with, --lib-kind or <project> <app> <lib> "
+                        "arguments.\n");
+        return -1;
+    }
+
+    if (opts->lib_kind == LIB_HEADER_ONLY && opts->features != 0) {
+        fprintf(stderr, "--lib-kind=header-only cannot be combined with --with.\n");
+        return -1;
+    }
+
+    // These need the project on disk
+    if (opts->output == OUTPUT_TAR
+        && (opts->git == GIT_SYSTEM || opts->store_path != NULL || opts->durable || opts->io == IO_URING)) {
+        fprintf(stderr, "--output=tar cannot be combined with --git=system, --store, --durable or --io=uring.\n");
+        return -1;
+    }
+
+    if (opts->io == IO_URING && !io_uring_available()) {
+        fprintf(stderr, "io_uring is not available (%s); using synchronous I/O.\n", strerror(errno));
+        opts->io = IO_SYNC;
+    }
+
+    return 0;
+}
+
+void init_project_context(project_context *ctx, const options *opts,
+                          const char *root_dir, const char *app_dir, const char *lib_dir) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->opts = opts;
+
+    // "foo/" is the directory "foo": drop trailing slashes, which would leave no name to stage under
+    size_t length = strlen(root_dir);
+    while (length > 1 && root_dir[length - 1] == '/') {
+        length--;
+    }
+    char *trimmed = root_dir[length] != '\0' ? arena_alloc(ctx, length + 1) : NULL;
+    if (trimmed != NULL) {
+        memcpy(trimmed, root_dir, length);
+        trimmed[length] = '\0';
+        root_dir = trimmed;
+    }
+    ctx->root_dir = root_dir;
+    ctx->project_name = root_dir;
+    ctx->app_dir = app_dir;
+    ctx->lib_dir = lib_dir;
+    ctx->features = opts->features;
+    ctx->lib_kind = opts->lib_kind;
+    ctx->root_fd = -1;
+}
+
+void free_project_context(project_context *ctx) {
+    if (ctx->trace_count > 0) {
+        flush_trace(ctx);
+    }
+    free(ctx->trace_events);
+    ctx->trace_events = NULL;
+    ctx->trace_count = ctx->trace_capacity = 0;
+    while (ctx->arena != NULL) {
+        arena_block *next = ctx->arena->next;
+        free(ctx->arena);
+        ctx->arena = next;
+    }
+    while (ctx->spare_arena != NULL) {
+        arena_block *next = ctx->spare_arena->next;
+        free(ctx->spare_arena);
+        ctx->spare_arena = next;
+    }
+    free(ctx->files);
+    ctx->files = NULL;
+    ctx->file_count = ctx->file_capacity = 0;
+#ifndef _WIN32
+    if (ctx->root_fd >= 0) {
+        close(ctx->root_fd);
+    }
+#endif
+    ctx->root_fd = -1;
+    free(ctx->staging_path);
+    ctx->staging_path = NULL;
+    free(ctx->tar.data);
+    memset(&ctx->tar, 0, sizeof(ctx->tar));
+    free(ctx->directories);
+    ctx->directories = NULL;
+    ctx->directory_count = ctx->directory_capacity = 0;
+    close_io_ring(ctx);
+}
+
+// Remember a generated file so later steps can use it without touching the disk
+static int record_generated_file(project_context *ctx, const char *path, const char *content,
+                                 size_t length, const struct stat *info) {
+    if (ctx->file_count == ctx->file_capacity) {
+        size_t capacity = ctx->file_capacity ? ctx->file_capacity * 2 : 32;
+        generated_file *grown = realloc(ctx->files, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        ctx->files = grown;
+        ctx->file_capacity = capacity;
+    }
+
+    generated_file *file = &ctx->files[ctx->file_count];
+    file->path = path;
+    file->content = content;
+    file->length = length;
+    if (info != NULL) {
+        file->info = *info;
+    } else {
+        memset(&file->info, 0, sizeof(file->info));
+    }
+    file->hashed = 0;
+    ctx->file_count++;
+    return 0;
+}
+
+void add_generation_stats(generation_stats *total, const generation_stats *stats) {
+    total->directories_created += stats->directories_created;
+    total->files_written += stats->files_written;
+    total->bytes_written += stats->bytes_written;
+    total->shared_reflinks += stats->shared_reflinks;
+    total->shared_hardlinks += stats->shared_hardlinks;
+    total->shared_copies += stats->shared_copies;
+    total->syscalls += stats->syscalls;
+    total->shared_bytes += stats->shared_bytes;
+    total->shared_inodes += stats->shared_inodes;
+}
+
+void print_store_summary(const options *opts, const generation_stats *stats) {
+    if (opts->store_path == NULL) {
+        return;
+    }
+    printf("Store '%s': %zu reflinked, %zu hardlinked, %zu copied; saved %zu bytes and %zu inodes\n",
+           opts->store_path, stats->shared_reflinks, stats->shared_hardlinks, stats->shared_copies,
+           stats->shared_bytes, stats->shared_inodes);
+}
+
+// Current time in seconds from a monotonic clock
+static double monotonic_seconds(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Nanoseconds from the same clock, for trace timestamps
+static long long monotonic_nanoseconds(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int buffer_append(byte_buffer *buffer, const void *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+}
+
+// Tracing. Spans are kept in the project context and written out in one go when it is freed, so
+// the only per-span cost is two clock reads; the trace file and the summary are shared by all
+// workers under one lock.
+
+static const char *const trace_phase_names[TRACE_PHASE_COUNT] = {
+    [TRACE_PROJECT] = "create_project_structure",
+    [TRACE_STAGING] = "begin_staging",
+    [TRACE_DIRECTORY] = "create_directory",
+    [TRACE_RENDER] = "render_template",
+    [TRACE_WRITE] = "write_file",
+    [TRACE_MARKDOWN] = "create_markdown",
+    [TRACE_LICENSE] = "create_license_file",
+    [TRACE_MANIFEST] = "write_project_manifest",
+    [TRACE_GIT] = "initialize_git_repository",
+    [TRACE_PUBLISH] = "publish_staging",
+};
+
+static struct {
+    FILE *file;
+    const char *path;
+    long long origin;
+    size_t events;
+    size_t counts[TRACE_PHASE_COUNT];
+    long long totals[TRACE_PHASE_COUNT];
+    long long maxima[TRACE_PHASE_COUNT];
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} trace_log = {
+    .file = NULL,
+#ifndef _WIN32
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+// Start of a span, or 0 when tracing is off
+static long long trace_begin(const project_context *ctx) {
+    return ctx->opts->trace_path != NULL ? monotonic_nanoseconds() : 0;
+}
+
+static void trace_end(project_context *ctx, trace_phase phase, const char *detail, long long start) {
+    if (ctx->opts->trace_path == NULL) {
+        return;
+    }
+    if (ctx->trace_count == ctx->trace_capacity) {
+        size_t capacity = ctx->trace_capacity ? ctx->trace_capacity * 2 : 64;
+        trace_event *grown = realloc(ctx->trace_events, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            return;  // the trace loses a span rather than failing the generation
+        }
+        ctx->trace_events = grown;
+        ctx->trace_capacity = capacity;
+    }
+    trace_event *event = &ctx->trace_events[ctx->trace_count++];
+    event->phase = phase;
+    event->detail = detail;
+    event->start = start;
+    event->duration = monotonic_nanoseconds() - start;
+}
+
+// Run one step of a project's generation as a span of its own
+static int run_traced_step(project_context *ctx, trace_phase phase, int (*step)(project_context *ctx)) {
+    long long start = trace_begin(ctx);
+    int status = step(ctx);
+    trace_end(ctx, phase, ctx->root_dir, start);
+    return status;
+}
+
+int open_trace(const char *path) {
+    trace_log.file = fopen(path, "w");
+    if (trace_log.file == NULL) {
+        fprintf(stderr, "Error opening trace file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    trace_log.path = path;
+    trace_log.origin = monotonic_nanoseconds();
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", trace_log.file);
+    return 0;
+}
+
+// Append a JSON string literal
+static void buffer_append_json_string(byte_buffer *buffer, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    buffer_append(buffer, "\"", 1);
+    for (const char *c = text; *c != '\0'; ++c) {
+        unsigned char byte = (unsigned char)*c;
+        if (byte == '"' || byte == '\\') {
+            char escaped[2] = { '\\', (char)byte };
+            buffer_append(buffer, escaped, 2);
+        } else if (byte < 0x20) {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[byte >> 4], hex[byte & 15] };
+            buffer_append(buffer, escaped, 6);
+        } else {
+            buffer_append(buffer, c, 1);
+        }
+    }
+    buffer_append(buffer, "\"", 1);
+}
+
+void flush_trace(project_context *ctx) {
+    if (trace_log.file == NULL) {
+        return;
+    }
+
+    // Format outside the lock; Chrome trace timestamps are microseconds
+    byte_buffer text = { 0 };
+    for (size_t i = 0; i < ctx->trace_count; ++i) {
+        const trace_event *event = &ctx->trace_events[i];
+        long long start = event->start - trace_log.origin;
+        char line[256];
+        int length = snprintf(line, sizeof(line),
+                              ",\n{\"name\": \"%s\", \"cat\": \"progen\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                              "\"ts\": %lld.%03lld, \"dur\": %lld.%03lld, \"args\": {\"%s\": ",
+                              trace_phase_names[event->phase], ctx->trace_lane, start / 1000, start % 1000,
+                              event->duration / 1000, event->duration % 1000,
+                              event->phase == TRACE_PROJECT ? "project" : "path");
+        buffer_append(&text, line, (size_t)length);
+        buffer_append_json_string(&text, event->detail != NULL ? event->detail : "");
+        buffer_append(&text, "}}", 2);
+    }
+
+#ifndef _WIN32
+    pthread_mutex_lock(&trace_log.lock);
+#endif
+    if (text.data != NULL) {
+        // The first event of the file goes without the leading comma
+        size_t skip = trace_log.events == 0 ? 2 : 0;
+        fwrite(text.data + skip, 1, text.length - skip, trace_log.file);
+    }
+    trace_log.events += ctx->trace_count;
+    for (size_t i = 0; i < ctx->trace_count; ++i) {
+        const trace_event *event = &ctx->trace_events[i];
+        trace_log.counts[event->phase]++;
+        trace_log.totals[event->phase] += event->duration;
+        if (event->duration > trace_log.maxima[event->phase]) {
+            trace_log.maxima[event->phase] = event->duration;
+        }
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&trace_log.lock);
+#endif
+    free(text.data);
+}
+
+int close_trace(void) {
+    if (trace_log.file == NULL) {
+        return 0;
+    }
+    fputs("\n]}\n", trace_log.file);
+    int status = fclose(trace_log.file);
+    trace_log.file = NULL;
+    if (status != 0) {
+        fprintf(stderr, "Error writing trace file '%s': %s\n", trace_log.path, strerror(errno));
+        return -1;
+    }
+
+    // Spans nest (write_file inside create_markdown inside create_project_structure), so the
+    // share column is relative to the time spent in create_project_structure
+    long long projects = trace_log.totals[TRACE_PROJECT] > 0 ? trace_log.totals[TRACE_PROJECT] : 1;
+    fprintf(stderr, "Trace written to '%s' (%zu events)\n", trace_log.path, trace_log.events);
+    fprintf(stderr, "%-26s %8s %11s %10s %10s %7s\n", "phase", "count", "total ms", "mean us", "max us", "share");
+    for (int phase = 0; phase < TRACE_PHASE_COUNT; ++phase) {
+        size_t count = trace_log.counts[phase];
+        if (count == 0) {
+            continue;
+        }
+        long long total = trace_log.totals[phase];
+        fprintf(stderr, "%-26s %8zu %11.3f %10.1f %10.1f %6.1f%%\n", trace_phase_names[phase], count, total / 1e6,
+                total / 1e3 / (double)count, trace_log.maxima[phase] / 1e3, 100.0 * (double)total / (double)projects);
+    }
+    return 0;
+}
+
+// Read a whole file into a NUL-terminated heap buffer
+static char *read_text_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 4096, length = 0;
+    char *text = malloc(capacity);
+    while (text != NULL) {
+        length += fread(text + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = realloc(text, capacity);
+        if (grown == NULL) {
+            free(text);
+        }
+        text = grown;
+    }
+
+    if (text != NULL && ferror(file)) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    if (text != NULL) {
+        text[length] = '\0';
+    }
+    return text;
+}
+
+// Split the manifest into jobs in place. Each non-empty line is "<project> <app> <lib>";
+// '#' starts a comment. The whole manifest is validated before anything is generated.
+static int parse_manifest(const char *path, char *text, manifest_job **jobs_out, size_t *count_out) {
+    size_t count = 0, capacity = 64;
+    manifest_job *jobs = malloc(capacity * sizeof(*jobs));
+    if (jobs == NULL) {
+        perror("Error allocating manifest");
+        return -1;
+    }
+
+    int line_number = 0;
+    char *line = text;
+    while (line != NULL && *line != '\0') {
+        line_number++;
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char *fields[4];
+        int field_count = 0;
+        for (char *field = strtok(line, " \t\r"); field != NULL; field = strtok(NULL, " \t\r")) {
+            if (field_count == 4) {
+                break;
+            }
+            fields[field_count++] = field;
+        }
+
+        if (field_count != 0) {
+            if (field_count != 3) {
+                fprintf(stderr, "%s:%d: expected <project> <app> <lib>.\n", path, line_number);
+                free(jobs);
+                return -1;
+            }
+            if (count == capacity) {
+                capacity *= 2;
+                manifest_job *grown = realloc(jobs, capacity * sizeof(*jobs));
+                if (grown == NULL) {
+                    perror("Error allocating manifest");
+                    free(jobs);
+                    return -1;
+                }
+                jobs = grown;
+            }
+            memset(&jobs[count], 0, sizeof(jobs[count]));
+            jobs[count].project = fields[0];
+            jobs[count].app = fields[1];
+            jobs[count].lib = fields[2];
+            count++;
+        }
+
+        line = next;
+    }
+
+    *jobs_out = jobs;
+    *count_out = count;
+    return 0;
+}
+
+// Claim the next job, or NULL once the queue is drained
+static manifest_job *claim_job(job_queue *queue) {
+    manifest_job *job = NULL;
+#ifndef _WIN32
+    pthread_mutex_lock(&queue->lock);
+#endif
+    if (queue->next < queue->count) {
+        job = &queue->jobs[queue->next++];
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&queue->lock);
+#endif
+    return job;
+}
+
+static void *manifest_worker(void *arg) {
+    job_queue *queue = arg;
+#ifndef _WIN32
+    pthread_mutex_lock(&queue->lock);
+#endif
+    int lane = ++queue->workers_started;
+#ifndef _WIN32
+    pthread_mutex_unlock(&queue->lock);
+#endif
+
+    manifest_job *job;
+    while ((job = claim_job(queue)) != NULL) {
+        project_context ctx;
+        init_project_context(&ctx, queue->opts, job->project, job->app, job->lib);
+        ctx.trace_lane = lane;
+        job->status = create_project_structure(&ctx);
+        job->stats = ctx.stats;
+        free_project_context(&ctx);
+        if (job->status != 0) {
+            fprintf(stderr, "Error generating project '%s'.\n", job->project);
+        }
+    }
+    return NULL;
+}
+
+int run_manifest(const options *opts) {
+    char *text = read_text_file(opts->manifest_path);
+    if (text == NULL) {
+        perror("Error reading manifest");
+        return -1;
+    }
+
+    job_queue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.opts = opts;
+    if (parse_manifest(opts->manifest_path, text, &queue.jobs, &queue.count) != 0) {
+        free(text);
+        return -1;
+    }
+
+    long workers = opts->jobs;
+#ifdef _WIN32
+    // No pthreads here: the queue is drained on the calling thread
+    workers = 1;
+#else
+    if (workers == 0) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    if (workers < 1) {
+        workers = 1;
+    }
+    if ((size_t)workers > queue.count && queue.count > 0) {
+        workers = (long)queue.count;
+    }
+
+    double start = monotonic_seconds();
+
+#ifdef _WIN32
+    manifest_worker(&queue);
+#else
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_t *threads = malloc((size_t)workers * sizeof(*threads));
+    long started = 0;
+    if (threads != NULL) {
+        for (; started < workers; ++started) {
+            if (pthread_create(&threads[started], NULL, manifest_worker, &queue) != 0) {
+                break;
+            }
+        }
+    }
+    if (started == 0) {
+        // Could not start any thread; generate on this one instead
+        manifest_worker(&queue);
+    }
+    for (long i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&queue.lock);
+#endif
+
+    double elapsed = monotonic_seconds() - start;
+
+    size_t succeeded = 0;
+    generation_stats total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < queue.count; ++i) {
+        if (queue.jobs[i].status == 0) {
+            succeeded++;
+        }
+        add_generation_stats(&total, &queue.jobs[i].stats);
+    }
+    size_t files = total.files_written, directories = total.directories_created;
+
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+    printf("Generated %zu/%zu projects (%zu files, %zu directories) in %.3f s with %ld worker%s: "
+           "%.1f projects/s, %.1f files/s\n",
+           succeeded, queue.count, files, directories, elapsed, workers, workers == 1 ? "" : "s",
+           (double)succeeded / elapsed, (double)files / elapsed);
+
+    print_store_summary(opts, &total);
+
+    int status = succeeded == queue.count ? 0 : -1;
+    free(queue.jobs);
+    free(text);
+    return status;
+}
+
+// Workspaces: one project holding several libraries and apps, described by a spec file:
+//
+//     project <name>
+//     lib <name> [: <dependency>...]
+//     app <name> [: <dependency>...]
+//
+// Libraries become CMake object libraries and apps link every library they depend on, directly or
+// not. The spec is checked as a whole (names, unknown dependencies, cycles) before anything is
+// written, and is copied into the project so that 'progen update' can regenerate it.
+
+#define WORKSPACE_SPEC "workspace.progen"
+
+// Directories of the shared layout and targets CMake defines itself
+static const char *const reserved_target_names[] = {
+    "CMake", "docs", "tests", "bench", "test", "all", "clean", "install", "help", "package",
+};
+static const char *const reserved_target_prefixes[] = { "test_", "bench_" };
+
+// Make room for one more item in a growable array; returns the array, or NULL when out of memory
+static void *reserve_item(void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return array;
+    }
+    size_t grown_capacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(array, grown_capacity * size);
+    if (grown == NULL) {
+        perror("Error allocating workspace");
+        return NULL;
+    }
+    *capacity = grown_capacity;
+    return grown;
+}
+
+// Split the spec into targets in place. The dependency names are collected in *names_out, target
+// after target, to be resolved once every target is known.
+static int parse_workspace(const char *path, workspace *ws, const char ***names_out) {
+    const char **names = NULL;
+    size_t target_capacity = 0, name_capacity = 0;
+    int line_number = 0, status = 0, apps = 0;
+
+    char *line = ws->text;
+    while (status == 0 && line != NULL && *line != '\0') {
+        line_number++;
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char *colon = strchr(line, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+        }
+
+        char *fields[3];
+        int field_count = 0;
+        for (char *field = strtok(line, " \t\r"); field != NULL && field_count < 3; field = strtok(NULL, " \t\r")) {
+            fields[field_count++] = field;
+        }
+
+        if (field_count == 0 && colon == NULL) {
+            // Blank line
+        } else if (field_count > 0 && strcmp(fields[0], "project") == 0) {
+            if (field_count != 2 || colon != NULL || ws->project != NULL) {
+                fprintf(stderr, "%s:%d: expected a single 'project <name>' line.\n", path, line_number);
+                status = -1;
+            } else {
+                ws->project = fields[1];
+            }
+        } else if (field_count == 2 && (strcmp(fields[0], "lib") == 0 || strcmp(fields[0], "app") == 0)) {
+            workspace_target *targets = reserve_item(ws->targets, &target_capacity, ws->target_count,
+                                                     sizeof(*targets));
+            if (targets == NULL) {
+                status = -1;
+                break;
+            }
+            ws->targets = targets;
+            workspace_target *target = &ws->targets[ws->target_count++];
+            target->name = fields[1];
+            target->is_app = fields[0][0] == 'a';
+            target->line = line_number;
+            target->first_dependency = ws->dependency_count;
+            target->dependency_count = 0;
+            apps += target->is_app;
+
+            char *field = colon != NULL ? strtok(colon + 1, " \t\r") : NULL;
+            for (; field != NULL && status == 0; field = strtok(NULL, " \t\r")) {
+                const char **grown = reserve_item(names, &name_capacity, ws->dependency_count, sizeof(*names));
+                if (grown == NULL) {
+                    status = -1;
+                    break;
+                }
+                names = grown;
+                names[ws->dependency_count++] = field;
+                target->dependency_count++;
+            }
+        } else {
+            fprintf(stderr, "%s:%d: expected 'lib <name> [: <dependency>...]' or 'app <name> [: <dependency>...]'.\n",
+                    path, line_number);
+            status = -1;
+        }
+        line = next;
+    }
+
+    if (status == 0 && ws->project == NULL) {
+        fprintf(stderr, "%s: missing 'project <name>' line.\n", path);
+        status = -1;
+    }
+    // The PGO training run and perf-record need an executable
+    if (status == 0 && apps == 0) {
+        fprintf(stderr, "%s: a workspace needs at least one app.\n", path);
+        status = -1;
+    }
+    *names_out = names;
+    return status;
+}
+
+// Target names end up as directories, so names differing only in case are the same name
+static int same_target_name(const char *left, const char *right) {
+    for (; *left != '\0' && tolower((unsigned char)*left) == tolower((unsigned char)*right); ++left, ++right) {
+    }
+    return tolower((unsigned char)*left) == tolower((unsigned char)*right);
+}
+
+// FNV-1a of the lowercased name
+static size_t hash_target_name(const char *name) {
+    unsigned int hash = 2166136261u;
+    for (; *name != '\0'; ++name) {
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*name)) * 16777619u;
+    }
+    return hash;
+}
+
+// Slot of the name in the open-addressing table of target indices (+ 1, 0 for a free slot)
+static size_t find_target_slot(const workspace *ws, const size_t *table, size_t mask, const char *name) {
+    size_t slot = hash_target_name(name) & mask;
+    while (table[slot] != 0 && !same_target_name(ws->targets[table[slot] - 1].name, name)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Target names are used as C identifiers ({{lib}}_init) as well as directory and CMake target names
+static int check_target_name(const char *path, const workspace_target *target) {
+    int valid = isalpha((unsigned char)target->name[0]) || target->name[0] == '_';
+    for (const char *c = target->name; *c != '\0' && valid; ++c) {
+        valid = isalnum((unsigned char)*c) || *c == '_';
+    }
+    if (!valid) {
+        fprintf(stderr, "%s:%d: '%s' is not a valid target name (letters, digits and '_', not starting with a digit).\n",
+                path, target->line, target->name);
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(reserved_target_names) / sizeof(reserved_target_names[0]); ++i) {
+        if (same_target_name(target->name, reserved_target_names[i])) {
+            fprintf(stderr, "%s:%d: '%s' is a reserved name.\n", path, target->line, target->name);
+            return -1;
+        }
+    }
+    // test_<lib> and bench_<lib> are the executables of each library's test and benchmark
+    for (size_t i = 0; i < sizeof(reserved_target_prefixes) / sizeof(reserved_target_prefixes[0]); ++i) {
+        const char *name = target->name, *prefix = reserved_target_prefixes[i];
+        for (; *prefix != '\0' && tolower((unsigned char)*name) == *prefix; ++name, ++prefix) {
+        }
+        if (*prefix == '\0' && *name != '\0') {
+            fprintf(stderr, "%s:%d: '%s' starts with '%s', which names generated tests and benchmarks.\n", path,
+                    target->line, target->name, reserved_target_prefixes[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Check the target names and resolve the dependency names to target indices
+static int resolve_workspace(const char *path, workspace *ws, const char **names) {
+    size_t slots = 16;
+    while (slots < ws->target_count * 2) {
+        slots *= 2;
+    }
+    size_t *table = calloc(slots, sizeof(*table));
+    size_t *listed_by = calloc(ws->target_count, sizeof(*listed_by));  // last dependent listing each target, + 1
+    ws->dependencies = malloc((ws->dependency_count + 1) * sizeof(*ws->dependencies));
+    if (table == NULL || listed_by == NULL || ws->dependencies == NULL) {
+        perror("Error allocating workspace");
+        free(table);
+        free(listed_by);
+        return -1;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < ws->target_count && status == 0; ++i) {
+        const workspace_target *target = &ws->targets[i];
+        status = check_target_name(path, target);
+        size_t slot = find_target_slot(ws, table, slots - 1, target->name);
+        if (status == 0 && table[slot] != 0) {
+            const workspace_target *other = &ws->targets[table[slot] - 1];
+            fprintf(stderr, "%s:%d: '%s' is already declared as '%s' on line %d.\n", path, target->line, target->name,
+                    other->name, other->line);
+            status = -1;
+        }
+        table[slot] = i + 1;
+    }
+
+    for (size_t i = 0; i < ws->target_count && status == 0; ++i) {
+        const workspace_target *target = &ws->targets[i];
+        for (size_t k = 0; k < target->dependency_count && status == 0; ++k) {
+            const char *name = names[target->first_dependency + k];
+            size_t found = table[find_target_slot(ws, table, slots - 1, name)];
+            if (found == 0 || strcmp(ws->targets[found - 1].name, name) != 0) {
+                fprintf(stderr, "%s:%d: '%s' depends on unknown target '%s'.\n", path, target->line, target->name,
+                        name);
+                status = -1;
+            } else if (ws->targets[found - 1].is_app) {
+                fprintf(stderr, "%s:%d: '%s' cannot depend on app '%s'.\n", path, target->line, target->name, name);
+                status = -1;
+            } else if (listed_by[found - 1] == i + 1) {
+                fprintf(stderr, "%s:%d: '%s' lists '%s' twice.\n", path, target->line, target->name, name);
+                status = -1;
+            }
+            if (status != 0) {
+                break;
+            }
+            listed_by[found - 1] = i + 1;
+            ws->dependencies[target->first_dependency + k] = found - 1;
+        }
+    }
+
+    free(listed_by);
+    free(table);
+    return status;
+}
+
+// Sort the targets so that each comes after its dependencies (an iterative depth-first search,
+// in post-order), or report a dependency cycle
+static int order_workspace(const char *path, workspace *ws) {
+    size_t count = ws->target_count;
+    unsigned char *state = calloc(count, 1);    // 0: not visited, 1: on the current path, 2: ordered
+    size_t *stack = malloc(count * sizeof(*stack));
+    size_t *next_edge = malloc(count * sizeof(*next_edge));
+    ws->order = malloc(count * sizeof(*ws->order));
+    if (state == NULL || stack == NULL || next_edge == NULL || ws->order == NULL) {
+        perror("Error allocating workspace");
+        free(state);
+        free(stack);
+        free(next_edge);
+        return -1;
+    }
+
+    size_t ordered = 0;
+    int status = 0;
+    for (size_t root = 0; root < count && status == 0; ++root) {
+        if (state[root] != 0) {
+            continue;
+        }
+        size_t depth = 1;
+        stack[0] = root;
+        next_edge[0] = 0;
+        state[root] = 1;
+        while (depth > 0 && status == 0) {
+            const workspace_target *target = &ws->targets[stack[depth - 1]];
+            if (next_edge[depth - 1] == target->dependency_count) {
+                state[stack[depth - 1]] = 2;
+                ws->order[ordered++] = stack[--depth];
+                continue;
+            }
+            size_t dependency = ws->dependencies[target->first_dependency + next_edge[depth - 1]++];
+            if (state[dependency] == 0) {
+                state[dependency] = 1;
+                stack[depth] = dependency;
+                next_edge[depth++] = 0;
+            } else if (state[dependency] == 1) {
+                // The cycle is the part of the path starting at the dependency
+                size_t start = depth - 1;
+                while (stack[start] != dependency) {
+                    start--;
+                }
+                fprintf(stderr, "%s:%d: dependency cycle: ", path, ws->targets[dependency].line);
+                for (size_t i = start; i < depth; ++i) {
+                    fprintf(stderr, "%s -> ", ws->targets[stack[i]].name);
+                }
+                fprintf(stderr, "%s\n", ws->targets[dependency].name);
+                status = -1;
+            }
+        }
+    }
+
+    free(state);
+    free(stack);
+    free(next_edge);
+    return status;
+}
+
+int load_workspace(const char *path, workspace *ws) {
+    memset(ws, 0, sizeof(*ws));
+    ws->source = read_text_file(path);
+    if (ws->source == NULL) {
+        fprintf(stderr, "Error reading '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    ws->source_length = strlen(ws->source);
+    ws->text = malloc(ws->source_length + 1);
+    if (ws->text == NULL) {
+        perror("Error allocating workspace");
+        free_workspace(ws);
+        return -1;
+    }
+    memcpy(ws->text, ws->source, ws->source_length + 1);
+
+    const char **names = NULL;
+    int status = parse_workspace(path, ws, &names);
+    if (status == 0) {
+        status = resolve_workspace(path, ws, names);
+    }
+    if (status == 0) {
+        status = order_workspace(path, ws);
+    }
+    free(names);
+    if (status != 0) {
+        free_workspace(ws);
+    }
+    return status;
+}
+
+void free_workspace(workspace *ws) {
+    free(ws->source);
+    free(ws->text);
+    free(ws->targets);
+    free(ws->dependencies);
+    free(ws->order);
+    memset(ws, 0, sizeof(*ws));
+}
+
+// Name of the first library or app of the spec, or "" if there is none; the project-wide
+// templates use them as {{lib}} and {{app}}
+static const char *first_workspace_target(const workspace *ws, int is_app) {
+    for (size_t i = 0; i < ws->target_count; ++i) {
+        if (ws->targets[i].is_app == is_app) {
+            return ws->targets[i].name;
+        }
+    }
+    return "";
+}
+
+int run_workspace(const options *opts) {
+    workspace ws;
+    if (load_workspace(opts->workspace_path, &ws) != 0) {
+        return -1;
+    }
+
+    size_t apps = 0;
+    for (size_t i = 0; i < ws.target_count; ++i) {
+        apps += ws.targets[i].is_app;
+    }
+    printf("Creating workspace '%s' with %zu librar%s and %zu app%s.\n", ws.project, ws.target_count - apps,
+           ws.target_count - apps == 1 ? "y" : "ies", apps, apps == 1 ? "" : "s");
+
+    double start = monotonic_seconds();
+    project_context ctx;
+    init_project_context(&ctx, opts, ws.project, first_workspace_target(&ws, 1), first_workspace_target(&ws, 0));
+    ctx.workspace = &ws;
+    ctx.features = FEATURE_BIT(FEATURE_WORKSPACE);
+    int status = create_project_structure(&ctx);
+    generation_stats stats = ctx.stats;
+    free_project_context(&ctx);
+    double elapsed = monotonic_seconds() - start;
+
+    if (status == 0) {
+        printf("Workspace '%s' created successfully: %zu files, %zu directories in %.3f s.\n", ws.project,
+               stats.files_written, stats.directories_created, elapsed);
+        print_store_summary(opts, &stats);
+    }
+    free_workspace(&ws);
+    return status;
+}
+
+#ifndef _WIN32
+// Collect the relative paths of every regular file below root/relative
+static int collect_template_files(const char *root, const char *relative, char ***paths, size_t *count,
+                                  size_t *capacity) {
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s%s%s", root, *relative ? "/" : "", relative);
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Error reading '%s': %s\n", directory, strerror(errno));
+        return -1;
+    }
+
+    int status = 0;
+    struct dirent *entry;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[4096], full_path[4096 + 64];
+        snprintf(path, sizeof(path), "%s%s%s", relative, *relative ? "/" : "", entry->d_name);
+        snprintf(full_path, sizeof(full_path), "%s/%s", root, path);
+
+        struct stat info;
+        if (stat(full_path, &info) != 0) {
+            fprintf(stderr, "Error reading '%s': %s\n", full_path, strerror(errno));
+            status = -1;
+        } else if (S_ISDIR(info.st_mode)) {
+            status = collect_template_files(root, path, paths, count, capacity);
+        } else if (S_ISREG(info.st_mode)) {
+            if (*count == *capacity) {
+                *capacity = *capacity ? *capacity * 2 : 32;
+                char **grown = realloc(*paths, *capacity * sizeof(*grown));
+                if (grown == NULL) {
+                    status = -1;
+                    break;
+                }
+                *paths = grown;
+            }
+            (*paths)[*count] = malloc(strlen(path) + 1);
+            if ((*paths)[*count] == NULL) {
+                status = -1;
+                break;
+            }
+            strcpy((*paths)[(*count)++], path);
+        }
+    }
+    closedir(dir);
+    return status;
+}
+
+static int compare_strings(const void *left, const void *right) {
+    return strcmp(*(char *const *)left, *(char *const *)right);
+}
+#endif
+
+int run_pack(int argc, char *argv[]) {
+    const char *directory = NULL, *output = NULL;
+    int builtin = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--builtin") == 0 && directory == NULL) {
+            builtin = 1;
+        } else if (directory == NULL && !builtin && argv[i][0] != '-') {
+            directory = argv[i];
+        } else {
+            directory = NULL;
+            builtin = 0;
+            break;
+        }
+    }
+    if (builtin) {
+        return write_baked_templates(output != NULL ? output : "progen_templates.h");
+    }
+    if (directory == NULL) {
+        fprintf(stderr, "Usage: %s pack <dir>|--builtin [-o <file>]\n", argv[0]);
+        return -1;
+    }
+
+#ifdef _WIN32
+    (void)output;
+    fprintf(stderr, "Building template packs is not supported on this platform.\n");
+    return -1;
+#else
+    // Default output: <dir>.pack next to the directory
+    char default_output[4096];
+    if (output == NULL) {
+        size_t length = strlen(directory);
+        while (length > 1 && directory[length - 1] == '/') {
+            length--;
+        }
+        snprintf(default_output, sizeof(default_output), "%.*s.pack", (int)length, directory);
+        output = default_output;
+    }
+
+    // Each file's path below <dir> is its output path template, e.g. {{lib}}/{{lib}}.h
+    char **paths = NULL;
+    size_t count = 0, capacity = 0;
+    int status = collect_template_files(directory, "", &paths, &count, &capacity);
+    template_source *sources = calloc(count ? count : 1, sizeof(*sources));
+    if (sources == NULL) {
+        status = -1;
+    }
+    if (status == 0) {
+        qsort(paths, count, sizeof(*paths), compare_strings);
+    }
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        char full_path[8192];
+        snprintf(full_path, sizeof(full_path), "%s/%s", directory, paths[i]);
+        sources[i].path = paths[i];
+        sources[i].content = read_text_file(full_path);
+        if (sources[i].content == NULL) {
+            fprintf(stderr, "Error reading '%s': %s\n", full_path, strerror(errno));
+            status = -1;
+        }
+    }
+
+    byte_buffer pack = { 0 };
+    if (status == 0) {
+        status = build_template_pack(sources, count, &pack);
+    }
+    if (status == 0) {
+        FILE *file = fopen(output, "wb");
+        if (file == NULL || fwrite(pack.data, 1, pack.length, file) != pack.length) {
+            perror("Error writing template pack");
+            status = -1;
+        }
+        if (file != NULL && fclose(file) != 0) {
+            perror("Error writing template pack");
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        printf("Packed %zu templates from '%s' into '%s' (%zu bytes).\n", count, directory, output, pack.length);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (sources != NULL) {
+            free((char *)sources[i].content);
+        }
+        free(paths[i]);
+    }
+    free(sources);
+    free(paths);
+    free(pack.data);
+    return status;
+#endif
+}
+
+// Tar output (--output=tar): every directory and file a project would get on disk, .git included,
+// becomes a ustar member in a per-project buffer that is written to stdout in one piece once the
+// project is complete. Members get fixed modes, owners and mtime (SOURCE_DATE_EPOCH, or 0), so the
+// same inputs give the same bytes.
+
+static struct {
+    int fd;                 // the original stdout; stdout itself is pointed at stderr
+    long long mtime;
+#ifndef _WIN32
+    pthread_mutex_t lock;   // keeps each project's members together in manifest mode
+#endif
+} tar_output = {
+    .fd = -1,
+#ifndef _WIN32
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+int open_tar_output(void) {
+#ifdef _WIN32
+    fprintf(stderr, "--output=tar is not supported on this platform.\n");
+    return -1;
+#else
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    if (epoch != NULL) {
+        char *end;
+        errno = 0;
+        tar_output.mtime = strtoll(epoch, &end, 10);
+        if (errno != 0 || *end != '\0' || end == epoch || tar_output.mtime < 0 || tar_output.mtime > 077777777777LL) {
+            fprintf(stderr, "Invalid SOURCE_DATE_EPOCH '%s'.\n", epoch);
+            return -1;
+        }
+    }
+    if (isatty(STDOUT_FILENO)) {
+        fprintf(stderr, "Refusing to write a tar stream to a terminal.\n");
+        return -1;
+    }
+
+    // Progress messages would corrupt the stream, so they go to stderr from now on
+    fflush(stdout);
+    tar_output.fd = dup(STDOUT_FILENO);
+    if (tar_output.fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("Error opening tar output");
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+static int write_all(int fd, const char *bytes, size_t length, size_t *syscalls) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        (*syscalls)++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+#endif
+
+// Write the project's members out; takes the place of the rename that publishes a directory
+static int tar_publish(project_context *ctx) {
+#ifdef _WIN32
+    (void)ctx;
+    return -1;
+#else
+    pthread_mutex_lock(&tar_output.lock);
+    int status = write_all(tar_output.fd, ctx->tar.data, ctx->tar.length, &ctx->stats.syscalls);
+    pthread_mutex_unlock(&tar_output.lock);
+    if (status != 0) {
+        perror("Error writing tar output");
+    }
+    return status;
+#endif
+}
+
+int close_tar_output(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    if (tar_output.fd < 0) {
+        return 0;
+    }
+    // End of archive: two zero blocks
+    static const char end[1024];
+    size_t syscalls = 0;
+    int status = write_all(tar_output.fd, end, sizeof(end), &syscalls);
+    if (close(tar_output.fd) != 0) {
+        status = -1;
+    }
+    tar_output.fd = -1;
+    if (status != 0) {
+        perror("Error writing tar output");
+    }
+    return status;
+#endif
+}
+
+// Append one header. A path too long for the name field is split at a '/' into the prefix field
+// or, when it does not fit that way either, carried by a pax extended header.
+static int append_tar_header(byte_buffer *tar, const char *path, size_t size, char type, unsigned int mode) {
+    static const char padding[512];
+    size_t length = strlen(path);
+    size_t split = 0;   // length of the part in the prefix field; the '/' after it is implied
+    for (size_t i = length > 101 ? length - 101 : 0; length > 100 && i <= 155 && i + 1 < length && split == 0; ++i) {
+        split = path[i] == '/' ? i : 0;
+    }
+    if (length > 100 && split == 0) {
+        // "<length> path=<path>\n", where the length counts its own digits
+        size_t record_length = length + 7, total = record_length + 1;
+        while (total != record_length + (size_t)snprintf(NULL, 0, "%zu", total)) {
+            total = record_length + (size_t)snprintf(NULL, 0, "%zu", total);
+        }
+        char record[32];
+        int record_prefix = snprintf(record, sizeof(record), "%zu path=", total);
+        int status = append_tar_header(tar, "././@PaxHeader", total, 'x', 0644);
+        status |= buffer_append(tar, record, (size_t)record_prefix);
+        status |= buffer_append(tar, path, length);
+        status |= buffer_append(tar, "\n", 1);
+        status |= buffer_append(tar, padding, (512 - total % 512) % 512);
+        if (status != 0) {
+            return -1;
+        }
+        length = 100;   // the ustar name is only a fallback for readers without pax support
+    }
+
+    unsigned char header[512] = { 0 };
+    char *field = (char *)header;
+    if (split != 0) {
+        memcpy(field + 345, path, split);
+        memcpy(field, path + split + 1, length - split - 1);
+    } else {
+        memcpy(field, path, length);
+    }
+    snprintf(field + 100, 8, "%07o", mode);
+    snprintf(field + 108, 8, "%07o", 0u);   // uid
+    snprintf(field + 116, 8, "%07o", 0u);   // gid
+    snprintf(field + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf(field + 136, 12, "%011llo", (unsigned long long)tar_output.mtime);
+    memset(field + 148, ' ', 8);
+    field[156] = type;
+    memcpy(field + 257, "ustar", 6);
+    memcpy(field + 263, "00", 2);
+
+    unsigned int checksum = 0;
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        checksum += header[i];
+    }
+    snprintf(field + 148, 8, "%06o", checksum);
+    field[155] = ' ';
+    return buffer_append(tar, header, sizeof(header));
+}
+
+// Remember a directory, for backends that cannot ask the disk whether it exists; returns 1 if it
+// is already in the project. The open-addressing table holds 64-bit FNV-1a hashes of the names,
+// 0 marking a free slot.
+static int add_project_directory(project_context *ctx, const char *name) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (const char *c = name; *c != '\0'; ++c) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+    }
+    hash += hash == 0;
+
+    if (2 * (ctx->directory_count + 1) > ctx->directory_capacity) {
+        size_t capacity = ctx->directory_capacity ? ctx->directory_capacity * 2 : 64;
+        unsigned long long *table = calloc(capacity, sizeof(*table));
+        if (table == NULL) {
+            return -1;
+        }
+        for (size_t i = 0; i < ctx->directory_capacity; ++i) {
+            if (ctx->directories[i] == 0) {
+                continue;
+            }
+            size_t slot = (size_t)ctx->directories[i] & (capacity - 1);
+            while (table[slot] != 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            table[slot] = ctx->directories[i];
+        }
+        free(ctx->directories);
+        ctx->directories = table;
+        ctx->directory_capacity = capacity;
+    }
+
+    size_t slot = (size_t)hash & (ctx->directory_capacity - 1);
+    while (ctx->directories[slot] != 0) {
+        if (ctx->directories[slot] == hash) {
+            return 1;
+        }
+        slot = (slot + 1) & (ctx->directory_capacity - 1);
+    }
+    ctx->directories[slot] = hash;
+    ctx->directory_count++;
+    return 0;
+}
+
+int append_tar_member(project_context *ctx, const char *path, const void *data, size_t length) {
+    // Members are named <root>/<path>, directories with a trailing '/'
+    const char *root = ctx->root_dir;
+    while (*root == '/') {
+        root++;
+    }
+    char name[4096];
+    int name_length = snprintf(name, sizeof(name), "%s%s%s%s", root, *path ? "/" : "", path, data ? "" : "/");
+    if (name_length < 0 || (size_t)name_length >= sizeof(name)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (data == NULL) {
+        // Like mkdir, a directory that already exists is an EEXIST error
+        int seen = add_project_directory(ctx, name);
+        if (seen > 0) {
+            errno = EEXIST;
+        }
+        return seen != 0 ? -1 : append_tar_header(&ctx->tar, name, 0, '5', 0755);
+    }
+
+    static const char padding[512];
+    int status = append_tar_header(&ctx->tar, name, length, '0', 0644);
+    status |= buffer_append(&ctx->tar, data, length);
+    return status | buffer_append(&ctx->tar, padding, (512 - length % 512) % 512);
+}
+
+static int tar_begin(project_context *ctx) {
+    // Nothing touches the disk: the members pile up in memory until tar_publish
+    return append_tar_member(ctx, "", NULL, 0);
+}
+
+static int tar_make_directory(project_context *ctx, const char *path) {
+    return append_tar_member(ctx, path, NULL, 0);
+}
+
+static int tar_write_bytes(project_context *ctx, const char *path, const void *data, size_t length,
+                           struct stat *info) {
+    if (info != NULL) {
+        memset(info, 0, sizeof(*info));
+        info->st_mode = S_IFREG | 0644;
+        info->st_size = (off_t)length;
+        info->st_mtime = (time_t)tar_output.mtime;
+    }
+    return append_tar_member(ctx, path, data, length);
+}
+
+// In-memory file system (OUTPUT_MEMORY, used by 'progen fuzz'): the project becomes a tree of
+// nodes in its arena, kept for inspection until the context is freed. Missing parents, existing
+// directories and over-long names fail with the errno the disk would give.
+
+static memory_node *add_memory_node(project_context *ctx, memory_node *parent, const char *name, const char *data,
+                                    size_t length) {
+    size_t name_length = strlen(name);
+    memory_node *node = arena_alloc(ctx, sizeof(*node) + name_length + 1);
+    if (node == NULL) {
+        return NULL;
+    }
+    char *copy = (char *)(node + 1);
+    memcpy(copy, name, name_length + 1);
+    node->name = copy;
+    node->data = data;
+    node->length = length;
+    node->children = NULL;
+    node->next = NULL;
+    if (parent != NULL) {
+        node->next = parent->children;
+        parent->children = node;
+    }
+    return node;
+}
+
+static memory_node *find_memory_child(const memory_node *directory, const char *name, size_t length) {
+    for (memory_node *node = directory->children; node != NULL; node = node->next) {
+        if (strncmp(node->name, name, length) == 0 && node->name[length] == '\0') {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// Directory holding the last component of path, which is returned through name; NULL with errno
+// set when a directory on the way is missing
+static memory_node *find_memory_parent(const project_context *ctx, const char *path, const char **name) {
+    memory_node *directory = ctx->memory_root;
+    const char *component = path;
+    for (const char *slash = strchr(component, '/'); slash != NULL; slash = strchr(component, '/')) {
+        memory_node *child = find_memory_child(directory, component, (size_t)(slash - component));
+        if (child == NULL || child->data != NULL) {
+            errno = child == NULL ? ENOENT : ENOTDIR;
+            return NULL;
+        }
+        directory = child;
+        component = slash + 1;
+    }
+    if (*component == '\0' || strlen(component) > 255) {
+        errno = *component == '\0' ? ENOENT : ENAMETOOLONG;
+        return NULL;
+    }
+    *name = component;
+    return directory;
+}
+
+// File or directory at path, or NULL
+static const memory_node *find_memory_node(const project_context *ctx, const char *path) {
+    const char *name;
+    const memory_node *parent = ctx->memory_root != NULL ? find_memory_parent(ctx, path, &name) : NULL;
+    return parent != NULL ? find_memory_child(parent, name, strlen(name)) : NULL;
+}
+
+static int memory_begin(project_context *ctx) {
+    ctx->memory_root = add_memory_node(ctx, NULL, ctx->root_dir, NULL, 0);
+    return ctx->memory_root != NULL ? 0 : -1;
+}
+
+static int memory_make_directory(project_context *ctx, const char *path) {
+    const char *name;
+    memory_node *parent = find_memory_parent(ctx, path, &name);
+    if (parent == NULL) {
+        return -1;
+    }
+    if (find_memory_child(parent, name, strlen(name)) != NULL) {
+        errno = EEXIST;
+        return -1;
+    }
+    return add_memory_node(ctx, parent, name, NULL, 0) != NULL ? 0 : -1;
+}
+
+static int memory_write_bytes(project_context *ctx, const char *path, const void *data, size_t length,
+                              struct stat *info) {
+    const char *name;
+    memory_node *parent = find_memory_parent(ctx, path, &name);
+    if (parent == NULL) {
+        return -1;
+    }
+    memory_node *node = find_memory_child(parent, name, strlen(name));
+    if (node != NULL && node->data == NULL) {
+        errno = EISDIR;
+        return -1;
+    }
+
+    // Callers may pass transient buffers (git objects), so the bytes are copied
+    char *copy = arena_alloc(ctx, length + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, data, length);
+    if (node == NULL && add_memory_node(ctx, parent, name, copy, length) == NULL) {
+        return -1;
+    }
+    if (node != NULL) {
+        node->data = copy;
+        node->length = length;
+    }
+    if (info != NULL) {
+        memset(info, 0, sizeof(*info));
+        info->st_mode = S_IFREG | 0644;
+        info->st_size = (off_t)length;
+    }
+    return 0;
+}
+
+static int memory_publish(project_context *ctx) {
+    (void)ctx;
+    return 0;
+}
+
+
+// Batched file system calls (--io=uring). The directory output queues its directory creations
+// and file writes in the project's context and flush_queued_writes hands them to the kernel
+// together: the directories as one linked chain, in the order they were made (parents first),
+// then each file as a chain of its own (open into a registered slot, write, statx, close). The
+// first file drains the directory chain, so no file is opened before its parent exists, while the
+// files themselves run concurrently. Anything that needs the files on disk flushes first: the git
+// step and the --store links; publishing flushes what is left.
+
+#ifdef HAVE_IO_URING
+#define IO_RING_ENTRIES 256
+#define IO_RING_SLOTS (IO_RING_ENTRIES / 4)    // a file takes four entries and one registered slot
+#define IO_RING_MAX_WRITE (1u << 30)            // larger writes are made directly
+
+// A directory creation or file write waiting for the next flush
+typedef struct queued_write {
+    const char *path;       // arena copies
+    const char *data;       // NULL for a directory
+    size_t length;
+    size_t file;            // generated file whose stat data the write provides, or SIZE_MAX
+} queued_write;
+
+// An io_uring instance with its rings mapped, and the writes queued for it
+typedef struct io_ring {
+    int fd;
+    unsigned char *rings;   // submission and completion rings, in one mapping
+    size_t rings_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned sq_mask;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    queued_write *queue;
+    size_t queue_count;
+    size_t queue_capacity;
+    int broken;             // entries may be left in the rings after a failed submission
+    struct statx stats[IO_RING_SLOTS];  // statx results of the files in flight, by slot
+} io_ring;
+
+static void free_io_ring(io_ring *ring, size_t *syscalls) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+        (*syscalls)++;
+    }
+    if (ring->rings != NULL && ring->rings != MAP_FAILED) {
+        munmap(ring->rings, ring->rings_size);
+        (*syscalls)++;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        (*syscalls)++;
+    }
+    free(ring->queue);
+    free(ring);
+}
+
+// Set up a ring with its file slots registered; NULL when the kernel refuses
+static io_ring *open_io_ring(size_t *syscalls) {
+    io_ring *ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    // One thread submits and waits, so completion work can wait until it asks (Linux 6.1); older
+    // kernels get the plain ring. SUBMIT_ALL keeps one bad entry from holding back the others.
+    static const unsigned flag_sets[] = {
+        IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_SUBMIT_ALL,
+    };
+    struct io_uring_params params;
+    ring->fd = -1;
+    for (size_t i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]) && ring->fd < 0; ++i) {
+        memset(&params, 0, sizeof(params));
+        params.flags = flag_sets[i];
+        ring->fd = (int)syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+        (*syscalls)++;
+        if (ring->fd < 0 && errno != EINVAL) {
+            break;
+        }
+    }
+    if (ring->fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        int saved = ring->fd < 0 ? errno : ENOSYS;
+        free_io_ring(ring, syscalls);
+        errno = saved;
+        return NULL;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = ring->rings == MAP_FAILED ? MAP_FAILED
+                 : mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQES);
+    *syscalls += 2;
+
+    int slots[IO_RING_SLOTS];
+    for (size_t i = 0; i < IO_RING_SLOTS; ++i) {
+        slots[i] = -1;
+    }
+    if (ring->sqes == MAP_FAILED
+        || syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, slots, IO_RING_SLOTS) != 0) {
+        int saved = errno;
+        free_io_ring(ring, syscalls);
+        errno = saved;
+        return NULL;
+    }
+    (*syscalls)++;
+
+    ring->sq_tail = (unsigned *)(ring->rings + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(ring->rings + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned *)(ring->rings + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(ring->rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(ring->rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ring->rings + params.cq_off.cqes);
+    // Entry i of the submission ring is always SQE i
+    unsigned *array = (unsigned *)(ring->rings + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+    return ring;
+}
+
+// Rings are kept per thread and reused by its next project: setting one up costs about as much as a
+// small project's writes, and the kernel ties the ring to the thread that submits to it
+static pthread_key_t io_ring_key;
+static pthread_once_t io_ring_key_once = PTHREAD_ONCE_INIT;
+static int io_ring_key_status = -1;
+
+static void free_thread_io_ring(void *ring) {
+    size_t syscalls = 0;
+    free_io_ring(ring, &syscalls);
+}
+
+static void create_io_ring_key(void) {
+    io_ring_key_status = pthread_key_create(&io_ring_key, free_thread_io_ring);
+}
+
+// The calling thread's ring, set up on first use; NULL when there cannot be one
+static io_ring *acquire_io_ring(size_t *syscalls) {
+    pthread_once(&io_ring_key_once, create_io_ring_key);
+    if (io_ring_key_status != 0) {
+        return NULL;
+    }
+    io_ring *ring = pthread_getspecific(io_ring_key);
+    if (ring == NULL) {
+        ring = open_io_ring(syscalls);
+        if (ring != NULL && pthread_setspecific(io_ring_key, ring) != 0) {
+            free_io_ring(ring, syscalls);
+            ring = NULL;
+        }
+    }
+    return ring;
+}
+#endif
+
+int io_uring_available(void) {
+#ifdef HAVE_IO_URING
+    size_t syscalls = 0;
+    io_ring *ring = open_io_ring(&syscalls);
+    if (ring == NULL) {
+        return 0;
+    }
+    static const unsigned char needed[] = {
+        IORING_OP_MKDIRAT, IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_STATX, IORING_OP_CLOSE,
+    };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int available = probe != NULL
+                    && syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; i < sizeof(needed) && available; ++i) {
+        available = needed[i] < probe->ops_len && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    free_io_ring(ring, &syscalls);
+    if (!available) {
+        errno = ENOSYS;
+    }
+    return available;
+#else
+    errno = ENOSYS;
+    return 0;
+#endif
+}
+
+void close_io_ring(project_context *ctx) {
+#ifdef HAVE_IO_URING
+    // The ring goes back to its thread, unless a failed submission may have left entries in it
+    if (ctx->ring != NULL && ctx->ring->broken) {
+        pthread_setspecific(io_ring_key, NULL);
+        free_io_ring(ctx->ring, &ctx->stats.syscalls);
+    } else if (ctx->ring != NULL) {
+        ctx->ring->queue_count = 0;
+    }
+    ctx->ring = NULL;
+#else
+    (void)ctx;
+#endif
+}
+
+#ifdef HAVE_IO_URING
+static int queue_write(project_context *ctx, const char *path, const void *data, size_t length, size_t file) {
+    io_ring *ring = ctx->ring;
+    if (ring->queue_count == ring->queue_capacity) {
+        size_t capacity = ring->queue_capacity ? ring->queue_capacity * 2 : 64;
+        queued_write *grown = realloc(ring->queue, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        ring->queue = grown;
+        ring->queue_capacity = capacity;
+    }
+
+    // Callers may reuse their buffers as soon as this returns
+    size_t path_length = strlen(path) + 1;
+    char *copy = arena_alloc(ctx, path_length + (data != NULL ? length : 0));
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, path, path_length);
+    queued_write *entry = &ring->queue[ring->queue_count++];
+    entry->path = copy;
+    entry->data = NULL;
+    entry->length = length;
+    entry->file = file;
+    if (data != NULL) {
+        memcpy(copy + path_length, data, length);
+        entry->data = copy + path_length;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *prepare_sqe(io_ring *ring, unsigned index, unsigned char opcode, int fd,
+                                        unsigned long long user_data) {
+    struct io_uring_sqe *sqe = &ring->sqes[index & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+// Completions carry the queue index, the file slot and which step of the file's chain they are
+#define IO_RING_USER_DATA(index, slot, step) ((unsigned long long)(index) << 8 | (unsigned)(slot) << 2 | (step))
+
+// Handle one completion; returns the error it reports, or 0
+static int complete_queued_write(project_context *ctx, const struct io_uring_cqe *cqe) {
+    io_ring *ring = ctx->ring;
+    const queued_write *entry = &ring->queue[cqe->user_data >> 8];
+    unsigned slot = (unsigned)(cqe->user_data >> 2) & (IO_RING_SLOTS - 1);
+    unsigned step = (unsigned)cqe->user_data & 3;
+    int error = cqe->res < 0 ? -cqe->res : 0;
+
+    if (error == ECANCELED) {
+        return 0;   // an earlier step of its chain failed, and that is what gets reported
+    }
+    if (entry->data == NULL) {
+        if (error != 0) {
+            fprintf(stderr, "Error creating directory '%s': %s\n", entry->path, strerror(error));
+        }
+        return error;
+    }
+    if (step == 2) {
+        // As with fstat after a synchronous write, missing stat data only costs git a rehash
+        if (error == 0 && entry->file < ctx->file_count) {
+            const struct statx *result = &ring->stats[slot];
+            struct stat *info = &ctx->files[entry->file].info;
+            memset(info, 0, sizeof(*info));
+            info->st_dev = makedev(result->stx_dev_major, result->stx_dev_minor);
+            info->st_ino = (ino_t)result->stx_ino;
+            info->st_mode = result->stx_mode;
+            info->st_nlink = result->stx_nlink;
+            info->st_uid = result->stx_uid;
+            info->st_gid = result->stx_gid;
+            info->st_size = (off_t)result->stx_size;
+            info->st_mtim.tv_sec = (time_t)result->stx_mtime.tv_sec;
+            info->st_mtim.tv_nsec = (long)result->stx_mtime.tv_nsec;
+            info->st_ctim.tv_sec = (time_t)result->stx_ctime.tv_sec;
+            info->st_ctim.tv_nsec = (long)result->stx_ctime.tv_nsec;
+        }
+        return 0;
+    }
+    if (step == 1 && error == 0 && (size_t)cqe->res != entry->length) {
+        error = EIO;    // regular files only come up short when the disk is full or failing
+    }
+    if (error != 0) {
+        fprintf(stderr, "Error writing file '%s': %s\n", entry->path, strerror(error));
+    }
+    return error;
+}
+
+// Submit the entries prepared since the last submission and wait for all of their completions
+static int submit_queued_writes(project_context *ctx, unsigned count) {
+    io_ring *ring = ctx->ring;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + count, __ATOMIC_RELEASE);
+    int first_error = 0;
+    unsigned to_submit = count, completed = 0;
+    while (completed < count) {
+        int entered = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, count - completed,
+                                   IORING_ENTER_GETEVENTS, NULL, 0);
+        ctx->stats.syscalls++;
+        if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // Entries the kernel never saw cannot be waited for; the project is discarded anyway
+            ring->broken = 1;
+            return -1;
+        }
+        if (entered > 0) {
+            to_submit -= (unsigned)entered < to_submit ? (unsigned)entered : to_submit;
+        }
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head, ++completed) {
+            int error = complete_queued_write(ctx, &ring->cqes[head & ring->cq_mask]);
+            if (first_error == 0) {
+                first_error = error;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    if (first_error != 0) {
+        errno = first_error;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+int flush_queued_writes(project_context *ctx) {
+#ifdef HAVE_IO_URING
+    io_ring *ring = ctx->ring;
+    if (ring == NULL || ring->queue_count == 0) {
+        return 0;
+    }
+    long long start = trace_begin(ctx);
+    int status = 0;
+    size_t count = ring->queue_count, next_directory = 0, next_file = 0;
+    while (status == 0 && next_file < count) {
+        unsigned tail = *ring->sq_tail, prepared = 0, slot = 0;
+        struct io_uring_sqe *last_directory = NULL;
+        for (; next_directory < count && prepared < IO_RING_ENTRIES; ++next_directory) {
+            const queued_write *entry = &ring->queue[next_directory];
+            if (entry->data == NULL) {
+                last_directory = prepare_sqe(ring, tail + prepared++, IORING_OP_MKDIRAT, ctx->root_fd,
+                                             IO_RING_USER_DATA(next_directory, 0, 0));
+                last_directory->addr = (unsigned long long)(uintptr_t)entry->path;
+                last_directory->len = 0755;
+                last_directory->flags = IOSQE_IO_LINK;
+            }
+        }
+        if (last_directory != NULL) {
+            last_directory->flags = 0;  // ends the chain
+        }
+
+        // Files once every directory is on its way, each as open -> write -> statx -> close. Hard
+        // links keep the close in the chain when the write fails, so the slot is not left open.
+        unsigned char drain = last_directory != NULL ? IOSQE_IO_DRAIN : 0;
+        for (; next_directory == count && next_file < count && prepared + 4 <= IO_RING_ENTRIES
+               && slot < IO_RING_SLOTS; ++next_file) {
+            const queued_write *entry = &ring->queue[next_file];
+            if (entry->data == NULL) {
+                continue;
+            }
+            struct io_uring_sqe *sqe = prepare_sqe(ring, tail + prepared++, IORING_OP_OPENAT, ctx->root_fd,
+                                                   IO_RING_USER_DATA(next_file, slot, 0));
+            sqe->addr = (unsigned long long)(uintptr_t)entry->path;
+            sqe->len = 0644;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            sqe->file_index = slot + 1;
+            sqe->flags = IOSQE_IO_LINK | drain;
+            drain = 0;
+
+            sqe = prepare_sqe(ring, tail + prepared++, IORING_OP_WRITE, (int)slot,
+                              IO_RING_USER_DATA(next_file, slot, 1));
+            sqe->addr = (unsigned long long)(uintptr_t)entry->data;
+            sqe->len = (unsigned)entry->length;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+            sqe = prepare_sqe(ring, tail + prepared++, IORING_OP_STATX, ctx->root_fd,
+                              IO_RING_USER_DATA(next_file, slot, 2));
+            sqe->addr = (unsigned long long)(uintptr_t)entry->path;
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long long)(uintptr_t)&ring->stats[slot];
+            sqe->flags = IOSQE_IO_HARDLINK;
+
+            sqe = prepare_sqe(ring, tail + prepared++, IORING_OP_CLOSE, 0, IO_RING_USER_DATA(next_file, slot, 3));
+            sqe->file_index = slot + 1;
+            slot++;
+        }
+        status = prepared > 0 ? submit_queued_writes(ctx, prepared) : 0;
+    }
+    ring->queue_count = 0;
+    trace_end(ctx, TRACE_WRITE, "(queued writes)", start);
+    return status;
+#else
+    (void)ctx;
+    return 0;
+#endif
+}
+
+#ifdef _WIN32
+// Without *at() calls, paths are joined onto the project root
+static int join_project_path(project_context *ctx, const char *path, char *out, size_t size) {
+    int length = snprintf(out, size, "%s/%s", ctx->staging_path, path);
+    if (length < 0 || (size_t)length >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+static int disk_make_directory(project_context *ctx, const char *path) {
+#ifdef _WIN32
+    char full_path[4096];
+    if (join_project_path(ctx, path, full_path, sizeof(full_path)) != 0) {
+        return -1;
+    }
+    return mkdir(full_path);
+#else
+#ifdef HAVE_IO_URING
+    if (ctx->ring != NULL) {
+        // The disk is only asked at the flush, so repeats are caught here and fail like mkdir
+        int seen = add_project_directory(ctx, path);
+        if (seen > 0) {
+            errno = EEXIST;
+        }
+        return seen != 0 ? -1 : queue_write(ctx, path, NULL, 0, SIZE_MAX);
+    }
+#endif
+    ctx->stats.syscalls++;
+    return mkdirat(ctx->root_fd, path, 0755);
+#endif
+}
+
+static int disk_write_bytes(project_context *ctx, const char *path, const void *data, size_t length,
+                            struct stat *info) {
+#ifdef _WIN32
+    char full_path[4096];
+    if (join_project_path(ctx, path, full_path, sizeof(full_path)) != 0) {
+        return -1;
+    }
+    FILE *file = fopen(full_path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    int status = fwrite(data, 1, length, file) == length && fflush(file) == 0 ? 0 : -1;
+    if (status == 0 && info != NULL && fstat(fileno(file), info) != 0) {
+        memset(info, 0, sizeof(*info));
+    }
+    if (fclose(file) != 0) {
+        status = -1;
+    }
+    return status;
+#else
+#ifdef HAVE_IO_URING
+    if (ctx->ring != NULL && length <= IO_RING_MAX_WRITE) {
+        // The stat data comes with the completion and goes to the file write_file records next
+        if (info != NULL) {
+            memset(info, 0, sizeof(*info));
+        }
+        return queue_write(ctx, path, data, length, info != NULL ? ctx->file_count : SIZE_MAX);
+    }
+    if (flush_queued_writes(ctx) != 0) {
+        return -1;
+    }
+#endif
+    int fd = openat(ctx->root_fd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ctx->stats.syscalls += 2;  // openat and close
+    if (fd < 0) {
+        return -1;
+    }
+    const char *bytes = data;
+    size_t remaining = length;
+    while (remaining > 0) {
+        ssize_t written = write(fd, bytes, remaining);
+        ctx->stats.syscalls++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+    if (info != NULL) {
+        ctx->stats.syscalls++;
+        if (fstat(fd, info) != 0) {
+            memset(info, 0, sizeof(*info));
+        }
+    }
+    return close(fd);
+#endif
+}
+
+int create_directory(project_context *ctx, const char *path) {
+    if (ctx->render_only) {
+        return 0;
+    }
+    long long start = trace_begin(ctx);
+    int result = make_directory_at(ctx, path);
+    if (result == 0) {
+        ctx->stats.directories_created++;
+    }
+    trace_end(ctx, TRACE_DIRECTORY, path, start);
+    return result;
+}
+
+int write_file(project_context *ctx, const char *path, const char *content, size_t length) {
+    if (ctx->render_only) {
+        if (record_generated_file(ctx, path, content, length, NULL) != 0) {
+            perror("Error recording generated file");
+            return -1;
+        }
+        return 0;
+    }
+
+    long long start = trace_begin(ctx);
+    struct stat info;
+    if (write_bytes_at(ctx, path, content, length, &info) != 0) {
+        fprintf(stderr, "Error writing file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    ctx->stats.files_written++;
+    ctx->stats.bytes_written += length;
+    trace_end(ctx, TRACE_WRITE, path, start);
+
+    if (record_generated_file(ctx, path, content, length, &info) != 0) {
+        perror("Error recording generated file");
+        return -1;
+    }
+    return 0;
+}
+
+static int buffer_append_be32(byte_buffer *buffer, unsigned int value) {
+    unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16),
+                               (unsigned char)(value >> 8), (unsigned char)value };
+    return buffer_append(buffer, bytes, 4);
+}
+
+static const char *const template_variable_names[VAR_COUNT] = {
+    [VAR_PROJECT] = "project",
+    [VAR_APP] = "app",
+    [VAR_APP_UPPER] = "APP",
+    [VAR_LIB] = "lib",
+    [VAR_LIB_UPPER] = "LIB",
+    [VAR_LIB_SOURCES] = "lib_sources",
+    [VAR_APP_SOURCES] = "app_sources",
+    [VAR_TEST_SOURCES] = "test_sources",
+    [VAR_BENCH_SOURCES] = "bench_sources",
+    [VAR_MODULES] = "modules",
+    [VAR_LIB_KIND] = "lib_kind",
+    [VAR_SUBDIRECTORIES] = "subdirectories",
+    [VAR_DEPS] = "deps",
+    [VAR_LINKS] = "links",
+    [VAR_DEP_INCLUDES] = "dep_includes",
+    [VAR_DEP_CALLS] = "dep_calls",
+    [VAR_TEST_LINKS] = "test_links",
+};
+
+// Template pack layout, all integers little-endian u32:
+//   header   magic "PROGENTP", version, template count, index offset, pack size, 2 reserved words
+//   index    per template: path text, then content text, each as
+//            text offset, text length, segment offset, segment count, literal length
+//   segments 12-byte records: offset and length within the text, variable (PACK_LITERAL for text)
+//   texts    template text, each followed by a NUL so literal-only paths can be used as-is
+#define PACK_MAGIC "PROGENTP"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 32
+#define PACK_TEXT_FIELDS 5
+#define PACK_INDEX_ENTRY_SIZE (2 * PACK_TEXT_FIELDS * 4)
+#define PACK_SEGMENT_SIZE 12
+#define PACK_LITERAL 0xFFFFFFFFu
+
+static template_set active_templates;
+
+static unsigned int read_le32(const unsigned char *bytes) {
+    return (unsigned int)bytes[0] | (unsigned int)bytes[1] << 8 | (unsigned int)bytes[2] << 16
+         | (unsigned int)bytes[3] << 24;
+}
+
+static void store_le32(unsigned char *bytes, unsigned int value) {
+    bytes[0] = (unsigned char)value;
+    bytes[1] = (unsigned char)(value >> 8);
+    bytes[2] = (unsigned char)(value >> 16);
+    bytes[3] = (unsigned char)(value >> 24);
+}
+
+static int buffer_append_le32(byte_buffer *buffer, unsigned int value) {
+    unsigned char bytes[4];
+    store_le32(bytes, value);
+    return buffer_append(buffer, bytes, 4);
+}
+
+void *arena_alloc(project_context *ctx, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    arena_block *block = ctx->arena;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > 64 * 1024 ? size : 64 * 1024;
+        if (ctx->spare_arena != NULL && ctx->spare_arena->capacity >= size) {
+            block = ctx->spare_arena;
+            ctx->spare_arena = block->next;
+        } else {
+            block = malloc(sizeof(*block) + capacity);
+            if (block == NULL) {
+                return NULL;
+            }
+            block->capacity = capacity;
+        }
+        block->next = ctx->arena;
+        block->used = 0;
+        ctx->arena = block;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+int compile_template(const char *name, const char *source, byte_buffer *segments, size_t *segment_count,
+                     size_t *literal_length) {
+    *segment_count = 0;
+    *literal_length = 0;
+
+    const char *cursor = source;
+    int status = 0;
+    while (*cursor != '\0' && status == 0) {
+        const char *open = strstr(cursor, "{{");
+        // In a run like "${{{LIB}}" the placeholder starts at the last "{{"
+        while (open != NULL && open[2] == '{') {
+            open++;
+        }
+        const char *literal_end = open != NULL ? open : cursor + strlen(cursor);
+        if (literal_end > cursor) {
+            status |= buffer_append_le32(segments, (unsigned int)(cursor - source));
+            status |= buffer_append_le32(segments, (unsigned int)(literal_end - cursor));
+            status |= buffer_append_le32(segments, PACK_LITERAL);
+            *literal_length += (size_t)(literal_end - cursor);
+            (*segment_count)++;
+        }
+        if (open == NULL) {
+            break;
+        }
+
+        const char *close = strstr(open + 2, "}}");
+        if (close == NULL) {
+            fprintf(stderr, "Unterminated placeholder in template '%s'.\n", name);
+            return -1;
+        }
+        size_t name_length = (size_t)(close - open - 2);
+        int variable = -1;
+        for (int i = 0; i < VAR_COUNT; ++i) {
+            if (strlen(template_variable_names[i]) == name_length
+                && strncmp(open + 2, template_variable_names[i], name_length) == 0) {
+                variable = i;
+                break;
+            }
+        }
+        if (variable < 0) {
+            fprintf(stderr, "Unknown variable '{{%.*s}}' in template '%s'.\n", (int)name_length, open + 2, name);
+            return -1;
+        }
+
+        status |= buffer_append_le32(segments, (unsigned int)(open - source));
+        status |= buffer_append_le32(segments, (unsigned int)(close + 2 - open));
+        status |= buffer_append_le32(segments, (unsigned int)variable);
+        (*segment_count)++;
+        cursor = close + 2;
+    }
+
+    if (status != 0) {
+        perror("Error compiling template");
+    }
+    return status;
+}
+
+int build_template_pack(const template_source *sources, size_t count, byte_buffer *pack) {
+    byte_buffer index = { 0 }, segments = { 0 }, texts = { 0 };
+    int status = 0;
+
+    // Offsets are collected relative to each area and rebased once the area sizes are known
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        const char *parts[2] = { sources[i].path, sources[i].content };
+        for (int p = 0; p < 2 && status == 0; ++p) {
+            size_t segment_start = segments.length, segment_count, literal_length;
+            size_t length = strlen(parts[p]);
+            if (compile_template(sources[i].path, parts[p], &segments, &segment_count, &literal_length) != 0) {
+                status = -1;
+                break;
+            }
+            status |= buffer_append_le32(&index, (unsigned int)texts.length);
+            status |= buffer_append_le32(&index, (unsigned int)length);
+            status |= buffer_append_le32(&index, (unsigned int)segment_start);
+            status |= buffer_append_le32(&index, (unsigned int)segment_count);
+            status |= buffer_append_le32(&index, (unsigned int)literal_length);
+            status |= buffer_append(&texts, parts[p], length + 1);
+        }
+    }
+
+    size_t segments_base = PACK_HEADER_SIZE + index.length;
+    size_t texts_base = segments_base + segments.length;
+    size_t size = texts_base + texts.length;
+    if (status == 0 && size > 0xFFFFFFFFu) {
+        fprintf(stderr, "Template pack exceeds 4 GiB.\n");
+        status = -1;
+    }
+    for (size_t offset = 0; offset < index.length && status == 0; offset += PACK_TEXT_FIELDS * 4) {
+        unsigned char *field = (unsigned char *)index.data + offset;
+        store_le32(field, read_le32(field) + (unsigned int)texts_base);
+        store_le32(field + 8, read_le32(field + 8) + (unsigned int)segments_base);
+    }
+
+    if (status == 0) {
+        pack->length = 0;
+        status |= buffer_append(pack, PACK_MAGIC, 8);
+        status |= buffer_append_le32(pack, PACK_VERSION);
+        status |= buffer_append_le32(pack, (unsigned int)count);
+        status |= buffer_append_le32(pack, PACK_HEADER_SIZE);
+        status |= buffer_append_le32(pack, (unsigned int)size);
+        status |= buffer_append_le32(pack, 0);
+        status |= buffer_append_le32(pack, 0);
+        status |= buffer_append(pack, index.data, index.length);
+        status |= buffer_append(pack, segments.data, segments.length);
+        status |= buffer_append(pack, texts.data, texts.length);
+    }
+
+    free(index.data);
+    free(segments.data);
+    free(texts.data);
+    return status;
+}
+
+// Does a relative path stay inside the project: not absolute and without '..' components?
+static int is_project_path(const char *path) {
+    if (path[0] == '/' || path[0] == '\0') {
+        return 0;
+    }
+#ifdef _WIN32
+    // Backslashes and drive letters lead out of it too
+    if (strchr(path, '\\') != NULL || path[1] == ':') {
+        return 0;
+    }
+#endif
+    const char *part = path;
+    while (*part != '\0') {
+        size_t part_length = strcspn(part, "/");
+        if (part_length == 2 && strncmp(part, "..", 2) == 0) {
+            return 0;
+        }
+        part += part_length;
+        if (*part == '/') {
+            part++;
+        }
+    }
+    return 1;
+}
+
+// Resolve one text of a pack entry, checking every offset against the pack bounds
+static int open_template_text(const unsigned char *data, size_t size, const unsigned char *fields,
+                              template_text *text) {
+    size_t offset = read_le32(fields), length = read_le32(fields + 4);
+    size_t segment_offset = read_le32(fields + 8), segment_count = read_le32(fields + 12);
+    if (offset > size || length >= size - offset || data[offset + length] != '\0'
+        || segment_offset > size || segment_count > (size - segment_offset) / PACK_SEGMENT_SIZE) {
+        return -1;
+    }
+
+    text->text = (const char *)data + offset;
+    text->length = length;
+    text->segments = data + segment_offset;
+    text->segment_count = segment_count;
+    text->literal_length = read_le32(fields + 16);
+
+    size_t literal_length = 0;
+    for (size_t i = 0; i < segment_count; ++i) {
+        const unsigned char *segment = text->segments + i * PACK_SEGMENT_SIZE;
+        size_t start = read_le32(segment), span = read_le32(segment + 4);
+        unsigned int variable = read_le32(segment + 8);
+        if (start > length || span > length - start || (variable != PACK_LITERAL && variable >= VAR_COUNT)) {
+            return -1;
+        }
+        if (variable == PACK_LITERAL) {
+            literal_length += span;
+        }
+    }
+    return literal_length == text->literal_length ? 0 : -1;
+}
+
+int open_template_pack(const char *name, const unsigned char *data, size_t size, pack_template **templates,
+                       size_t *count) {
+    if (size < PACK_HEADER_SIZE || memcmp(data, PACK_MAGIC, 8) != 0) {
+        fprintf(stderr, "'%s' is not a template pack.\n", name);
+        return -1;
+    }
+    if (read_le32(data + 8) != PACK_VERSION) {
+        fprintf(stderr, "Template pack '%s' has unsupported version %u.\n", name, read_le32(data + 8));
+        return -1;
+    }
+
+    size_t entry_count = read_le32(data + 12), index_offset = read_le32(data + 16);
+    if (read_le32(data + 20) != size || index_offset > size
+        || entry_count > (size - index_offset) / PACK_INDEX_ENTRY_SIZE) {
+        fprintf(stderr, "Template pack '%s' is truncated or corrupt.\n", name);
+        return -1;
+    }
+
+    pack_template *entries = calloc(entry_count ? entry_count : 1, sizeof(*entries));
+    if (entries == NULL) {
+        perror("Error opening template pack");
+        return -1;
+    }
+    for (size_t i = 0; i < entry_count; ++i) {
+        const unsigned char *fields = data + index_offset + i * PACK_INDEX_ENTRY_SIZE;
+        if (open_template_text(data, size, fields, &entries[i].path) != 0
+            || open_template_text(data, size, fields + PACK_TEXT_FIELDS * 4, &entries[i].content) != 0) {
+            fprintf(stderr, "Template pack '%s' is truncated or corrupt.\n", name);
+            free(entries);
+            return -1;
+        }
+
+        // Generated paths must stay inside the project and out of .git
+        const char *path = entries[i].path.text;
+        if (!is_project_path(path) || strncmp(path, ".git/", 5) == 0) {
+            fprintf(stderr, "Template pack '%s' contains invalid path '%s'.\n", name, path);
+            free(entries);
+            return -1;
+        }
+    }
+
+    *templates = entries;
+    *count = entry_count;
+    return 0;
+}
+
+// Map a file read-only; the mapping stays alive for the rest of the process
+static const unsigned char *map_file(const char *path, size_t *size) {
+#ifdef _WIN32
+    char *data = read_text_file(path);
+    if (data != NULL) {
+        struct stat info;
+        *size = stat(path, &info) == 0 ? (size_t)info.st_size : strlen(data);
+    }
+    return (const unsigned char *)data;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    } else if (fstat(fd, &info) == 0) {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = saved;
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return data;
+#endif
+}
+
+int write_baked_templates(const char *path) {
+    // Compile every template first, so that one using an unknown variable leaves no header behind
+    byte_buffer segments = { 0 };
+    size_t counts[TEMPLATE_COUNT][2], literal_lengths[TEMPLATE_COUNT][2];
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        const char *parts[2] = { builtin_templates[id].path, builtin_templates[id].content };
+        for (int p = 0; p < 2; ++p) {
+            if (compile_template(builtin_templates[id].path, parts[p], &segments, &counts[id][p],
+                                 &literal_lengths[id][p]) != 0) {
+                free(segments.data);
+                return -1;
+            }
+        }
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Error writing baked templates");
+        free(segments.data);
+        return -1;
+    }
+    fprintf(file, "// Generated by 'progen pack --builtin' from the built-in templates of progen.c; do not edit.\n"
+                  "// The segments are offsets into builtin_templates: regenerate it whenever a template changes.\n\n");
+    fprintf(file, "typedef char baked_templates_match[TEMPLATE_COUNT == %d && VAR_COUNT == %d ? 1 : -1];\n",
+            TEMPLATE_COUNT, VAR_COUNT);
+    const unsigned char *record = (const unsigned char *)segments.data;
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        fprintf(file, "\n// %s: path, then content\nstatic const unsigned char baked_segments_%d[] = {",
+                builtin_templates[id].path, id);
+        for (size_t i = 0; i < counts[id][0] + counts[id][1]; ++i, record += PACK_SEGMENT_SIZE) {
+            unsigned int variable = read_le32(record + 8);
+            fprintf(file, "%sBAKED_SEGMENT(%u, %u, ", i % 4 == 0 ? "\n    " : " ", read_le32(record),
+                    read_le32(record + 4));
+            fprintf(file, variable == PACK_LITERAL ? "PACK_LITERAL)," : "%u),", variable);
+        }
+        fprintf(file, "\n};\n");
+    }
+    fprintf(file, "\n// Length, segment count and literal length of each path and content\n"
+                  "static const baked_template baked_templates[TEMPLATE_COUNT] = {\n");
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        fprintf(file, "    { baked_segments_%d, { %zu, %zu, %zu }, { %zu, %zu, %zu } },\n", id,
+                strlen(builtin_templates[id].path), counts[id][0], literal_lengths[id][0],
+                strlen(builtin_templates[id].content), counts[id][1], literal_lengths[id][1]);
+    }
+    fprintf(file, "};\n");
+
+    int status = ferror(file) ? -1 : 0;
+    if (fclose(file) != 0 || status != 0) {
+        perror("Error writing baked templates");
+        remove(path);
+        status = -1;
+    } else {
+        printf("Baked %d templates into '%s' (%zu segments).\n", TEMPLATE_COUNT, path,
+               segments.length / PACK_SEGMENT_SIZE);
+    }
+    free(segments.data);
+    return status;
+}
+
+#ifdef PROGEN_BAKED_TEMPLATES
+// Segments of the built-in templates compiled ahead of time by 'progen pack --builtin', in the
+// pack's record layout but pointing into builtin_templates rather than holding a copy of them
+typedef struct baked_text {
+    unsigned int length;
+    unsigned int segment_count;
+    unsigned int literal_length;
+} baked_text;
+
+typedef struct baked_template {
+    const unsigned char *segments;  // the path's, then the content's
+    baked_text path;
+    baked_text content;
+} baked_template;
+
+#define BAKED_LE32(value)                                                  \
+    (unsigned char)((value) & 0xFF), (unsigned char)((value) >> 8 & 0xFF), \
+    (unsigned char)((value) >> 16 & 0xFF), (unsigned char)((value) >> 24 & 0xFF)
+#define BAKED_SEGMENT(offset, length, variable) BAKED_LE32(offset), BAKED_LE32(length), BAKED_LE32(variable)
+
+#include "progen_templates.h"
+
+// Point every built-in template at its baked segments; nothing is compiled or compared
+static void open_baked_templates(void) {
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        const baked_template *baked = &baked_templates[id];
+        const baked_text *parts[2] = { &baked->path, &baked->content };
+        const char *texts[2] = { builtin_templates[id].path, builtin_templates[id].content };
+        template_text *targets[2] = { &active_templates.builtin[id].path, &active_templates.builtin[id].content };
+        const unsigned char *segments = baked->segments;
+        for (int p = 0; p < 2; ++p) {
+            targets[p]->text = texts[p];
+            targets[p]->length = parts[p]->length;
+            targets[p]->segments = segments;
+            targets[p]->segment_count = parts[p]->segment_count;
+            targets[p]->literal_length = parts[p]->literal_length;
+            segments += parts[p]->segment_count * PACK_SEGMENT_SIZE;
+        }
+    }
+}
+#endif
+
+int load_templates(options *opts) {
+    // The built-in templates go through the same pack format as user packs, compiled at startup
+    // unless the build baked them in
+    static byte_buffer embedded;
+    static int loaded;
+    pack_template *entries;
+    size_t count;
+#ifdef PROGEN_BAKED_TEMPLATES
+    if (!loaded) {
+        open_baked_templates();
+        loaded = 1;
+    }
+#endif
+    if (!loaded) {
+        if (build_template_pack(builtin_templates, TEMPLATE_COUNT, &embedded) != 0
+            || open_template_pack("<embedded>", (const unsigned char *)embedded.data, embedded.length,
+                                  &entries, &count) != 0) {
+            return -1;
+        }
+        memcpy(active_templates.builtin, entries, sizeof(active_templates.builtin));
+        free(entries);
+        loaded = 1;
+    }
+    opts->templates = &active_templates;
+
+    if (opts->templates_path == NULL) {
+        return 0;
+    }
+
+    size_t size;
+    const unsigned char *data = map_file(opts->templates_path, &size);
+    if (data == NULL) {
+        perror("Error opening template pack");
+        return -1;
+    }
+    if (open_template_pack(opts->templates_path, data, size, &entries, &count) != 0) {
+        return -1;
+    }
+
+    // Entries named like a built-in template replace it; the others are extra files
+    active_templates.extra = calloc(count ? count : 1, sizeof(*active_templates.extra));
+    if (active_templates.extra == NULL) {
+        free(entries);
+        perror("Error opening template pack");
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        int replaced = 0;
+        for (int id = 0; id < TEMPLATE_COUNT && !replaced; ++id) {
+            if (strcmp(entries[i].path.text, builtin_templates[id].path) == 0) {
+                active_templates.builtin[id] = entries[i];
+                replaced = 1;
+            }
+        }
+        if (!replaced) {
+            active_templates.extra[active_templates.extra_count++] = entries[i];
+        }
+    }
+    free(entries);
+    return 0;
+}
+
+const char *render_template(project_context *ctx, const template_text *text, size_t *length) {
+    // Templates without placeholders are emitted straight from the pack
+    if (text->segment_count <= 1 && text->literal_length == text->length) {
+        *length = text->length;
+        return text->text;
+    }
+
+    size_t total = text->literal_length;
+    for (size_t i = 0; i < text->segment_count; ++i) {
+        unsigned int variable = read_le32(text->segments + i * PACK_SEGMENT_SIZE + 8);
+        if (variable != PACK_LITERAL) {
+            total += ctx->variable_lengths[variable];
+        }
+    }
+
+    char *output = arena_alloc(ctx, total + 1);
+    if (output == NULL) {
+        return NULL;
+    }
+    char *cursor = output;
+    for (size_t i = 0; i < text->segment_count; ++i) {
+        const unsigned char *segment = text->segments + i * PACK_SEGMENT_SIZE;
+        unsigned int variable = read_le32(segment + 8);
+        if (variable == PACK_LITERAL) {
+            size_t span = read_le32(segment + 4);
+            memcpy(cursor, text->text + read_le32(segment), span);
+            cursor += span;
+        } else {
+            memcpy(cursor, ctx->variables[variable], ctx->variable_lengths[variable]);
+            cursor += ctx->variable_lengths[variable];
+        }
+    }
+    *cursor = '\0';
+    *length = total;
+    return output;
+}
+
+// Does the project get a built-in template, i.e. are the modules it belongs to selected?
+static int template_enabled(const project_context *ctx, template_id id) {
+    return (template_features[id] & ctx->features) == template_features[id];
+}
+
+// Is path a C or C++ source file directly inside directory?
+static int is_source_file_in(const char *path, const char *directory) {
+    static const char *const extensions[] = { ".c", ".cpp", ".cc", ".cxx", ".c++" };
+    size_t length = strlen(directory);
+    if (strncmp(path, directory, length) != 0 || path[length] != '/' || strchr(path + length + 1, '/') != NULL) {
+        return 0;
+    }
+    const char *extension = strrchr(path + length + 1, '.');
+    for (size_t i = 0; extension != NULL && i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        if (strcmp(extension, extensions[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Copy a value built in a buffer into the arena and make it the value of a variable
+static int set_buffer_variable(project_context *ctx, template_variable variable, const byte_buffer *text) {
+    char *value = arena_alloc(ctx, text->length + 1);
+    if (value == NULL) {
+        return -1;
+    }
+    memcpy(value, text->data ? text->data : "", text->length);
+    value[text->length] = '\0';
+    ctx->variables[variable] = value;
+    ctx->variable_lengths[variable] = text->length;
+    return 0;
+}
+
+// Set a name variable ({{app}}, {{lib}}) and its uppercase counterpart
+static int set_name_variables(project_context *ctx, template_variable variable, template_variable upper_variable,
+                              const char *name) {
+    size_t length = strlen(name);
+    char *upper = arena_alloc(ctx, length + 1);
+    if (upper == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        upper[i] = (char)toupper((unsigned char)name[i]);
+    }
+    upper[length] = '\0';
+    ctx->variables[variable] = name;
+    ctx->variable_lengths[variable] = length;
+    ctx->variables[upper_variable] = upper;
+    ctx->variable_lengths[upper_variable] = length;
+    return 0;
+}
+
+// Fill in the source list variables from the paths every template in effect renders to
+static int set_source_list_variables(project_context *ctx) {
+    const template_set *templates = ctx->opts->templates;
+    size_t count = TEMPLATE_COUNT + templates->extra_count;
+    const char **paths = malloc(count * sizeof(*paths));
+    if (paths == NULL) {
+        return -1;
+    }
+    size_t rendered = 0;
+    for (size_t i = 0; i < TEMPLATE_COUNT + templates->extra_count; ++i) {
+        if (i < TEMPLATE_COUNT && !template_enabled(ctx, (template_id)i)) {
+            continue;
+        }
+        const pack_template *template = i < TEMPLATE_COUNT ? &templates->builtin[i]
+                                                           : &templates->extra[i - TEMPLATE_COUNT];
+        size_t length;
+        paths[rendered] = render_template(ctx, &template->path, &length);
+        if (paths[rendered++] == NULL) {
+            free(paths);
+            return -1;
+        }
+    }
+    count = rendered;
+    qsort(paths, count, sizeof(*paths), compare_strings);
+
+    const template_variable lists[] = { VAR_LIB_SOURCES, VAR_APP_SOURCES, VAR_TEST_SOURCES, VAR_BENCH_SOURCES };
+    const char *directories[] = { ctx->lib_dir, ctx->app_dir, "tests", "bench" };
+    int status = 0;
+    for (size_t list = 0; list < sizeof(lists) / sizeof(lists[0]) && status == 0; ++list) {
+        byte_buffer text = { 0 };
+        size_t prefix = strlen(directories[list]) + 1;
+        for (size_t i = 0; i < count; ++i) {
+            if (is_source_file_in(paths[i], directories[list])) {
+                status |= buffer_append(&text, "  ", 2);
+                status |= buffer_append(&text, paths[i] + prefix, strlen(paths[i] + prefix));
+                status |= buffer_append(&text, "\n", 1);
+            }
+        }
+        status = status == 0 ? set_buffer_variable(ctx, lists[list], &text) : -1;
+        free(text.data);
+    }
+    free(paths);
+    return status;
+}
+
+int set_template_variables(project_context *ctx) {
+    for (int i = 0; i < VAR_COUNT; ++i) {
+        ctx->variables[i] = "";
+        ctx->variable_lengths[i] = 0;
+    }
+    ctx->variables[VAR_PROJECT] = ctx->project_name;
+    ctx->variable_lengths[VAR_PROJECT] = strlen(ctx->project_name);
+    if (set_name_variables(ctx, VAR_APP, VAR_APP_UPPER, ctx->app_dir) != 0 ||
+        set_name_variables(ctx, VAR_LIB, VAR_LIB_UPPER, ctx->lib_dir) != 0) {
+        return -1;
+    }
+
+    byte_buffer modules = { 0 };
+    int status = 0;
+    for (int i = 0; i < FEATURE_COUNT; ++i) {
+        if (ctx->features & FEATURE_BIT(i)) {
+            status |= modules.length != 0 ? buffer_append(&modules, " ", 1) : 0;
+            status |= buffer_append(&modules, feature_names[i], strlen(feature_names[i]));
+        }
+    }
+    status = status == 0 ? set_buffer_variable(ctx, VAR_MODULES, &modules) : -1;
+    free(modules.data);
+
+    // The modules are sources of their own, which an INTERFACE library has no way to compile
+    if (ctx->lib_kind == LIB_HEADER_ONLY && (ctx->features & (FEATURE_BIT(FEATURE_COUNT) - 1))) {
+        fprintf(stderr, "A header-only library cannot have --with modules.\n");
+        return -1;
+    }
+    ctx->variables[VAR_LIB_KIND] = lib_kind_types[ctx->lib_kind];
+    ctx->variable_lengths[VAR_LIB_KIND] = strlen(lib_kind_types[ctx->lib_kind]);
+
+    // A workspace adds one directory per target, in build order, then tests and bench; a project its fixed four
+    byte_buffer subdirectories = { 0 };
+    const workspace *ws = ctx->workspace;
+    const char *directories[] = { ctx->lib_dir, ctx->app_dir, "tests", "bench" };
+    size_t count = ws != NULL ? ws->target_count + 2 : sizeof(directories) / sizeof(directories[0]);
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        const char *name = ws == NULL                ? directories[i]
+                           : i < ws->target_count ? ws->targets[ws->order[i]].name
+                                                  : directories[i - ws->target_count + 2];
+        status |= buffer_append(&subdirectories, "add_subdirectory(", 17);
+        status |= buffer_append(&subdirectories, name, strlen(name));
+        status |= buffer_append(&subdirectories, ")\n", 2);
+    }
+    status = status == 0 ? set_buffer_variable(ctx, VAR_SUBDIRECTORIES, &subdirectories) : -1;
+    free(subdirectories.data);
+    if (status != 0 || set_source_list_variables(ctx) != 0) {
+        return -1;
+    }
+    if (ws == NULL) {
+        ctx->variables[VAR_TEST_LINKS] = ctx->variables[VAR_LIB];
+        ctx->variable_lengths[VAR_TEST_LINKS] = ctx->variable_lengths[VAR_LIB];
+        return 0;
+    }
+
+    // A workspace has a test and a benchmark per library, each linking every library: object files do
+    // not propagate through target_link_libraries, and linking them all needs no dependency walk
+    byte_buffer values[3] = { { 0 } };
+    const char *prefixes[3] = { "  test_", "  bench_", "" };
+    for (size_t i = 0; i < ws->target_count; ++i) {
+        const workspace_target *target = &ws->targets[ws->order[i]];
+        if (target->is_app) {
+            continue;
+        }
+        for (int k = 0; k < 2; ++k) {
+            status |= buffer_append(&values[k], prefixes[k], strlen(prefixes[k]));
+            status |= buffer_append(&values[k], target->name, strlen(target->name));
+            status |= buffer_append(&values[k], ".c\n", 3);
+        }
+        status |= values[2].length != 0 ? buffer_append(&values[2], " ", 1) : 0;
+        status |= buffer_append(&values[2], target->name, strlen(target->name));
+    }
+    const template_variable variables[3] = { VAR_TEST_SOURCES, VAR_BENCH_SOURCES, VAR_TEST_LINKS };
+    for (int i = 0; i < 3; ++i) {
+        status = status == 0 ? set_buffer_variable(ctx, variables[i], &values[i]) : -1;
+        free(values[i].data);
+    }
+    return status;
+}
+
+// Render a template's path and content; the path is returned through path_out
+static const char *render_pack_template(project_context *ctx, const pack_template *template,
+                                        const char **path_out, size_t *length) {
+    long long start = trace_begin(ctx);
+    size_t path_length;
+    const char *path = render_template(ctx, &template->path, &path_length);
+    const char *content = path != NULL ? render_template(ctx, &template->content, length) : NULL;
+    if (content == NULL) {
+        perror("Error rendering template");
+        return NULL;
+    }
+    trace_end(ctx, TRACE_RENDER, path, start);
+    *path_out = path;
+    return content;
+}
+
+int emit_template(project_context *ctx, template_id id) {
+    const char *path;
+    size_t length;
+    const pack_template *template = &ctx->opts->templates->builtin[id];
+    const char *content = render_pack_template(ctx, template, &path, &length);
+    if (content == NULL) {
+        return -1;
+    }
+    // Content without placeholders comes out the same in every project
+    if (content == template->content.text) {
+        return write_shared_file(ctx, path, content, length, template_read_only[id]);
+    }
+    return write_file(ctx, path, content, length);
+}
+
+int make_parent_directories(project_context *ctx, const char *path) {
+    if (ctx->render_only || strchr(path, '/') == NULL) {
+        return 0;
+    }
+    size_t path_length = strlen(path);
+    char *parent = arena_alloc(ctx, path_length + 1);
+    if (parent == NULL) {
+        perror("Error creating directory");
+        return -1;
+    }
+    memcpy(parent, path, path_length + 1);
+    for (char *slash = strchr(parent, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (make_directory_at(ctx, parent) == 0) {
+            ctx->stats.directories_created++;
+        } else if (errno != EEXIST) {
+            fprintf(stderr, "Error creating directory '%s': %s\n", parent, strerror(errno));
+            return -1;
+        }
+        *slash = '/';
+    }
+    return 0;
+}
+
+int emit_extra_templates(project_context *ctx) {
+    const template_set *templates = ctx->opts->templates;
+    for (size_t i = 0; i < templates->extra_count; ++i) {
+        const char *path;
+        size_t length;
+        const pack_template *template = &templates->extra[i];
+        const char *content = render_pack_template(ctx, template, &path, &length);
+        if (content == NULL) {
+            return -1;
+        }
+
+        // User templates may live in directories the built-in layout does not create
+        if (make_parent_directories(ctx, path) != 0) {
+            return -1;
+        }
+
+        int written = content == template->content.text ? write_shared_file(ctx, path, content, length, 0)
+                                                        : write_file(ctx, path, content, length);
+        if (written != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+// Remove everything below dir_fd, leaving the directory itself empty
+static int remove_tree_contents(int dir_fd) {
+    int scan_fd = dup(dir_fd);
+    DIR *dir = scan_fd < 0 ? NULL : fdopendir(scan_fd);
+    if (dir == NULL) {
+        if (scan_fd >= 0) {
+            close(scan_fd);
+        }
+        return -1;
+    }
+    int status = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (unlinkat(dir_fd, entry->d_name, 0) == 0) {
+            continue;
+        }
+        int child = openat(dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child < 0) {
+            status = -1;
+            continue;
+        }
+        status |= remove_tree_contents(child);
+        close(child);
+        status |= unlinkat(dir_fd, entry->d_name, AT_REMOVEDIR);
+    }
+    closedir(dir);
+    return status;
+}
+
+#ifndef __linux__
+// fsync every file and directory below dir_fd, for systems without syncfs
+static int sync_tree(int dir_fd) {
+    int scan_fd = dup(dir_fd);
+    DIR *dir = scan_fd < 0 ? NULL : fdopendir(scan_fd);
+    if (dir == NULL) {
+        if (scan_fd >= 0) {
+            close(scan_fd);
+        }
+        return -1;
+    }
+    int status = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        int child = openat(dir_fd, entry->d_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (child < 0) {
+            status = -1;
+            continue;
+        }
+        struct stat info;
+        if (fstat(child, &info) == 0 && S_ISDIR(info.st_mode)) {
+            status |= sync_tree(child);
+        } else {
+            status |= fsync(child);
+        }
+        close(child);
+    }
+    closedir(dir);
+    return status | fsync(dir_fd);
+}
+#endif
+#endif
+
+static int disk_begin(project_context *ctx) {
+    struct stat info;
+    if (stat(ctx->root_dir, &info) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+
+#ifdef _WIN32
+    // No atomic directory publish here: generate in place
+    ctx->staging_path = malloc(strlen(ctx->root_dir) + 1);
+    if (ctx->staging_path == NULL) {
+        return -1;
+    }
+    strcpy(ctx->staging_path, ctx->root_dir);
+    return mkdir(ctx->root_dir);
+#else
+    // Hidden sibling of the root, so the final rename never crosses a filesystem
+    const char *slash = strrchr(ctx->root_dir, '/');
+    size_t parent_length = slash != NULL ? (size_t)(slash - ctx->root_dir) + 1 : 0;
+    const char *base = ctx->root_dir + parent_length;
+    size_t size = strlen(ctx->root_dir) + sizeof("/..progen-XXXXXX");
+    ctx->staging_path = malloc(size);
+    if (ctx->staging_path == NULL) {
+        return -1;
+    }
+    snprintf(ctx->staging_path, size, "%.*s.%s.progen-XXXXXX", (int)parent_length, ctx->root_dir, base);
+    if (mkdtemp(ctx->staging_path) == NULL) {
+        free(ctx->staging_path);
+        ctx->staging_path = NULL;
+        return -1;
+    }
+    ctx->root_fd = open(ctx->staging_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ctx->stats.syscalls += 4;  // stat, mkdir, open and fchmod
+    if (ctx->root_fd < 0 || fchmod(ctx->root_fd, 0755) != 0) {
+        int saved = errno;
+        discard_staging(ctx);
+        errno = saved;
+        return -1;
+    }
+#ifdef HAVE_IO_URING
+    if (ctx->opts->io == IO_URING) {
+        // Without a ring (a locked-memory limit, say) the project is written one call at a time
+        ctx->ring = acquire_io_ring(&ctx->stats.syscalls);
+    }
+#endif
+    return 0;
+#endif
+}
+
+static int disk_publish(project_context *ctx) {
+#ifdef _WIN32
+    return 0;
+#else
+    if (flush_queued_writes(ctx) != 0) {
+        return -1;
+    }
+    close_io_ring(ctx);
+
+    if (ctx->opts->durable) {
+        // One pass over the finished tree instead of a sync per file
+#ifdef __linux__
+        int synced = syncfs(ctx->root_fd);
+#else
+        int synced = sync_tree(ctx->root_fd);
+#endif
+        ctx->stats.syscalls++;
+        if (synced != 0) {
+            perror("Error syncing project");
+            return -1;
+        }
+    }
+
+#ifdef RENAME_NOREPLACE
+    int renamed = renameat2(AT_FDCWD, ctx->staging_path, AT_FDCWD, ctx->root_dir, RENAME_NOREPLACE);
+    if (renamed != 0 && (errno == ENOSYS || errno == EINVAL)) {
+        renamed = rename(ctx->staging_path, ctx->root_dir);
+    }
+#else
+    int renamed = rename(ctx->staging_path, ctx->root_dir);
+#endif
+    ctx->stats.syscalls++;
+    if (renamed != 0) {
+        if (errno == ENOTEMPTY) {
+            errno = EEXIST;
+        }
+        perror("Error publishing project directory");
+        return -1;
+    }
+
+    if (ctx->opts->durable) {
+        // Persist the rename itself
+        const char *slash = strrchr(ctx->root_dir, '/');
+        char parent[4096];
+        snprintf(parent, sizeof(parent), "%.*s", slash != NULL ? (int)(slash - ctx->root_dir) + 1 : 1,
+                 slash != NULL ? ctx->root_dir : ".");
+        int parent_fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ctx->stats.syscalls += 3;  // open, fsync and close
+        if (parent_fd < 0 || fsync(parent_fd) != 0) {
+            perror("Error syncing parent directory");
+            if (parent_fd >= 0) {
+                close(parent_fd);
+            }
+            return -1;
+        }
+        close(parent_fd);
+    }
+    return 0;
+#endif
+}
+
+static void disk_discard(project_context *ctx) {
+#ifndef _WIN32
+    if (ctx->staging_path == NULL) {
+        return;
+    }
+    if (ctx->root_fd >= 0) {
+        remove_tree_contents(ctx->root_fd);
+    }
+    rmdir(ctx->staging_path);
+#else
+    (void)ctx;
+#endif
+}
+
+// Where a project's directories and files go, by options.output. The tar and memory backends
+// keep everything in the context, so a failed project leaves nothing to discard.
+typedef struct output_backend {
+    int (*begin)(project_context *ctx);
+    int (*make_directory)(project_context *ctx, const char *path);
+    int (*write_bytes)(project_context *ctx, const char *path, const void *data, size_t length, struct stat *info);
+    int (*publish)(project_context *ctx);
+    void (*discard)(project_context *ctx);
+} output_backend;
+
+static const output_backend output_backends[] = {
+    [OUTPUT_DIRECTORY] = { disk_begin, disk_make_directory, disk_write_bytes, disk_publish, disk_discard },
+    [OUTPUT_TAR] = { tar_begin, tar_make_directory, tar_write_bytes, tar_publish, NULL },
+    [OUTPUT_MEMORY] = { memory_begin, memory_make_directory, memory_write_bytes, memory_publish, NULL },
+};
+
+int begin_staging(project_context *ctx) {
+    return output_backends[ctx->opts->output].begin(ctx);
+}
+
+int publish_staging(project_context *ctx) {
+    return output_backends[ctx->opts->output].publish(ctx);
+}
+
+void discard_staging(project_context *ctx) {
+    if (output_backends[ctx->opts->output].discard != NULL) {
+        output_backends[ctx->opts->output].discard(ctx);
+    }
+}
+
+int make_directory_at(project_context *ctx, const char *path) {
+    return output_backends[ctx->opts->output].make_directory(ctx, path);
+}
+
+int write_bytes_at(project_context *ctx, const char *path, const void *data, size_t length,
+                   struct stat *info) {
+    return output_backends[ctx->opts->output].write_bytes(ctx, path, data, length, info);
+}
+
+int create_markdown(project_context *ctx) {
+    // README.md
+    if (emit_template(ctx, TEMPLATE_README) != 0) {
+        return -1;
+    }
+
+    // Create additional markdown files
+    // CONTRIBUTING.md
+    if (emit_template(ctx, TEMPLATE_CONTRIBUTING) != 0) {
+        return -1;
+    }
+
+    // CODE_OF_CONDUCT.md
+    if (emit_template(ctx, TEMPLATE_CODE_OF_CONDUCT) != 0) {
+        return -1;
+    }
+
+    // CHANGELOG.md
+    return emit_template(ctx, TEMPLATE_CHANGELOG);
+}
+
+int initialize_git_repository(project_context *ctx) {
+    const char *path = ctx->staging_path;
+    char command[4096 + 64];
+
+    if (ctx->opts->git == GIT_NONE) {
+        return 0;
+    }
+    // The index needs the stat data of every file, and git the files themselves
+    if (flush_queued_writes(ctx) != 0) {
+        return -1;
+    }
+    if (ctx->opts->git == GIT_NATIVE) {
+        return write_git_repository(ctx);
+    }
+
+    // Initialize Git repository
+    snprintf(command, sizeof(command), "cd %s && git init -b master", path);
+    int result = system(command);
+    if (result != 0) {
+        fprintf(stderr, "Error initializing Git repository.\n");
+        return -1;
+    }
+
+    // Add all files to Git, including .gitignore
+    snprintf(command, sizeof(command), "cd %s && git add .", path);
+    result = system(command);
+    if (result != 0) {
+        fprintf(stderr, "Error adding files to Git repository.\n");
+        return -1;
+    }
+
+    // Optionally commit the initial state
+    snprintf(command, sizeof(command), "cd %s && git commit -m \"Initial commit\"", path);
+    result = system(command);
+    if (result != 0) {
+        fprintf(stderr, "Error committing files to Git repository.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Native git writer. Objects are zlib streams made of stored deflate blocks: git only
+// requires a valid zlib stream, and skipping compression keeps this dependency-free.
+
+typedef struct sha1_context {
+    unsigned int state[5];
+    unsigned long long length;
+    unsigned char block[64];
+    size_t used;
+} sha1_context;
+
+static unsigned int rotate_left(unsigned int value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_transform(sha1_context *sha, const unsigned char *block) {
+    unsigned int w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (unsigned int)block[i * 4] << 24 | (unsigned int)block[i * 4 + 1] << 16
+             | (unsigned int)block[i * 4 + 2] << 8 | (unsigned int)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    unsigned int a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3], e = sha->state[4];
+    for (int i = 0; i < 80; ++i) {
+        unsigned int f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        unsigned int temp = rotate_left(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotate_left(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+}
+
+static void sha1_init(sha1_context *sha) {
+    static const unsigned int initial[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->length = 0;
+    sha->used = 0;
+}
+
+static void sha1_update(sha1_context *sha, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    sha->length += length;
+    while (length > 0) {
+        size_t chunk = 64 - sha->used;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(sha->block + sha->used, bytes, chunk);
+        sha->used += chunk;
+        bytes += chunk;
+        length -= chunk;
+        if (sha->used == 64) {
+            sha1_transform(sha, sha->block);
+            sha->used = 0;
+        }
+    }
+}
+
+static void sha1_final(sha1_context *sha, unsigned char digest[20]) {
+    unsigned long long bits = sha->length * 8;
+    unsigned char padding = 0x80;
+    sha1_update(sha, &padding, 1);
+    padding = 0;
+    while (sha->used != 56) {
+        sha1_update(sha, &padding, 1);
+    }
+    unsigned char length_bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        length_bytes[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha1_update(sha, length_bytes, 8);
+    for (int i = 0; i < 20; ++i) {
+        digest[i] = (unsigned char)(sha->state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static void sha1_to_hex(const unsigned char digest[20], char hex[41]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 20; ++i) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xF];
+    }
+    hex[40] = '\0';
+}
+
+// Hash "<type> <length>\0<data>", the id git gives an object
+static void compute_object_id(const char *type, const void *data, size_t length, unsigned char digest[20]) {
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "%s %zu", type, length) + 1;
+    sha1_context sha;
+    sha1_init(&sha);
+    sha1_update(&sha, header, (size_t)header_length);
+    sha1_update(&sha, data, length);
+    sha1_final(&sha, digest);
+}
+
+// The blob id of a generated file, hashed at most once
+static const unsigned char *generated_file_blob_id(generated_file *file) {
+    if (!file->hashed) {
+        compute_object_id("blob", file->content, file->length, file->blob_id);
+        file->hashed = 1;
+    }
+    return file->blob_id;
+}
+
+// Store data as a loose object under .git/objects; digest is its id, computed first unless known
+static int write_loose_object(project_context *ctx, const char *type, const void *data, size_t length,
+                              unsigned char digest[20], int known) {
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "%s %zu", type, length) + 1;
+    if (!known) {
+        compute_object_id(type, data, length, digest);
+    }
+
+    // zlib header (deflate, 32K window, no compression level hint), stored blocks, adler32
+    byte_buffer stream = { 0 };
+    unsigned char zlib_header[2] = { 0x78, 0x01 };
+    int status = buffer_append(&stream, zlib_header, 2);
+
+    const unsigned char *parts[2] = { (const unsigned char *)header, data };
+    size_t part_lengths[2] = { (size_t)header_length, length };
+    size_t total = part_lengths[0] + part_lengths[1];
+    unsigned int adler_a = 1, adler_b = 0;
+    size_t part = 0, offset = 0, emitted = 0;
+    do {
+        size_t block_length = total - emitted > 65535 ? 65535 : total - emitted;
+        unsigned char block_header[5] = {
+            (unsigned char)(emitted + block_length == total),
+            (unsigned char)block_length, (unsigned char)(block_length >> 8),
+            (unsigned char)~block_length, (unsigned char)(~block_length >> 8)
+        };
+        status |= buffer_append(&stream, block_header, 5);
+        size_t remaining = block_length;
+        while (remaining > 0 && status == 0) {
+            size_t chunk = part_lengths[part] - offset;
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+            const unsigned char *bytes = parts[part] + offset;
+            for (size_t i = 0; i < chunk; ++i) {
+                adler_a = (adler_a + bytes[i]) % 65521;
+                adler_b = (adler_b + adler_a) % 65521;
+            }
+            status |= buffer_append(&stream, bytes, chunk);
+            offset += chunk;
+            remaining -= chunk;
+            if (offset == part_lengths[part]) {
+                part++;
+                offset = 0;
+            }
+        }
+        emitted += block_length;
+    } while (emitted < total && status == 0);
+    status |= buffer_append_be32(&stream, adler_b << 16 | adler_a);
+
+    char hex[41], path[64];
+    sha1_to_hex(digest, hex);
+    if (status == 0) {
+        snprintf(path, sizeof(path), ".git/objects/%.2s", hex);
+        status = make_directory_at(ctx, path) == 0 || errno == EEXIST ? 0 : -1;
+    }
+    if (status == 0) {
+        snprintf(path, sizeof(path), ".git/objects/%.2s/%s", hex, hex + 2);
+        status = write_bytes_at(ctx, path, stream.data, stream.length, NULL);
+    }
+    free(stream.data);
+    return status;
+}
+
+static int compare_generated_paths(const void *left, const void *right) {
+    const generated_file *const *a = left;
+    const generated_file *const *b = right;
+    return strcmp((*a)->path, (*b)->path);
+}
+
+// Write the tree for files[begin, end), all of which share the first prefix_length bytes of
+// their path. Sorting full paths bytewise already yields git's tree entry order.
+static int write_tree(project_context *ctx, generated_file **files, const unsigned char (*blobs)[20],
+                      size_t begin, size_t end, size_t prefix_length, unsigned char digest[20]) {
+    byte_buffer tree = { 0 };
+    int status = 0;
+
+    size_t i = begin;
+    while (i < end && status == 0) {
+        const char *name = files[i]->path + prefix_length;
+        const char *slash = strchr(name, '/');
+        unsigned char entry_digest[20];
+        size_t name_length;
+        const char *mode;
+
+        if (slash == NULL) {
+            mode = "100644 ";
+            name_length = strlen(name);
+            memcpy(entry_digest, blobs[i], 20);
+            i++;
+        } else {
+            mode = "40000 ";
+            name_length = (size_t)(slash - name);
+            size_t group_end = i + 1;
+            while (group_end < end
+                   && strncmp(files[group_end]->path + prefix_length, name, name_length + 1) == 0) {
+                group_end++;
+            }
+            status = write_tree(ctx, files, blobs, i, group_end, prefix_length + name_length + 1,
+                                entry_digest);
+            i = group_end;
+        }
+
+        status |= buffer_append(&tree, mode, strlen(mode));
+        status |= buffer_append(&tree, name, name_length);
+        status |= buffer_append(&tree, "", 1);
+        status |= buffer_append(&tree, entry_digest, 20);
+    }
+
+    if (status == 0) {
+        status = write_loose_object(ctx, "tree", tree.data ? tree.data : "", tree.length, digest, 0);
+    }
+    free(tree.data);
+    return status;
+}
+
+// Write a version 2 index matching the commit, so the work tree starts out clean
+static int write_git_index(project_context *ctx, generated_file **files, const unsigned char (*blobs)[20],
+                           size_t count) {
+    byte_buffer index = { 0 };
+    int status = buffer_append(&index, "DIRC", 4);
+    status |= buffer_append_be32(&index, 2);
+    status |= buffer_append_be32(&index, (unsigned int)count);
+
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        const struct stat *info = &files[i]->info;
+        size_t path_length = strlen(files[i]->path);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_ctime);
+        status |= buffer_append_be32(&index, 0);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_mtime);
+        status |= buffer_append_be32(&index, 0);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_dev);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_ino);
+        status |= buffer_append_be32(&index, 0100644);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_uid);
+        status |= buffer_append_be32(&index, (unsigned int)info->st_gid);
+        status |= buffer_append_be32(&index, (unsigned int)files[i]->length);
+        status |= buffer_append(&index, blobs[i], 20);
+        unsigned char flags[2] = { (unsigned char)((path_length > 0xFFF ? 0xFFF : path_length) >> 8),
+                                   (unsigned char)(path_length > 0xFFF ? 0xFFF : path_length) };
+        status |= buffer_append(&index, flags, 2);
+        status |= buffer_append(&index, files[i]->path, path_length);
+        // Entries are NUL-padded to a multiple of 8 bytes, with at least one NUL
+        static const char padding[8] = { 0 };
+        size_t entry_length = 62 + path_length;
+        status |= buffer_append(&index, padding, 8 - entry_length % 8);
+    }
+
+    if (status == 0) {
+        sha1_context sha;
+        unsigned char digest[20];
+        sha1_init(&sha);
+        sha1_update(&sha, index.data, index.length);
+        sha1_final(&sha, digest);
+        status = buffer_append(&index, digest, 20);
+    }
+
+    if (status == 0) {
+        status = write_bytes_at(ctx, ".git/index", index.data, index.length, NULL);
+    }
+    free(index.data);
+    return status;
+}
+
+// Commit identity: GIT_<ROLE>_NAME/EMAIL, then [user] from the global git config, then a placeholder
+typedef struct git_identity {
+    char name[256];
+    char email[256];
+} git_identity;
+
+static git_identity config_identity;
+
+static void read_config_identity(void) {
+    strcpy(config_identity.name, "progen");
+    strcpy(config_identity.email, "progen@localhost");
+
+    const char *home = getenv("HOME");
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    char paths[2][4096];
+    int path_count = 0;
+    if (xdg != NULL && *xdg != '\0') {
+        snprintf(paths[path_count++], sizeof(paths[0]), "%s/git/config", xdg);
+    } else if (home != NULL) {
+        snprintf(paths[path_count++], sizeof(paths[0]), "%s/.config/git/config", home);
+    }
+    if (home != NULL) {
+        snprintf(paths[path_count++], sizeof(paths[0]), "%s/.gitconfig", home);
+    }
+
+    // Later files take precedence, as in git
+    for (int p = 0; p < path_count; ++p) {
+        char *text = read_text_file(paths[p]);
+        if (text == NULL) {
+            continue;
+        }
+        int in_user = 0;
+        for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+            while (isspace((unsigned char)*line)) {
+                line++;
+            }
+            if (*line == '[') {
+                in_user = strncmp(line, "[user]", 6) == 0;
+                continue;
+            }
+            char *equals = strchr(line, '=');
+            if (!in_user || equals == NULL) {
+                continue;
+            }
+            char *key_end = equals;
+            while (key_end > line && isspace((unsigned char)key_end[-1])) {
+                key_end--;
+            }
+            char *value = equals + 1;
+            while (isspace((unsigned char)*value)) {
+                value++;
+            }
+            size_t value_length = strlen(value);
+            while (value_length > 0 && isspace((unsigned char)value[value_length - 1])) {
+                value[--value_length] = '\0';
+            }
+            size_t key_length = (size_t)(key_end - line);
+            if (key_length == 4 && strncmp(line, "name", 4) == 0) {
+                snprintf(config_identity.name, sizeof(config_identity.name), "%s", value);
+            } else if (key_length == 5 && strncmp(line, "email", 5) == 0) {
+                snprintf(config_identity.email, sizeof(config_identity.email), "%s", value);
+            }
+        }
+        free(text);
+    }
+}
+
+static void resolve_git_identity(const char *role, git_identity *identity) {
+#ifdef _WIN32
+    static int loaded = 0;
+    if (!loaded) {
+        read_config_identity();
+        loaded = 1;
+    }
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, read_config_identity);
+#endif
+
+    char variable[64];
+    snprintf(variable, sizeof(variable), "GIT_%s_NAME", role);
+    const char *name = getenv(variable);
+    snprintf(variable, sizeof(variable), "GIT_%s_EMAIL", role);
+    const char *email = getenv(variable);
+    snprintf(identity->name, sizeof(identity->name), "%s", name ? name : config_identity.name);
+    snprintf(identity->email, sizeof(identity->email), "%s", email ? email : config_identity.email);
+}
+
+int write_git_repository(project_context *ctx) {
+    static const char *const directories[] = { ".git", ".git/objects", ".git/objects/info", ".git/objects/pack",
+                                               ".git/refs", ".git/refs/heads", ".git/refs/tags", ".git/info" };
+    for (size_t i = 0; i < sizeof(directories) / sizeof(directories[0]); ++i) {
+        if (make_directory_at(ctx, directories[i]) != 0) {
+            perror("Error initializing Git repository");
+            return -1;
+        }
+    }
+
+    static const char config[] =
+        "[core]\n"
+        "\trepositoryformatversion = 0\n"
+        "\tfilemode = true\n"
+        "\tbare = false\n"
+        "\tlogallrefupdates = true\n";
+    static const char head[] = "ref: refs/heads/master\n";
+    int status = write_bytes_at(ctx, ".git/config", config, sizeof(config) - 1, NULL);
+    status |= write_bytes_at(ctx, ".git/HEAD", head, sizeof(head) - 1, NULL);
+    if (status != 0) {
+        perror("Error initializing Git repository");
+        return -1;
+    }
+
+    // Blobs come straight from the in-memory copies; nothing is reread from disk
+    size_t count = ctx->file_count;
+    generated_file **files = malloc((count ? count : 1) * sizeof(*files));
+    unsigned char (*blobs)[20] = malloc((count ? count : 1) * sizeof(*blobs));
+    if (files == NULL || blobs == NULL) {
+        free(files);
+        free(blobs);
+        perror("Error initializing Git repository");
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        files[i] = &ctx->files[i];
+    }
+    qsort(files, count, sizeof(*files), compare_generated_paths);
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        memcpy(blobs[i], generated_file_blob_id(files[i]), 20);
+        status = write_loose_object(ctx, "blob", files[i]->content, files[i]->length, blobs[i], 1);
+    }
+    if (status != 0) {
+        free(files);
+        free(blobs);
+        fprintf(stderr, "Error adding files to Git repository.\n");
+        return -1;
+    }
+
+    unsigned char tree[20], commit[20];
+    status = write_tree(ctx, files, (const unsigned char (*)[20])blobs, 0, count, 0, tree);
+    if (status == 0) {
+        status = write_git_index(ctx, files, (const unsigned char (*)[20])blobs, count);
+    }
+    free(files);
+    free(blobs);
+    if (status != 0) {
+        fprintf(stderr, "Error adding files to Git repository.\n");
+        return -1;
+    }
+
+    git_identity author, committer;
+    resolve_git_identity("AUTHOR", &author);
+    resolve_git_identity("COMMITTER", &committer);
+    long long timestamp = ctx->opts->output == OUTPUT_TAR ? tar_output.mtime : (long long)time(NULL);
+
+    char tree_hex[41], commit_text[1024];
+    sha1_to_hex(tree, tree_hex);
+    int commit_length = snprintf(commit_text, sizeof(commit_text),
+                                 "tree %s\n"
+                                 "author %s <%s> %lld +0000\n"
+                                 "committer %s <%s> %lld +0000\n"
+                                 "\n"
+                                 "Initial commit\n",
+                                 tree_hex, author.name, author.email, timestamp,
+                                 committer.name, committer.email, timestamp);
+    if (commit_length < 0 || commit_length >= (int)sizeof(commit_text)
+        || write_loose_object(ctx, "commit", commit_text, (size_t)commit_length, commit, 0) != 0) {
+        fprintf(stderr, "Error committing files to Git repository.\n");
+        return -1;
+    }
+
+    char ref[42];
+    sha1_to_hex(commit, ref);
+    ref[40] = '\n';
+    if (write_bytes_at(ctx, ".git/refs/heads/master", ref, 41, NULL) != 0) {
+        perror("Error committing files to Git repository");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Content-addressed store. Files whose content is the same in every project are kept once under
+// <store>/<xx>/<sha1 rest> (the git blob id of the content) and materialized into each project as
+// a reflink, a hardlink, or, failing both, a plain copy.
+
+#ifndef _WIN32
+// A store object this process has already made sure of, keyed by the template text it holds
+typedef struct store_object {
+    const char *content;
+    char path[4096 + 64];
+    int fd;                 // open read-only, as the FICLONE source
+} store_object;
+
+static store_object store_objects[TEMPLATE_COUNT * 4];
+static size_t store_object_count;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Find or create the store object for a static content, once per content per process. *existed
+// is 0 for the call that created the object, whose file shares it with nothing yet.
+static const store_object *find_store_object(const char *store, const char *content, size_t length,
+                                             int *existed) {
+    *existed = 1;
+    pthread_mutex_lock(&store_lock);
+    for (size_t i = 0; i < store_object_count; ++i) {
+        if (store_objects[i].content == content) {
+            pthread_mutex_unlock(&store_lock);
+            return store_objects[i].fd >= 0 ? &store_objects[i] : NULL;
+        }
+    }
+    if (store_object_count == sizeof(store_objects) / sizeof(store_objects[0])) {
+        pthread_mutex_unlock(&store_lock);
+        return NULL;
+    }
+
+    store_object *object = &store_objects[store_object_count++];
+    object->content = content;
+    object->fd = -1;
+
+    unsigned char digest[20];
+    char hex[41];
+    compute_object_id("blob", content, length, digest);
+    sha1_to_hex(digest, hex);
+
+    char directory[4096 + 8];
+    snprintf(directory, sizeof(directory), "%s/%.2s", store, hex);
+    snprintf(object->path, sizeof(object->path), "%s/%s", directory, hex + 2);
+    if ((mkdir(store, 0755) != 0 && errno != EEXIST) || (mkdir(directory, 0755) != 0 && errno != EEXIST)) {
+        fprintf(stderr, "Error creating store directory '%s': %s\n", directory, strerror(errno));
+        pthread_mutex_unlock(&store_lock);
+        return NULL;
+    }
+
+    object->fd = open(object->path, O_RDONLY | O_CLOEXEC);
+    if (object->fd < 0) {
+        // Publish through a temporary name so concurrent processes only ever see whole objects.
+        // Objects are read-only: with hardlinks, an in-place edit would change every project.
+        char temporary[4096 + 80];
+        snprintf(temporary, sizeof(temporary), "%s/.%s.XXXXXX", directory, hex + 2);
+        int fd = mkstemp(temporary);
+        int written = fd >= 0 && write(fd, content, length) == (ssize_t)length && fchmod(fd, 0444) == 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!written || rename(temporary, object->path) != 0) {
+            fprintf(stderr, "Error adding '%s' to the store: %s\n", object->path, strerror(errno));
+            unlink(temporary);
+        } else {
+            object->fd = open(object->path, O_RDONLY | O_CLOEXEC);
+            *existed = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&store_lock);
+    return object->fd >= 0 ? object : NULL;
+}
+#endif
+
+int write_shared_file(project_context *ctx, const char *path, const char *content, size_t length, int hardlink) {
+#ifndef _WIN32
+    const store_object *object = NULL;
+    int existed = 0;
+    if (ctx->opts->store_path != NULL && length > 0 && !ctx->render_only) {
+        object = find_store_object(ctx->opts->store_path, content, length, &existed);
+    }
+    if (object != NULL) {
+        // Links are made directly, into directories that may still be queued
+        if (flush_queued_writes(ctx) != 0) {
+            return -1;
+        }
+        long long start = trace_begin(ctx);
+        struct stat info;
+        int materialized = 0;
+
+#ifdef FICLONE
+        // A reflink shares the data blocks but keeps a separate, editable inode
+        int fd = openat(ctx->root_fd, path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        ctx->stats.syscalls++;
+        if (fd >= 0) {
+            if (ioctl(fd, FICLONE, object->fd) == 0 && fstat(fd, &info) == 0) {
+                materialized = 1;
+                ctx->stats.shared_reflinks++;
+            }
+            close(fd);
+            ctx->stats.syscalls += 3;  // ioctl, close, and fstat or unlinkat
+            if (!materialized) {
+                unlinkat(ctx->root_fd, path, 0);
+            }
+        }
+#endif
+
+        // A hardlink also saves the inode, but the store copy is read-only
+        if (!materialized && hardlink) {
+            int linked = linkat(AT_FDCWD, object->path, ctx->root_fd, path, 0) == 0;
+            if (linked && fstatat(ctx->root_fd, path, &info, 0) == 0) {
+                materialized = 1;
+                ctx->stats.shared_hardlinks++;
+                ctx->stats.shared_inodes += existed;
+            } else if (linked) {
+                unlinkat(ctx->root_fd, path, 0);
+            }
+            ctx->stats.syscalls += linked ? 2 : 1;
+        }
+
+        if (materialized) {
+            ctx->stats.shared_bytes += existed ? length : 0;
+            ctx->stats.files_written++;
+            trace_end(ctx, TRACE_WRITE, path, start);
+            if (record_generated_file(ctx, path, content, length, &info) != 0) {
+                perror("Error recording generated file");
+                return -1;
+            }
+            return 0;
+        }
+        ctx->stats.shared_copies++;
+    }
+#endif
+    return write_file(ctx, path, content, length);
+}
+
+int create_license_file(project_context *ctx) {
+    // Write the LICENSE file
+    return emit_template(ctx, TEMPLATE_LICENSE);
+}
+
+// Dependency variables of a workspace target: {{deps}}, {{dep_includes}} and {{dep_calls}} from its
+// direct dependencies and, for an app, {{links}} from all of them. The buffers and the reached
+// stamps are reused from target to target.
+static int set_dependency_variables(project_context *ctx, size_t index, byte_buffer values[4], size_t *reached,
+                                    size_t *stack) {
+    const workspace *ws = ctx->workspace;
+    const workspace_target *target = &ws->targets[index];
+    int status = 0;
+    for (int i = 0; i < 4; ++i) {
+        values[i].length = 0;
+    }
+
+    for (size_t k = 0; k < target->dependency_count; ++k) {
+        const char *name = ws->targets[ws->dependencies[target->first_dependency + k]].name;
+        size_t length = strlen(name);
+        status |= values[0].length != 0 ? buffer_append(&values[0], " ", 1) : 0;
+        status |= buffer_append(&values[0], name, length);
+        status |= buffer_append(&values[1], "#include \"", 10);
+        status |= buffer_append(&values[1], name, length);
+        status |= buffer_append(&values[1], "/", 1);
+        status |= buffer_append(&values[1], name, length);
+        status |= buffer_append(&values[1], ".h\"\n", 4);
+        status |= buffer_append(&values[2], "    ", 4);
+        status |= buffer_append(&values[2], name, length);
+        status |= buffer_append(&values[2], "_init();\n", 9);
+    }
+
+    if (target->is_app) {
+        // Mark everything the app reaches, then list it in build order so dependencies come first
+        size_t depth = 0;
+        reached[index] = index + 1;
+        stack[depth++] = index;
+        while (depth > 0) {
+            const workspace_target *top = &ws->targets[stack[--depth]];
+            for (size_t k = 0; k < top->dependency_count; ++k) {
+                size_t dependency = ws->dependencies[top->first_dependency + k];
+                if (reached[dependency] != index + 1) {
+                    reached[dependency] = index + 1;
+                    stack[depth++] = dependency;
+                }
+            }
+        }
+        for (size_t i = 0; i < ws->target_count; ++i) {
+            size_t library = ws->order[i];
+            if (library != index && reached[library] == index + 1) {
+                const char *name = ws->targets[library].name;
+                status |= values[3].length != 0 ? buffer_append(&values[3], " ", 1) : 0;
+                status |= buffer_append(&values[3], name, strlen(name));
+            }
+        }
+    }
+
+    const template_variable variables[4] = { VAR_DEPS, VAR_DEP_INCLUDES, VAR_DEP_CALLS, VAR_LINKS };
+    for (int i = 0; i < 4 && status == 0; ++i) {
+        status = set_buffer_variable(ctx, variables[i], &values[i]);
+    }
+    return status;
+}
+
+// Everything inside a workspace's root: the shared build setup and documents, the spec, and a
+// directory per target in build order
+static int create_workspace_contents(project_context *ctx) {
+    const workspace *ws = ctx->workspace;
+    const char *directories[] = {
+        "CMake", "CMake/Modules", "CMake/Scripts", "CMake/Toolchains", "docs", "tests", "bench",
+    };
+    for (size_t i = 0; i < sizeof(directories) / sizeof(directories[0]); ++i) {
+        if (create_directory(ctx, directories[i]) != 0) {
+            fprintf(stderr, "Error creating directory '%s': %s\n", directories[i], strerror(errno));
+            return -1;
+        }
+    }
+
+    const template_id shared[] = {
+        TEMPLATE_CMAKE_ROOT, TEMPLATE_CMAKE_PRESETS, TEMPLATE_CMAKE_OPTIMIZATION, TEMPLATE_CMAKE_ACCELERATION,
+        TEMPLATE_CMAKE_BUILD_TYPES, TEMPLATE_CMAKE_BUILD_PROFILE, TEMPLATE_BUILD_PROFILE_SCRIPT, TEMPLATE_CLANG_FORMAT,
+        TEMPLATE_CLANG_TIDY, TEMPLATE_GITIGNORE, TEMPLATE_CMAKE_TESTS, TEMPLATE_CMAKE_BENCH, TEMPLATE_BENCH_HARNESS,
+        TEMPLATE_CMAKE_PERF_GATE,
+    };
+    for (size_t i = 0; i < sizeof(shared) / sizeof(shared[0]); ++i) {
+        if (emit_template(ctx, shared[i]) != 0) {
+            return -1;
+        }
+    }
+    if (run_traced_step(ctx, TRACE_MARKDOWN, create_markdown) != 0 ||
+        run_traced_step(ctx, TRACE_LICENSE, create_license_file) != 0) {
+        return -1;
+    }
+
+    // The spec, for 'progen update'; editing it and updating adds or removes targets
+    if (write_file(ctx, WORKSPACE_SPEC, ws->source, ws->source_length) != 0) {
+        return -1;
+    }
+
+    // User templates see the first library and app, so they go before the targets change them
+    if (emit_extra_templates(ctx) != 0) {
+        return -1;
+    }
+
+    byte_buffer values[4] = { { 0 } };
+    size_t *reached = calloc(ws->target_count, sizeof(*reached));
+    size_t *stack = malloc(ws->target_count * sizeof(*stack));
+    int status = reached != NULL && stack != NULL ? 0 : -1;
+    for (size_t i = 0; i < ws->target_count && status == 0; ++i) {
+        size_t index = ws->order[i];
+        const workspace_target *target = &ws->targets[index];
+        status = target->is_app ? set_name_variables(ctx, VAR_APP, VAR_APP_UPPER, target->name)
+                                : set_name_variables(ctx, VAR_LIB, VAR_LIB_UPPER, target->name);
+        if (status == 0) {
+            status = set_dependency_variables(ctx, index, values, reached, stack);
+        }
+        if (status != 0) {
+            perror("Error preparing template variables");
+            break;
+        }
+        if (create_directory(ctx, target->name) != 0) {
+            fprintf(stderr, "Error creating directory '%s': %s\n", target->name, strerror(errno));
+            status = -1;
+            break;
+        }
+
+        const template_id lib_templates[] = {
+            TEMPLATE_WORKSPACE_LIB_HEADER, TEMPLATE_WORKSPACE_LIB_SOURCE, TEMPLATE_WORKSPACE_CMAKE_LIB,
+            TEMPLATE_WORKSPACE_LIB_TEST, TEMPLATE_WORKSPACE_LIB_BENCH,
+        };
+        const template_id app_templates[] = { TEMPLATE_WORKSPACE_APP_SOURCE, TEMPLATE_WORKSPACE_CMAKE_APP };
+        const template_id *ids = target->is_app ? app_templates : lib_templates;
+        size_t id_count = target->is_app ? sizeof(app_templates) / sizeof(app_templates[0])
+                                         : sizeof(lib_templates) / sizeof(lib_templates[0]);
+        for (size_t k = 0; k < id_count && status == 0; ++k) {
+            status = emit_template(ctx, ids[k]);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        free(values[i].data);
+    }
+    free(reached);
+    free(stack);
+    return status;
+}
+
+// Everything inside the project root; paths are relative to the staging directory
+static int create_project_contents(project_context *ctx) {
+    if (ctx->workspace != NULL) {
+        return create_workspace_contents(ctx);
+    }
+
+    const char *app_dir = ctx->app_dir;
+    const char *lib_dir = ctx->lib_dir;
+
+    // Create subdirectories
+    if (create_directory(ctx, lib_dir) != 0) {
+        perror("Error creating library directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, app_dir) != 0) {
+        perror("Error creating application directory");
+        return -1;
+    }
+
+    // Create CMake and Docs directories
+    if (create_directory(ctx, "CMake") != 0) {
+        perror("Error creating CMake directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "CMake/Modules") != 0) {
+        perror("Error creating CMake Modules directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "CMake/Toolchains") != 0) {
+        perror("Error creating CMake Toolchains directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "CMake/Scripts") != 0) {
+        perror("Error creating CMake Scripts directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "docs") != 0) {
+        perror("Error creating docs directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "tests") != 0) {
+        perror("Error creating tests directory");
+        return -1;
+    }
+
+    if (create_directory(ctx, "bench") != 0) {
+        perror("Error creating bench directory");
+        return -1;
+    }
+
+    // Create library header and source files
+    if (emit_template(ctx, TEMPLATE_LIB_HEADER) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_LIB_EXPORT) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_LIB_SOURCE) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_TEST_SOURCE) != 0) {
+        return -1;
+    }
+
+    // Create app source file
+    if (emit_template(ctx, TEMPLATE_APP_SOURCE) != 0) {
+        return -1;
+    }
+
+    // Create CMakeLists.txt files
+
+    // Root CMakeLists.txt
+    if (emit_template(ctx, TEMPLATE_CMAKE_ROOT) != 0) {
+        return -1;
+    }
+
+    // Library CMakeLists.txt
+    if (emit_template(ctx, TEMPLATE_CMAKE_LIB) != 0) {
+        return -1;
+    }
+
+    // Application CMakeLists.txt
+    if (emit_template(ctx, TEMPLATE_CMAKE_APP) != 0) {
+        return -1;
+    }
+
+    // Create test CMakeLists.txt
+    if (emit_template(ctx, TEMPLATE_CMAKE_TESTS) != 0) {
+        return -1;
+    }
+
+    // Create the benchmark harness, a sample benchmark and their CMakeLists.txt
+    if (emit_template(ctx, TEMPLATE_BENCH_HARNESS) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_BENCH_SOURCE) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_BENCH) != 0) {
+        return -1;
+    }
+
+    // Create CMake presets and the optimization module they drive
+    if (emit_template(ctx, TEMPLATE_CMAKE_PRESETS) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_OPTIMIZATION) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_ACCELERATION) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_BUILD_TYPES) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_PERF_GATE) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_CMAKE_BUILD_PROFILE) != 0) {
+        return -1;
+    }
+
+    if (emit_template(ctx, TEMPLATE_BUILD_PROFILE_SCRIPT) != 0) {
+        return -1;
+    }
+
+    // Create the optional library modules selected with --with
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        if (template_features[id] != 0 && template_enabled(ctx, (template_id)id) && emit_template(ctx, id) != 0) {
+            return -1;
+        }
+    }
+
+    // Create .clang-format
+    if (create_clang_format(ctx) != 0) {
+        return -1;
+    }
+
+    // Create .clang-tidy
+    if (create_clang_tidy(ctx) != 0) {
+        return -1;
+    }
+
+    // Create markdown files
+    if (run_traced_step(ctx, TRACE_MARKDOWN, create_markdown) != 0) {
+        return -1;
+    }
+
+    // Create license
+    if (run_traced_step(ctx, TRACE_LICENSE, create_license_file) != 0) {
+        return -1;
+    }
+
+    // Create .gitignore
+    if (emit_template(ctx, TEMPLATE_GITIGNORE) != 0) {
+        return -1;
+    }
+
+    // Create files from user templates
+    return emit_extra_templates(ctx);
+}
+
+int create_project_structure(project_context *ctx) {
+    long long start = trace_begin(ctx);
+    if (set_template_variables(ctx) != 0) {
+        perror("Error preparing template variables");
+        return -1;
+    }
+
+    // Create root directory, as a hidden staging directory that is renamed into place once complete
+    // On failure errno is left as the failing step set it, for 'progen serve' to pass on
+    if (run_traced_step(ctx, TRACE_STAGING, begin_staging) != 0) {
+        int saved = errno;
+        perror("Error creating root directory");
+        errno = saved;
+        return -1;
+    }
+    ctx->stats.directories_created++;
+
+    if (create_project_contents(ctx) != 0 || run_traced_step(ctx, TRACE_MANIFEST, write_project_manifest) != 0
+        || run_traced_step(ctx, TRACE_GIT, initialize_git_repository) != 0
+        || run_traced_step(ctx, TRACE_PUBLISH, publish_staging) != 0) {
+        int saved = errno;
+        discard_staging(ctx);
+        errno = saved;
+        return -1;
+    }
+
+    trace_end(ctx, TRACE_PROJECT, ctx->root_dir, start);
+    return 0;
+}
+
+
+int create_clang_format(project_context *ctx) {
+    // Write the content to the .clang-format file
+    return emit_template(ctx, TEMPLATE_CLANG_FORMAT);
+}
+
+int create_clang_tidy(project_context *ctx) {
+    // Write the content to the .clang-tidy file
+    return emit_template(ctx, TEMPLATE_CLANG_TIDY);
+}
+
+// Project manifest: the names a project was generated with and the git blob id of every generated
+// file, so 'progen update' can tell upstream template changes from local edits.
+
+#define PROJECT_MANIFEST ".progen-manifest"
+
+// One "file" line of a project manifest
+typedef struct manifest_file {
+    const char *path;
+    unsigned char blob_id[20];
+    int seen;               // matched by a rendered file during update
+} manifest_file;
+
+// Parsed project manifest; strings point into the manifest text
+typedef struct project_manifest {
+    const char *project;
+    const char *app;
+    const char *lib;
+    const char *workspace;  // spec of a --workspace project, relative to the project root
+    unsigned int features;  // modules of the 'with' line
+    lib_kind lib_kind;      // the 'lib-kind' line, static when there is none
+    manifest_file *files;   // sorted by path
+    size_t file_count;
+} project_manifest;
+
+// Outcome counters of an update
+typedef struct update_summary {
+    size_t unchanged;
+    size_t updated;
+    size_t created;
+    size_t removed;
+    size_t conflicts;
+} update_summary;
+
+static int append_manifest_header(byte_buffer *text, const char *project, const char *app, const char *lib,
+                                  unsigned int features, lib_kind kind) {
+    const char *parts[] = { "# Written by progen and read by 'progen update'; do not edit.\nversion 1\nproject ",
+                            project, "\napp ", app, "\nlib ", lib, "\n" };
+    int status = 0;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i) {
+        status |= buffer_append(text, parts[i], strlen(parts[i]));
+    }
+
+    // Modules, as a --with list; the line is left out when there are none
+    const char *separator = "with ";
+    for (int i = 0; i < FEATURE_COUNT; ++i) {
+        if (features & FEATURE_BIT(i)) {
+            status |= buffer_append(text, separator, strlen(separator));
+            status |= buffer_append(text, feature_names[i], strlen(feature_names[i]));
+            separator = ",";
+        }
+    }
+    if (features & (FEATURE_BIT(FEATURE_COUNT) - 1)) {
+        status |= buffer_append(text, "\n", 1);
+    }
+    if (kind != LIB_STATIC) {
+        status |= buffer_append(text, "lib-kind ", 9);
+        status |= buffer_append(text, lib_kind_names[kind], strlen(lib_kind_names[kind]));
+        status |= buffer_append(text, "\n", 1);
+    }
+    if (features & FEATURE_BIT(FEATURE_WORKSPACE)) {
+        const char *line = "workspace " WORKSPACE_SPEC "\n";
+        status |= buffer_append(text, line, strlen(line));
+    }
+    return status;
+}
+
+static int append_manifest_entry(byte_buffer *text, const unsigned char blob_id[20], const char *path) {
+    char line[46];
+    memcpy(line, "file ", 5);
+    sha1_to_hex(blob_id, line + 5);
+    line[45] = ' ';
+    int status = buffer_append(text, line, sizeof(line));
+    status |= buffer_append(text, path, strlen(path));
+    return status | buffer_append(text, "\n", 1);
+}
+
+int write_project_manifest(project_context *ctx) {
+    byte_buffer text = { 0 };
+    int status = append_manifest_header(&text, ctx->project_name, ctx->app_dir, ctx->lib_dir, ctx->features,
+                                        ctx->lib_kind);
+    for (size_t i = 0; i < ctx->file_count && status == 0; ++i) {
+        status = append_manifest_entry(&text, generated_file_blob_id(&ctx->files[i]), ctx->files[i].path);
+    }
+
+    char *content = status == 0 ? arena_alloc(ctx, text.length + 1) : NULL;
+    if (content == NULL) {
+        free(text.data);
+        perror("Error writing project manifest");
+        return -1;
+    }
+    memcpy(content, text.data, text.length);
+    content[text.length] = '\0';
+    free(text.data);
+    return write_file(ctx, PROJECT_MANIFEST, content, text.length);
+}
+
+static int compare_manifest_files(const void *left, const void *right) {
+    return strcmp(((const manifest_file *)left)->path, ((const manifest_file *)right)->path);
+}
+
+static int hex_to_blob_id(const char *hex, unsigned char blob_id[20]) {
+    for (int i = 0; i < 40; ++i) {
+        int c = tolower((unsigned char)hex[i]);
+        int value = isdigit(c) ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (value < 0) {
+            return -1;
+        }
+        if (i % 2 == 0) {
+            blob_id[i / 2] = (unsigned char)(value << 4);
+        } else {
+            blob_id[i / 2] |= (unsigned char)value;
+        }
+    }
+    return 0;
+}
+
+// Parse a manifest in place
+static int parse_project_manifest(const char *name, char *text, project_manifest *manifest) {
+    memset(manifest, 0, sizeof(*manifest));
+    size_t capacity = 0;
+    int version = 0, line_number = 0;
+
+    char *line = text;
+    while (line != NULL && *line != '\0') {
+        line_number++;
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        if (strncmp(line, "version ", 8) == 0) {
+            version = atoi(line + 8);
+        } else if (strncmp(line, "project ", 8) == 0) {
+            manifest->project = line + 8;
+        } else if (strncmp(line, "app ", 4) == 0) {
+            manifest->app = line + 4;
+        } else if (strncmp(line, "lib ", 4) == 0) {
+            manifest->lib = line + 4;
+        } else if (strncmp(line, "workspace ", 10) == 0) {
+            manifest->workspace = line + 10;
+            if (!is_project_path(manifest->workspace)) {
+                fprintf(stderr, "%s:%d: invalid workspace path.\n", name, line_number);
+                free(manifest->files);
+                return -1;
+            }
+        } else if (strncmp(line, "with ", 5) == 0) {
+            if (parse_features(line + 5, &manifest->features) != 0) {
+                fprintf(stderr, "%s:%d: unknown module.\n", name, line_number);
+                free(manifest->files);
+                return -1;
+            }
+        } else if (strncmp(line, "lib-kind ", 9) == 0) {
+            if (parse_lib_kind(line + 9, &manifest->lib_kind) != 0) {
+                fprintf(stderr, "%s:%d: unknown library kind.\n", name, line_number);
+                free(manifest->files);
+                return -1;
+            }
+        } else if (strncmp(line, "file ", 5) == 0) {
+            if (strlen(line) < 47 || line[45] != ' ') {
+                fprintf(stderr, "%s:%d: malformed file entry.\n", name, line_number);
+                free(manifest->files);
+                return -1;
+            }
+            if (manifest->file_count == capacity) {
+                capacity = capacity ? capacity * 2 : 32;
+                manifest_file *grown = realloc(manifest->files, capacity * sizeof(*grown));
+                if (grown == NULL) {
+                    free(manifest->files);
+                    return -1;
+                }
+                manifest->files = grown;
+            }
+            manifest_file *file = &manifest->files[manifest->file_count];
+            if (hex_to_blob_id(line + 5, file->blob_id) != 0) {
+                fprintf(stderr, "%s:%d: malformed file entry.\n", name, line_number);
+                free(manifest->files);
+                return -1;
+            }
+            file->path = line + 46;
+            // update removes and replaces these files, so they must not lead out of the project
+            if (!is_project_path(file->path)) {
+                fprintf(stderr, "%s:%d: invalid path '%s'.\n", name, line_number, file->path);
+                free(manifest->files);
+                return -1;
+            }
+            file->seen = 0;
+            manifest->file_count++;
+        } else if (*line != '#' && *line != '\0') {
+            fprintf(stderr, "%s:%d: unexpected line.\n", name, line_number);
+            free(manifest->files);
+            return -1;
+        }
+        line = next;
+    }
+
+    if (version != 1 || manifest->project == NULL || manifest->app == NULL || manifest->lib == NULL) {
+        fprintf(stderr, "%s: not a version 1 progen manifest.\n", name);
+        free(manifest->files);
+        return -1;
+    }
+    qsort(manifest->files, manifest->file_count, sizeof(*manifest->files), compare_manifest_files);
+    return 0;
+}
+
+// Hash a file of the project as it is on disk; returns 1 if it does not exist
+static int hash_project_file(project_context *ctx, const char *path, unsigned char blob_id[20]) {
+#ifdef _WIN32
+    char full_path[4096];
+    if (join_project_path(ctx, path, full_path, sizeof(full_path)) != 0) {
+        return -1;
+    }
+    FILE *file = fopen(full_path, "rb");
+    if (file == NULL) {
+        return errno == ENOENT ? 1 : -1;
+    }
+#else
+    int fd = openat(ctx->root_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 1 : -1;
+    }
+    FILE *file = fdopen(fd, "rb");
+    if (file == NULL) {
+        close(fd);
+        return -1;
+    }
+#endif
+    byte_buffer content = { 0 };
+    char chunk[16384];
+    size_t read_length;
+    int status = 0;
+    while (status == 0 && (read_length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        status = buffer_append(&content, chunk, read_length);
+    }
+    if (ferror(file)) {
+        status = -1;
+    }
+    fclose(file);
+    if (status == 0) {
+        compute_object_id("blob", content.data ? content.data : "", content.length, blob_id);
+    }
+    free(content.data);
+    return status;
+}
+
+// Replace a project file through a temporary name, so readers never see a partial file
+static int replace_project_file(project_context *ctx, const char *path, const char *content, size_t length) {
+    if (make_parent_directories(ctx, path) != 0) {
+        return -1;
+    }
+    size_t path_length = strlen(path);
+    char *temporary = arena_alloc(ctx, path_length + sizeof(".progen-tmp"));
+    if (temporary == NULL) {
+        return -1;
+    }
+    memcpy(temporary, path, path_length);
+    memcpy(temporary + path_length, ".progen-tmp", sizeof(".progen-tmp"));
+    if (write_bytes_at(ctx, temporary, content, length, NULL) != 0) {
+        return -1;
+    }
+#ifdef _WIN32
+    char from[4096], to[4096];
+    if (join_project_path(ctx, temporary, from, sizeof(from)) != 0
+        || join_project_path(ctx, path, to, sizeof(to)) != 0) {
+        return -1;
+    }
+    remove(to);
+    return rename(from, to);
+#else
+    if (renameat(ctx->root_fd, temporary, ctx->root_fd, path) != 0) {
+        int saved = errno;
+        unlinkat(ctx->root_fd, temporary, 0);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+static int remove_project_file(project_context *ctx, const char *path) {
+#ifdef _WIN32
+    char full_path[4096];
+    if (join_project_path(ctx, path, full_path, sizeof(full_path)) != 0) {
+        return -1;
+    }
+    return remove(full_path);
+#else
+    return unlinkat(ctx->root_fd, path, 0);
+#endif
+}
+
+static void report_update(const char *action, const char *path, const char *reason) {
+    if (reason != NULL) {
+        printf("  %-9s %s (%s)\n", action, path, reason);
+    } else {
+        printf("  %-9s %s\n", action, path);
+    }
+}
+
+// Bring one project up to date with the current templates
+static int update_project(const options *opts, const char *directory, int dry_run, update_summary *summary) {
+    char manifest_path[4096];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", directory, PROJECT_MANIFEST);
+    char *manifest_text = read_text_file(manifest_path);
+    if (manifest_text == NULL) {
+        fprintf(stderr, "Error reading '%s': %s\n", manifest_path, strerror(errno));
+        return -1;
+    }
+    project_manifest manifest;
+    if (parse_project_manifest(manifest_path, manifest_text, &manifest) != 0) {
+        free(manifest_text);
+        return -1;
+    }
+
+    // A workspace is regenerated from its spec as it is now, so edits to it add or remove targets
+    workspace ws;
+    memset(&ws, 0, sizeof(ws));
+    if (manifest.workspace != NULL) {
+        char spec_path[4096];
+        snprintf(spec_path, sizeof(spec_path), "%s/%s", directory, manifest.workspace);
+        int options_apply = opts->features == 0 && opts->lib_kind == LIB_KIND_COUNT;
+        if (!options_apply) {
+            fprintf(stderr, "%s: --with and --lib-kind do not apply to workspaces.\n", directory);
+        }
+        if (!options_apply || load_workspace(spec_path, &ws) != 0) {
+            free(manifest.files);
+            free(manifest_text);
+            return -1;
+        }
+    }
+
+    // Render every file in memory; only files whose rendering changed are looked at on disk
+    project_context ctx;
+    if (manifest.workspace != NULL) {
+        init_project_context(&ctx, opts, directory, first_workspace_target(&ws, 1), first_workspace_target(&ws, 0));
+        ctx.workspace = &ws;
+        ctx.features = FEATURE_BIT(FEATURE_WORKSPACE);
+        ctx.lib_kind = LIB_STATIC;
+    } else {
+        init_project_context(&ctx, opts, directory, manifest.app, manifest.lib);
+        ctx.features |= manifest.features;
+        ctx.lib_kind = opts->lib_kind != LIB_KIND_COUNT ? opts->lib_kind : manifest.lib_kind;
+    }
+    ctx.project_name = manifest.project;
+    ctx.render_only = 1;
+    int status = set_template_variables(&ctx) == 0 && create_project_contents(&ctx) == 0 ? 0 : -1;
+    ctx.render_only = 0;
+
+#ifdef _WIN32
+    ctx.staging_path = malloc(strlen(directory) + 1);
+    if (ctx.staging_path != NULL) {
+        strcpy(ctx.staging_path, directory);
+    } else {
+        status = -1;
+    }
+#else
+    ctx.root_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (ctx.root_fd < 0) {
+        fprintf(stderr, "Error opening '%s': %s\n", directory, strerror(errno));
+        status = -1;
+    }
+#endif
+
+    byte_buffer next_manifest = { 0 };
+    update_summary local;
+    memset(&local, 0, sizeof(local));
+    int changed = 0;
+    printf("%s:\n", directory);
+
+    // Manifest entries of the new manifest, written in generation order
+    for (size_t i = 0; i < ctx.file_count && status == 0; ++i) {
+        generated_file *file = &ctx.files[i];
+        const unsigned char *new_id = generated_file_blob_id(file);
+        manifest_file key = { .path = file->path };
+        manifest_file *old = bsearch(&key, manifest.files, manifest.file_count, sizeof(*manifest.files),
+                                     compare_manifest_files);
+        const unsigned char *recorded = new_id;
+
+        if (old != NULL) {
+            old->seen = 1;
+        }
+        if (old != NULL && memcmp(old->blob_id, new_id, 20) == 0) {
+            local.unchanged++;
+        } else {
+            unsigned char disk_id[20];
+            int disk = hash_project_file(&ctx, file->path, disk_id);
+            if (disk < 0) {
+                fprintf(stderr, "Error reading '%s/%s': %s\n", directory, file->path, strerror(errno));
+                status = -1;
+                break;
+            }
+            int missing = disk == 1;
+            if (!missing && memcmp(disk_id, new_id, 20) == 0) {
+                // Already matches the new template, e.g. the same change was made by hand
+                local.unchanged++;
+            } else if (old != NULL && missing) {
+                report_update("conflict", file->path, "deleted locally");
+                local.conflicts++;
+                recorded = old->blob_id;
+            } else if (old != NULL && memcmp(disk_id, old->blob_id, 20) != 0) {
+                report_update("conflict", file->path, "modified locally");
+                local.conflicts++;
+                recorded = old->blob_id;
+            } else if (old == NULL && !missing) {
+                report_update("conflict", file->path, "exists but is not tracked by progen");
+                local.conflicts++;
+                recorded = NULL;
+            } else {
+                report_update(old != NULL ? "update" : "create", file->path, NULL);
+                if (!dry_run && replace_project_file(&ctx, file->path, file->content, file->length) != 0) {
+                    fprintf(stderr, "Error writing '%s/%s': %s\n", directory, file->path, strerror(errno));
+                    status = -1;
+                    break;
+                }
+                if (old != NULL) {
+                    local.updated++;
+                } else {
+                    local.created++;
+                }
+            }
+            changed = 1;
+        }
+
+        if (recorded != NULL) {
+            status |= append_manifest_entry(&next_manifest, recorded, file->path);
+        }
+    }
+
+    // Files whose template is gone upstream
+    for (size_t i = 0; i < manifest.file_count && status == 0; ++i) {
+        manifest_file *old = &manifest.files[i];
+        if (old->seen) {
+            continue;
+        }
+        changed = 1;
+        unsigned char disk_id[20];
+        int disk = hash_project_file(&ctx, old->path, disk_id);
+        if (disk < 0) {
+            fprintf(stderr, "Error reading '%s/%s': %s\n", directory, old->path, strerror(errno));
+            status = -1;
+        } else if (disk == 0 && memcmp(disk_id, old->blob_id, 20) != 0) {
+            report_update("conflict", old->path, "removed upstream but modified locally");
+            local.conflicts++;
+            status |= append_manifest_entry(&next_manifest, old->blob_id, old->path);
+        } else if (disk == 0) {
+            report_update("remove", old->path, NULL);
+            if (!dry_run && remove_project_file(&ctx, old->path) != 0) {
+                fprintf(stderr, "Error removing '%s/%s': %s\n", directory, old->path, strerror(errno));
+                status = -1;
+            }
+            local.removed++;
+        }
+    }
+
+    if (status == 0 && changed && !dry_run) {
+        byte_buffer text = { 0 };
+        status = append_manifest_header(&text, manifest.project, ctx.app_dir, ctx.lib_dir, ctx.features, ctx.lib_kind);
+        status |= buffer_append(&text, next_manifest.data ? next_manifest.data : "", next_manifest.length);
+        if (status == 0 && replace_project_file(&ctx, PROJECT_MANIFEST, text.data, text.length) != 0) {
+            fprintf(stderr, "Error writing '%s': %s\n", manifest_path, strerror(errno));
+            status = -1;
+        }
+        free(text.data);
+    }
+
+    printf("  %zu updated, %zu created, %zu removed, %zu conflict%s, %zu unchanged\n", local.updated,
+           local.created, local.removed, local.conflicts, local.conflicts == 1 ? "" : "s", local.unchanged);
+    summary->unchanged += local.unchanged;
+    summary->updated += local.updated;
+    summary->created += local.created;
+    summary->removed += local.removed;
+    summary->conflicts += local.conflicts;
+
+    free(next_manifest.data);
+    free_project_context(&ctx);
+    free_workspace(&ws);
+    free(manifest.files);
+    free(manifest_text);
+    return status;
+}
+
+int run_update(int argc, char *argv[]) {
+    options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.lib_kind = LIB_KIND_COUNT;     // keep each project's kind unless --lib-kind is given
+    int dry_run = 0, directory_count = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--templates") == 0 && i + 1 < argc) {
+            opts.templates_path = argv[++i];
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = 1;
+        } else if (strncmp(argv[i], "--with=", 7) == 0) {
+            if (parse_features(argv[i] + 7, &opts.features) != 0) {
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--lib-kind=", 11) == 0) {
+            if (parse_lib_kind(argv[i] + 11, &opts.lib_kind) != 0) {
+                return -1;
+            }
+        } else if (argv[i][0] == '-') {
+            directory_count = 0;
+            break;
+        } else {
+            directory_count++;
+        }
+    }
+    if (directory_count == 0) {
+        fprintf(stderr, "Usage: %s update [--templates <pack>] [--with=<module>,...] [--lib-kind=<kind>] [--dry-run]\n"
+                        "           <project-dir>...\n", argv[0]);
+        return -1;
+    }
+    if (load_templates(&opts) != 0) {
+        return -1;
+    }
+
+    update_summary summary;
+    memset(&summary, 0, sizeof(summary));
+    int status = 0;
+    size_t projects = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (argv[i][0] == '-') {
+            i += strcmp(argv[i], "--templates") == 0;
+            continue;
+        }
+        status |= update_project(&opts, argv[i], dry_run, &summary);
+        projects++;
+    }
+
+    if (projects > 1) {
+        printf("%zu projects: %zu updated, %zu created, %zu removed, %zu conflicts, %zu unchanged\n", projects,
+               summary.updated, summary.created, summary.removed, summary.conflicts, summary.unchanged);
+    }
+    return status != 0 || summary.conflicts != 0 ? -1 : 0;
+}
+
+// Benchmark of the generation path: N projects per git and I/O mode, generated one after another
+// into a scratch directory, with per-project latency, file system calls and the process's peak RSS
+
+// Results of one benchmark variant
+typedef struct bench_result {
+    const char *git;
+    const char *io;
+    size_t projects;
+    double wall_seconds;
+    double latency_us[4];   // p50, p90, p99, max
+    double files_per_project;
+    double syscalls_per_project;
+} bench_result;
+
+static int compare_doubles(const void *left, const void *right) {
+    double a = *(const double *)left, b = *(const double *)right;
+    return (a > b) - (a < b);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, size_t count, double fraction) {
+    size_t rank = (size_t)(fraction * (double)count + 0.999999);
+    return sorted[rank == 0 ? 0 : rank > count ? count - 1 : rank - 1];
+}
+
+#ifndef _WIN32
+// Peak RSS of the whole process so far; it never decreases, so it is reported once per run
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes on macOS, kilobytes elsewhere
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Generate the projects of one variant into the empty scratch directory, then empty it again
+static int run_bench_variant(const options *opts, const char *scratch, size_t projects, bench_result *result) {
+    double *latencies = malloc(projects * sizeof(*latencies));
+    if (latencies == NULL) {
+        perror("Error running benchmark");
+        return -1;
+    }
+    generation_stats total;
+    memset(&total, 0, sizeof(total));
+
+    int status = 0;
+    double wall = 0;
+    // Project 0 warms up the page cache, the template pack and the git identity and is not measured
+    for (size_t i = 0; i <= projects && status == 0; ++i) {
+        char root[4096 + 32];
+        snprintf(root, sizeof(root), "%s/p%zu", scratch, i);
+        project_context ctx;
+        init_project_context(&ctx, opts, root, "app", "core");
+        double start = monotonic_seconds();
+        status = create_project_structure(&ctx);
+        double elapsed = monotonic_seconds() - start;
+        if (i > 0) {
+            latencies[i - 1] = elapsed * 1e6;
+            wall += elapsed;
+            add_generation_stats(&total, &ctx.stats);
+        }
+        free_project_context(&ctx);
+    }
+
+    int scratch_fd = open(scratch, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (scratch_fd < 0 || remove_tree_contents(scratch_fd) != 0) {
+        fprintf(stderr, "Error cleaning benchmark directory '%s': %s\n", scratch, strerror(errno));
+        status = -1;
+    }
+    if (scratch_fd >= 0) {
+        close(scratch_fd);
+    }
+
+    if (status == 0) {
+        qsort(latencies, projects, sizeof(*latencies), compare_doubles);
+        result->projects = projects;
+        result->wall_seconds = wall;
+        result->latency_us[0] = percentile(latencies, projects, 0.50);
+        result->latency_us[1] = percentile(latencies, projects, 0.90);
+        result->latency_us[2] = percentile(latencies, projects, 0.99);
+        result->latency_us[3] = latencies[projects - 1];
+        result->files_per_project = (double)total.files_written / (double)projects;
+        result->syscalls_per_project = (double)total.syscalls / (double)projects;
+    }
+    free(latencies);
+    return status;
+}
+
+// Parse a comma-separated list of mode names into their indices in names[], without repeats
+static int parse_bench_modes(const char *list, const char *const *names, size_t name_count, int *modes,
+                             size_t *count) {
+    for (const char *mode = list; *mode != '\0';) {
+        size_t length = strcspn(mode, ",");
+        size_t k = 0;
+        while (k < name_count && (strlen(names[k]) != length || strncmp(mode, names[k], length) != 0)) {
+            k++;
+        }
+        for (size_t i = 0; i < *count && k < name_count; ++i) {
+            k = modes[i] == (int)k ? name_count : k;
+        }
+        if (k == name_count) {
+            fprintf(stderr, "Invalid mode list '%s'.\n", list);
+            return -1;
+        }
+        modes[(*count)++] = (int)k;
+        mode += length + (mode[length] == ',');
+    }
+    return 0;
+}
+
+static int write_bench_json(const char *path, const char *scratch, const bench_result *results, size_t count,
+                            long peak_rss) {
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error writing '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(file, "{\n  \"benchmark\": \"progen-generate\",\n  \"version\": 2,\n  \"scratch\": \"");
+    for (const char *c = scratch; *c != '\0'; ++c) {
+        fprintf(file, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+    }
+    fprintf(file, "\",\n  \"process_peak_rss_kb\": %ld,\n  \"variants\": [\n", peak_rss);
+    for (size_t i = 0; i < count; ++i) {
+        const bench_result *r = &results[i];
+        fprintf(file,
+                "    {\"git\": \"%s\", \"io\": \"%s\", \"projects\": %zu, \"wall_seconds\": %.6f, "
+                "\"projects_per_second\": %.1f, "
+                "\"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+                "\"files_per_project\": %.1f, \"syscalls_per_project\": %.1f}%s\n",
+                r->git, r->io, r->projects, r->wall_seconds, (double)r->projects / r->wall_seconds,
+                r->latency_us[0], r->latency_us[1], r->latency_us[2], r->latency_us[3],
+                r->files_per_project, r->syscalls_per_project, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout && fclose(file) != 0) {
+        fprintf(stderr, "Error writing '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+int run_bench(int argc, char *argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    fprintf(stderr, "%s bench is not supported on Windows.\n", argv[0]);
+    return -1;
+#else
+    options opts;
+    memset(&opts, 0, sizeof(opts));
+    long projects = 200;
+    const char *directory = NULL, *json_path = NULL, *modes = "none,native", *io_modes = "sync";
+    for (int i = 2; i < argc; ++i) {
+        const char *arg = argv[i];
+        if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--projects") == 0) && i + 1 < argc) {
+            char *end;
+            projects = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || projects <= 0) {
+                fprintf(stderr, "Invalid project count '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(arg, "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(arg, "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(arg, "--templates") == 0 && i + 1 < argc) {
+            opts.templates_path = argv[++i];
+        } else if (strcmp(arg, "--store") == 0 && i + 1 < argc) {
+            opts.store_path = argv[++i];
+        } else if (strcmp(arg, "--durable") == 0) {
+            opts.durable = 1;
+        } else if (strncmp(arg, "--git=", 6) == 0) {
+            modes = arg + 6;
+        } else if (strncmp(arg, "--io=", 5) == 0) {
+            io_modes = arg + 5;
+        } else {
+            fprintf(stderr, "Usage: %s bench [-n <projects>] [--dir <scratch>] [--git=none,native,system] "
+                            "[--io=sync,uring] [--json <file>|-] [--templates <pack>] [--store <dir>] [--durable]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+
+    // Every git mode with every I/O mode, the I/O mode varying fastest so the two sit side by side
+    static const char *const git_names[] = { [GIT_NATIVE] = "native", [GIT_SYSTEM] = "system", [GIT_NONE] = "none" };
+    static const char *const io_names[] = { [IO_SYNC] = "sync", [IO_URING] = "uring" };
+    int ios[2], gits[3];
+    size_t io_count = 0, git_count = 0;
+    if (parse_bench_modes(io_modes, io_names, 2, ios, &io_count) != 0
+        || parse_bench_modes(modes, git_names, 3, gits, &git_count) != 0) {
+        return -1;
+    }
+    bench_result results[6];
+    struct { git_mode git; io_mode io; } variants[6];
+    size_t variant_count = 0;
+    for (size_t g = 0; g < git_count; ++g) {
+        for (size_t i = 0; i < io_count; ++i) {
+            memset(&results[variant_count], 0, sizeof(results[variant_count]));
+            results[variant_count].git = git_names[gits[g]];
+            results[variant_count].io = io_names[ios[i]];
+            variants[variant_count].git = (git_mode)gits[g];
+            variants[variant_count++].io = (io_mode)ios[i];
+        }
+    }
+    if (variant_count == 0 || load_templates(&opts) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < io_count; ++i) {
+        if (ios[i] == IO_URING && !io_uring_available()) {
+            fprintf(stderr, "io_uring is not available (%s).\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    // Scratch space on tmpfs where available, so the numbers measure progen rather than the disk
+    if (directory == NULL) {
+        struct stat info;
+        const char *tmpdir = getenv("TMPDIR");
+        directory = stat("/dev/shm", &info) == 0 && S_ISDIR(info.st_mode) ? "/dev/shm"
+                    : tmpdir != NULL ? tmpdir : "/tmp";
+    }
+    char scratch[4096];
+    snprintf(scratch, sizeof(scratch), "%s/progen-bench-XXXXXX", directory);
+    if (mkdtemp(scratch) == NULL) {
+        fprintf(stderr, "Error creating benchmark directory in '%s': %s\n", directory, strerror(errno));
+        return -1;
+    }
+
+    int status = 0;
+    int to_stdout = json_path != NULL && strcmp(json_path, "-") == 0;
+    int saved_stdout = -1;
+    if (!to_stdout) {
+        printf("Generating %ld projects per variant in %s\n", projects, scratch);
+        printf("%-8s %-6s %10s %12s %10s %10s %10s %10s %8s %10s\n", "git", "io", "wall s", "projects/s",
+               "p50 us", "p90 us", "p99 us", "max us", "files", "syscalls");
+    } else {
+        // The JSON owns stdout: anything else written there while generating, such as the output of
+        // the git binary under --git=system, goes to stderr instead
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        if (saved_stdout < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("Error redirecting standard output");
+            status = -1;
+        }
+    }
+    for (size_t i = 0; i < variant_count && status == 0; ++i) {
+        opts.git = variants[i].git;
+        opts.io = variants[i].io;
+        bench_result *r = &results[i];
+        status = run_bench_variant(&opts, scratch, (size_t)projects, r);
+        if (status == 0 && !to_stdout) {
+            printf("%-8s %-6s %10.3f %12.1f %10.1f %10.1f %10.1f %10.1f %8.1f %10.1f\n", r->git, r->io,
+                   r->wall_seconds, (double)r->projects / r->wall_seconds, r->latency_us[0], r->latency_us[1],
+                   r->latency_us[2], r->latency_us[3], r->files_per_project, r->syscalls_per_project);
+        }
+    }
+    if (saved_stdout >= 0) {
+        fflush(stdout);
+        if (dup2(saved_stdout, STDOUT_FILENO) < 0) {
+            perror("Error restoring standard output");
+            status = -1;
+        }
+        close(saved_stdout);
+    }
+    long peak_rss = peak_rss_kb();
+    if (status == 0 && !to_stdout) {
+        printf("Peak RSS of the whole run: %ld KB\n", peak_rss);
+    }
+    if (rmdir(scratch) != 0 && status == 0) {
+        fprintf(stderr, "Error removing benchmark directory '%s': %s\n", scratch, strerror(errno));
+    }
+
+    if (status == 0 && json_path != NULL) {
+        status = write_bench_json(json_path, scratch, results, variant_count, peak_rss);
+    }
+    return status;
+#endif
+}
+
+// Fuzzing of the generation path: projects with random names (long ones, odd but legal
+// characters, names that collide with the fixed layout) generated into memory, each output
+// checked against what the names alone say it must be
+
+// Entries at the root of every project; an app or library named like one of them must fail
+static const char *const fuzz_root_entries[] = {
+    "CMake", "docs", "tests", "bench", ".git", "CMakeLists.txt", "CMakePresets.json", "README.md",
+    "CONTRIBUTING.md", "CODE_OF_CONDUCT.md", "CHANGELOG.md", "LICENSE", ".gitignore", ".clang-format",
+    ".clang-tidy", PROJECT_MANIFEST,
+};
+
+// xorshift64*
+static unsigned long long fuzz_random(unsigned long long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+// Mostly short names, one in ten up to 200 bytes; ASCII letters and digits mixed with
+// punctuation file names allow, spaces and multi-byte UTF-8
+static void fuzz_name(unsigned long long *state, char name[256]) {
+    static const char *const pieces[] = { "_", "-", ".", " ", "+", "@", "=", "\xc3\xa9", "\xc3\x9f",
+                                          "\xe6\x97\xa5\xe6\x9c\xac", "\xf0\x9f\x98\x80" };
+    static const char alphanumerics[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    do {
+        size_t limit = fuzz_random(state) % 10 == 0 ? 1 + fuzz_random(state) % 200 : 1 + fuzz_random(state) % 12;
+        size_t length = 0;
+        while (length < limit) {
+            unsigned long long pick = fuzz_random(state);
+            const char *piece = pieces[pick % (sizeof(pieces) / sizeof(pieces[0]))];
+            if (pick >> 32 & 3) {
+                name[length++] = alphanumerics[(pick >> 40) % (sizeof(alphanumerics) - 1)];
+            } else if (length + strlen(piece) <= limit) {
+                memcpy(name + length, piece, strlen(piece));
+                length += strlen(piece);
+            } else {
+                break;
+            }
+        }
+        name[length] = '\0';
+    } while (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0);
+}
+
+// Check a generated project against its names; returns what is wrong, or NULL
+static const char *check_fuzz_project(project_context *ctx, const char *project, const char *app, const char *lib) {
+    if (strcmp(ctx->root_dir, project) != 0 || strcmp(ctx->memory_root->name, project) != 0) {
+        return "the project directory keeps the trailing slashes it was given with";
+    }
+
+    // Every file reads back exactly as it was written; a later write to the same path shows here
+    for (size_t i = 0; i < ctx->file_count; ++i) {
+        const memory_node *node = find_memory_node(ctx, ctx->files[i].path);
+        if (node == NULL || node->data == NULL || node->length != ctx->files[i].length ||
+            memcmp(node->data, ctx->files[i].content, node->length) != 0) {
+            return "a generated file is missing or differs from what was written";
+        }
+    }
+
+    // The names appear in full in the paths and contents that carry them
+    char path[1024], text[1024];
+    const char *formats[][2] = {
+        { "%s/%s.h", lib }, { "%s/%s.c", lib }, { "%s/CMakeLists.txt", lib }, { "%s/%s.c", app },
+        { "%s/CMakeLists.txt", app }, { "tests/test_%s.c", lib }, { "bench/bench_%s.c", lib },
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        snprintf(path, sizeof(path), formats[i][0], formats[i][1], formats[i][1]);
+        const memory_node *node = find_memory_node(ctx, path);
+        if (node == NULL || node->data == NULL) {
+            return "a file named after the app or library is missing";
+        }
+    }
+    const memory_node *root_cmake = find_memory_node(ctx, "CMakeLists.txt");
+    int length = snprintf(text, sizeof(text), "add_subdirectory(%s)\n", lib);
+    if (root_cmake == NULL || root_cmake->data == NULL || strstr(root_cmake->data, text) == NULL) {
+        return "the root CMakeLists.txt does not add the library directory";
+    }
+    snprintf(path, sizeof(path), "%s/%s.h", lib, lib);
+    const memory_node *header = find_memory_node(ctx, path);
+    length = snprintf(text, sizeof(text), "#ifndef ");
+    for (const char *c = lib; *c != '\0'; ++c) {
+        text[length++] = (char)toupper((unsigned char)*c);
+    }
+    memcpy(text + length, "_H_\n", 5);
+    if (strncmp(header->data, text, strlen(text)) != 0) {
+        return "the library header guard does not match the library name";
+    }
+
+    // The manifest reads back to the same names and files
+    const memory_node *node = find_memory_node(ctx, PROJECT_MANIFEST);
+    char *manifest_text = node != NULL && node->data != NULL ? malloc(node->length + 1) : NULL;
+    if (manifest_text == NULL) {
+        return "the project manifest is missing";
+    }
+    memcpy(manifest_text, node->data, node->length);
+    manifest_text[node->length] = '\0';
+    project_manifest manifest;
+    const char *problem = NULL;
+    if (parse_project_manifest(PROJECT_MANIFEST, manifest_text, &manifest) != 0) {
+        problem = "the project manifest does not parse";
+    } else {
+        if (strcmp(manifest.project, project) != 0 || strcmp(manifest.app, app) != 0 ||
+            strcmp(manifest.lib, lib) != 0 || manifest.features != ctx->features ||
+            manifest.lib_kind != ctx->lib_kind) {
+            problem = "the project manifest does not hold the names, modules and library kind";
+        } else if (manifest.file_count + 1 != ctx->file_count) {
+            problem = "the project manifest does not list every file";
+        }
+        free(manifest.files);
+    }
+    free(manifest_text);
+    if (problem != NULL) {
+        return problem;
+    }
+
+    // The repository holds a blob of every file and a branch
+    if (ctx->opts->git == GIT_NATIVE) {
+        const memory_node *branch = find_memory_node(ctx, ".git/refs/heads/master");
+        if (find_memory_node(ctx, ".git/HEAD") == NULL || branch == NULL || branch->length != 41) {
+            return "the git repository has no branch";
+        }
+        for (size_t i = 0; i < ctx->file_count; ++i) {
+            char hex[41];
+            sha1_to_hex(generated_file_blob_id(&ctx->files[i]), hex);
+            snprintf(path, sizeof(path), ".git/objects/%.2s/%s", hex, hex + 2);
+            if (find_memory_node(ctx, path) == NULL) {
+                return "the git repository misses a blob";
+            }
+        }
+    }
+    return NULL;
+}
+
+int run_fuzz(int argc, char *argv[]) {
+    options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.output = OUTPUT_MEMORY;
+    opts.git = GIT_NONE;
+    long generations = 10000;
+    unsigned long long seed = (unsigned long long)time(NULL);
+    for (int i = 2; i < argc; ++i) {
+        const char *arg = argv[i];
+        char *end = "";
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc) {
+            generations = strtol(argv[++i], &end, 10);
+        } else if (strcmp(arg, "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], &end, 10);
+        } else if (strcmp(arg, "--git=native") == 0) {
+            opts.git = GIT_NATIVE;
+        } else if (strcmp(arg, "--git=none") == 0) {
+            opts.git = GIT_NONE;
+        } else {
+            end = NULL;
+        }
+        if (end == NULL || *end != '\0' || generations <= 0) {
+            fprintf(stderr, "Usage: %s fuzz [-n <generations>] [--seed <n>] [--git=none|native]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (load_templates(&opts) != 0) {
+        return -1;
+    }
+
+    printf("Fuzzing %ld generations with seed %llu\n", generations, seed);
+    fflush(stdout);
+    FILE *report = stderr;
+#ifndef _WIN32
+    // Generations expected to fail print their errors; only the fuzzer's own findings are shown
+    int saved_stderr = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    FILE *saved = saved_stderr >= 0 ? fdopen(saved_stderr, "w") : NULL;
+    if (saved != NULL && null_fd >= 0 && dup2(null_fd, STDERR_FILENO) >= 0) {
+        report = saved;
+    }
+#endif
+
+    unsigned long long state = seed ? seed : 1;
+    size_t rejected = 0, files = 0, failures = 0;
+    long n = 0;
+    double start = monotonic_seconds();
+    for (; n < generations && failures == 0; ++n) {
+        char project[256], app[256], lib[256], directory[259];
+        fuzz_name(&state, project);
+        fuzz_name(&state, app);
+        fuzz_name(&state, lib);
+        unsigned long long pick = fuzz_random(&state);
+        size_t entries = sizeof(fuzz_root_entries) / sizeof(fuzz_root_entries[0]);
+        if (pick % 32 == 0) {
+            strcpy(app, lib);
+        } else if (pick % 32 == 1) {
+            strcpy(pick & 32 ? app : lib, fuzz_root_entries[(pick >> 8) % entries]);
+        }
+        opts.features = (unsigned int)(pick >> 16) & (FEATURE_BIT(FEATURE_COUNT) - 1);
+        opts.lib_kind = (lib_kind)((pick >> 24) % LIB_KIND_COUNT);
+        if (opts.lib_kind == LIB_HEADER_ONLY && opts.features != 0) {
+            opts.lib_kind = LIB_STATIC;
+        }
+        // The project directory is sometimes given with trailing slashes, which name the same project
+        snprintf(directory, sizeof(directory), "%s%.*s", project, (int)((pick >> 32) % 3), "//");
+
+        int expect_failure = strcmp(app, lib) == 0;
+        for (size_t i = 0; i < entries; ++i) {
+            int used = strcmp(fuzz_root_entries[i], ".git") != 0 || opts.git != GIT_NONE;
+            expect_failure |= used && (strcmp(app, fuzz_root_entries[i]) == 0 || strcmp(lib, fuzz_root_entries[i]) == 0);
+        }
+
+        project_context ctx;
+        init_project_context(&ctx, &opts, directory, app, lib);
+        int status = create_project_structure(&ctx);
+        const char *problem = NULL;
+        if (status == 0 && expect_failure) {
+            problem = "generation succeeded although two directories have the same name";
+        } else if (status != 0 && !expect_failure) {
+            problem = "generation failed";
+        } else if (status == 0) {
+            problem = check_fuzz_project(&ctx, project, app, lib);
+            files += ctx.file_count;
+        } else {
+            rejected++;
+        }
+        if (problem != NULL) {
+            fprintf(report, "Generation %ld (seed %llu): %s\n  project '%s'\n  app     '%s'\n  lib     '%s'\n", n, seed,
+                    problem, project, app, lib);
+            failures++;
+        }
+        free_project_context(&ctx);
+    }
+    double elapsed = monotonic_seconds() - start;
+
+#ifndef _WIN32
+    if (report != stderr) {
+        fflush(report);
+        dup2(fileno(report), STDERR_FILENO);
+        fclose(report);
+    } else if (saved != NULL) {
+        fclose(saved);
+    } else if (saved_stderr >= 0) {
+        close(saved_stderr);
+    }
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+#endif
+
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+    printf("%s after %.3f s: %.0f generations/s, %zu files checked, %zu generations rejected as expected\n",
+           failures == 0 ? "Passed" : "Failed", elapsed, (double)n / elapsed, files, rejected);
+    return failures == 0 ? 0 : -1;
+}
+
+
+// Generation server ('progen serve'): a long-running process that answers generation requests on
+// a Unix socket, so callers skip process startup and template loading. The main thread accepts
+// connections and polls the idle ones; a connection with a request waiting is queued for a fixed
+// pool of workers, and handed back to the poll once its request is answered, so clients that keep
+// a connection open do not tie up a worker. Each worker keeps its arena blocks (and, with
+// --io=uring, its ring) from one project to the next.
+//
+// Requests and responses are frames: a 4-byte big-endian length, then that many bytes. A request
+// holds NUL-separated arguments: "generate" <project> <app> <lib> [--with=...] [--git=...]
+// [--io=...] [--durable], or "stats". A response is text, starting with "ok" or "error".
+
+#ifndef _WIN32
+#define SERVE_MAX_REQUEST (64 * 1024)
+#define SERVE_MAX_ARGUMENTS 32
+#define SERVE_MAX_CONNECTIONS 256       // more are answered "error server busy" and closed
+#define SERVE_IDLE_SECONDS 30           // a connection with no request for this long is closed
+#define SERVE_LATENCY_BUCKETS 20        // request latencies in powers of two from 64 us up
+#define SERVE_KEEP_ARENA_BLOCKS 16      // arena blocks a worker keeps between projects
+
+// Counters of a server, reported by the "stats" request
+typedef struct serve_stats {
+    unsigned long long connections;
+    unsigned long long requests;        // generate requests answered
+    unsigned long long errors;          // ... that failed or could not be parsed
+    unsigned long long rejected;        // connections turned away at SERVE_MAX_CONNECTIONS
+    unsigned long long files;
+    unsigned long long bytes;
+    unsigned long long latency_buckets[SERVE_LATENCY_BUCKETS + 1];  // the last one is unbounded
+    double latency_sum_us;
+    int in_flight;
+} serve_stats;
+
+// State shared by the accepting thread and the workers. Every open connection is in exactly one
+// place: the poll set, the ready queue, a worker or the returned list.
+typedef struct server {
+    const options *opts;
+    int uring;              // --io=uring requests can be honoured
+    long workers;
+    int ready[SERVE_MAX_CONNECTIONS];   // connections with a request waiting, as a ring
+    size_t ready_head;
+    size_t ready_count;
+    int returned[SERVE_MAX_CONNECTIONS];    // answered connections going back to the poll set
+    size_t returned_count;
+    size_t open_connections;
+    int stopping;
+    double started;
+    serve_stats stats;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+} server;
+
+// Wakes the accepting thread's poll: written by the signal handler and by workers returning a connection
+static int serve_wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t serve_stop_requested;
+
+static void wake_server(void) {
+    int saved = errno;
+    ssize_t ignored = write(serve_wake_pipe[1], "", 1);   // a full pipe is already a wakeup
+    (void)ignored;
+    errno = saved;
+}
+
+static void serve_stop_signal(int signal_number) {
+    (void)signal_number;
+    serve_stop_requested = 1;
+    wake_server();
+}
+
+// Read exactly length bytes; 0 on success, 1 when the peer closed before the first byte
+static int read_exactly(int fd, void *data, size_t length) {
+    char *bytes = data;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t received = recv(fd, bytes + done, length - done, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return received == 0 && done == 0 ? 1 : -1;
+        }
+        done += (size_t)received;
+    }
+    return 0;
+}
+
+static int send_frame(int fd, const char *text, size_t length) {
+    unsigned char header[4] = { (unsigned char)(length >> 24), (unsigned char)(length >> 16),
+                                (unsigned char)(length >> 8), (unsigned char)length };
+    const char *parts[2] = { (const char *)header, text };
+    size_t lengths[2] = { sizeof(header), length };
+    for (int part = 0; part < 2; ++part) {
+        size_t done = 0;
+        while (done < lengths[part]) {
+            // MSG_NOSIGNAL: a client that went away must not take the server down with SIGPIPE
+            ssize_t sent = send(fd, parts[part] + done, lengths[part] - done, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0) {
+                return -1;
+            }
+            done += (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+static int send_message(int fd, const char *format, ...) {
+    char text[1024];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    if (length < 0) {
+        return -1;
+    }
+    return send_frame(fd, text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+}
+
+static void record_request(server *srv, int failed, double latency_us, const generation_stats *stats) {
+    size_t bucket = 0;
+    while (bucket < SERVE_LATENCY_BUCKETS && latency_us > (double)(64ull << bucket)) {
+        bucket++;
+    }
+    pthread_mutex_lock(&srv->lock);
+    srv->stats.requests++;
+    srv->stats.errors += failed != 0;
+    srv->stats.latency_buckets[bucket]++;
+    srv->stats.latency_sum_us += latency_us;
+    if (stats != NULL) {
+        srv->stats.files += stats->files_written;
+        srv->stats.bytes += stats->bytes_written;
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+// Upper bound of the histogram bucket holding the given fraction of the requests
+static double latency_quantile(const serve_stats *stats, double fraction) {
+    unsigned long long rank = (unsigned long long)(fraction * (double)stats->requests + 0.999999), seen = 0;
+    for (size_t bucket = 0; bucket < SERVE_LATENCY_BUCKETS; ++bucket) {
+        seen += stats->latency_buckets[bucket];
+        if (seen >= rank && rank > 0) {
+            return (double)(64ull << bucket);
+        }
+    }
+    return rank > 0 ? (double)(64ull << SERVE_LATENCY_BUCKETS) : 0;   // past the last bound
+}
+
+// Counters in the Prometheus text format, the histogram buckets cumulative
+static int answer_stats(server *srv, int fd) {
+    pthread_mutex_lock(&srv->lock);
+    serve_stats stats = srv->stats;
+    pthread_mutex_unlock(&srv->lock);
+
+    byte_buffer text = { 0 };
+    char line[128];
+    int status = 0;
+#define STATS_LINE(...) \
+    status |= buffer_append(&text, line, (size_t)snprintf(line, sizeof(line), __VA_ARGS__))
+    STATS_LINE("ok\n");
+    STATS_LINE("progen_uptime_seconds %.3f\n", monotonic_seconds() - srv->started);
+    STATS_LINE("progen_workers %ld\n", srv->workers);
+    STATS_LINE("progen_connections_total %llu\n", stats.connections);
+    STATS_LINE("progen_connections_rejected_total %llu\n", stats.rejected);
+    STATS_LINE("progen_requests_total %llu\n", stats.requests);
+    STATS_LINE("progen_errors_total %llu\n", stats.errors);
+    STATS_LINE("progen_requests_in_flight %d\n", stats.in_flight);
+    STATS_LINE("progen_files_total %llu\n", stats.files);
+    STATS_LINE("progen_bytes_total %llu\n", stats.bytes);
+    unsigned long long cumulative = 0;
+    for (size_t bucket = 0; bucket < SERVE_LATENCY_BUCKETS; ++bucket) {
+        cumulative += stats.latency_buckets[bucket];
+        STATS_LINE("progen_request_latency_us_bucket{le=\"%llu\"} %llu\n", 64ull << bucket, cumulative);
+    }
+    STATS_LINE("progen_request_latency_us_bucket{le=\"+Inf\"} %llu\n", stats.requests);
+    STATS_LINE("progen_request_latency_us_sum %.0f\n", stats.latency_sum_us);
+    STATS_LINE("progen_request_latency_us_count %llu\n", stats.requests);
+    STATS_LINE("progen_request_latency_us{quantile=\"0.5\"} %.0f\n", latency_quantile(&stats, 0.50));
+    STATS_LINE("progen_request_latency_us{quantile=\"0.9\"} %.0f\n", latency_quantile(&stats, 0.90));
+    STATS_LINE("progen_request_latency_us{quantile=\"0.99\"} %.0f\n", latency_quantile(&stats, 0.99));
+#undef STATS_LINE
+    status = status != 0 ? send_message(fd, "error out of memory") : send_frame(fd, text.data, text.length);
+    free(text.data);
+    return status;
+}
+
+// Generate one project from the arguments after "generate", on top of the server's options
+static int answer_generate(server *srv, int fd, char **arguments, int count, arena_block **spare) {
+    double start = monotonic_seconds();
+    options request = *srv->opts;
+    const char *names[3];
+    int name_count = 0;
+    const char *problem = NULL;
+    for (int i = 0; i < count && problem == NULL; ++i) {
+        const char *arg = arguments[i];
+        if (strncmp(arg, "--with=", 7) == 0) {
+            problem = parse_features(arg + 7, &request.features) != 0 ? "unknown module" : NULL;
+        } else if (strncmp(arg, "--lib-kind=", 11) == 0) {
+            problem = parse_lib_kind(arg + 11, &request.lib_kind) != 0 ? "unknown library kind" : NULL;
+        } else if (strcmp(arg, "--git=native") == 0) {
+            request.git = GIT_NATIVE;
+        } else if (strcmp(arg, "--git=system") == 0) {
+            request.git = GIT_SYSTEM;
+        } else if (strcmp(arg, "--git=none") == 0) {
+            request.git = GIT_NONE;
+        } else if (strcmp(arg, "--io=sync") == 0) {
+            request.io = IO_SYNC;
+        } else if (strcmp(arg, "--io=uring") == 0) {
+            request.io = srv->uring ? IO_URING : IO_SYNC;
+        } else if (strcmp(arg, "--durable") == 0) {
+            request.durable = 1;
+        } else if (strncmp(arg, "--", 2) == 0) {
+            problem = "unknown option";
+        } else if (name_count == 3) {
+            problem = "too many arguments";
+        } else {
+            names[name_count++] = arg;
+        }
+    }
+    if (problem == NULL && name_count != 3) {
+        problem = "expected <project> <app> <lib>";
+    }
+    if (problem != NULL) {
+        record_request(srv, 1, (monotonic_seconds() - start) * 1e6, NULL);
+        return send_message(fd, "error %s", problem);
+    }
+
+    project_context ctx;
+    init_project_context(&ctx, &request, names[0], names[1], names[2]);
+    ctx.spare_arena = *spare;
+    int status = create_project_structure(&ctx);
+    int error = errno;
+
+    // Keep a few standard-size blocks for the next project; larger ones were for an outlier
+    *spare = NULL;
+    size_t kept = 0;
+    arena_block *lists[2] = { ctx.arena, ctx.spare_arena };
+    for (int list = 0; list < 2; ++list) {
+        while (lists[list] != NULL) {
+            arena_block *block = lists[list];
+            lists[list] = block->next;
+            if (block->capacity == 64 * 1024 && kept < SERVE_KEEP_ARENA_BLOCKS) {
+                block->next = *spare;
+                *spare = block;
+                kept++;
+            } else {
+                free(block);
+            }
+        }
+    }
+    ctx.arena = ctx.spare_arena = NULL;
+    generation_stats stats = ctx.stats;
+    free_project_context(&ctx);
+
+    double latency_us = (monotonic_seconds() - start) * 1e6;
+    record_request(srv, status != 0, latency_us, status == 0 ? &stats : NULL);
+    if (status != 0) {
+        return send_message(fd, "error could not generate '%s': %s", names[0], strerror(error));
+    }
+    return send_message(fd, "ok %s\nfiles %zu\ndirectories %zu\nbytes %zu\nlatency_us %.0f", names[0],
+                        stats.files_written, stats.directories_created, stats.bytes_written, latency_us);
+}
+
+// Answer the request waiting on a connection; 0 when the connection can take another one
+static int serve_request(server *srv, int fd, char *request, arena_block **spare) {
+    unsigned char header[4];
+    if (read_exactly(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    size_t length = (size_t)header[0] << 24 | (size_t)header[1] << 16 | (size_t)header[2] << 8 | header[3];
+    if (length > SERVE_MAX_REQUEST) {
+        send_message(fd, "error request longer than %d bytes", SERVE_MAX_REQUEST);
+        return -1;
+    }
+    if (read_exactly(fd, request, length) != 0) {
+        return -1;
+    }
+    request[length] = '\0';
+
+    // Split at the NULs; a trailing one is optional
+    char *arguments[SERVE_MAX_ARGUMENTS];
+    int count = 0;
+    for (size_t offset = 0; offset < length && count < SERVE_MAX_ARGUMENTS; ++count) {
+        arguments[count] = request + offset;
+        offset += strlen(request + offset) + 1;
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    srv->stats.in_flight++;
+    pthread_mutex_unlock(&srv->lock);
+    int status;
+    if (count == SERVE_MAX_ARGUMENTS) {
+        status = send_message(fd, "error more than %d arguments", SERVE_MAX_ARGUMENTS - 1);
+    } else if (count >= 1 && strcmp(arguments[0], "generate") == 0) {
+        status = answer_generate(srv, fd, arguments + 1, count - 1, spare);
+    } else if (count == 1 && strcmp(arguments[0], "stats") == 0) {
+        status = answer_stats(srv, fd);
+    } else {
+        status = send_message(fd, "error unknown request '%s'", count > 0 ? arguments[0] : "");
+    }
+    pthread_mutex_lock(&srv->lock);
+    srv->stats.in_flight--;
+    pthread_mutex_unlock(&srv->lock);
+    return status;
+}
+
+static void *serve_worker(void *arg) {
+    server *srv = arg;
+    char *request = malloc(SERVE_MAX_REQUEST + 1);
+    arena_block *spare = NULL;
+    pthread_mutex_lock(&srv->lock);
+    for (;;) {
+        while (srv->ready_count == 0 && !srv->stopping) {
+            pthread_cond_wait(&srv->work, &srv->lock);
+        }
+        if (srv->ready_count == 0) {
+            break;
+        }
+        int fd = srv->ready[srv->ready_head];
+        srv->ready_head = (srv->ready_head + 1) % SERVE_MAX_CONNECTIONS;
+        srv->ready_count--;
+        pthread_mutex_unlock(&srv->lock);
+
+        int status = request != NULL ? serve_request(srv, fd, request, &spare) : send_message(fd, "error out of memory");
+
+        // Once stopping, a connection is closed after its request is answered
+        pthread_mutex_lock(&srv->lock);
+        if (status == 0 && request != NULL && !srv->stopping) {
+            srv->returned[srv->returned_count++] = fd;
+            wake_server();
+        } else {
+            close(fd);
+            srv->open_connections--;
+        }
+    }
+    pthread_mutex_unlock(&srv->lock);
+    free(request);
+    while (spare != NULL) {
+        arena_block *next = spare->next;
+        free(spare);
+        spare = next;
+    }
+    return NULL;
+}
+
+// Bind the socket, replacing a stale one left by a server that did not shut down cleanly
+static int open_serve_socket(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path '%s' is longer than %zu bytes.\n", path, sizeof(address.sun_path) - 1);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    // Only the owner may connect: a request writes wherever it names
+    mode_t mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE) {
+        struct stat info;
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (!live && lstat(path, &info) == 0 && S_ISSOCK(info.st_mode) && unlink(path) == 0) {
+            bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    umask(mask);
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error listening on '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+int run_serve(int argc, char *argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    fprintf(stderr, "%s serve is not supported on Windows.\n", argv[0]);
+    return -1;
+#else
+    // --socket is ours; everything else is a default for the requests, parsed like the command line
+    const char *socket_path = NULL;
+    char **rest = malloc((size_t)argc * sizeof(*rest));
+    if (rest == NULL) {
+        perror("Error starting server");
+        return -1;
+    }
+    int rest_count = 0;
+    rest[rest_count++] = argv[0];
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else {
+            rest[rest_count++] = argv[i];
+        }
+    }
+    options opts;
+    int parsed = parse_options(rest_count, rest, &opts);
+    free(rest);
+    if (parsed != 0 || socket_path == NULL || opts.positional_count != 0 || opts.manifest_path != NULL
+        || opts.workspace_path != NULL || opts.trace_path != NULL || opts.output != OUTPUT_DIRECTORY) {
+        fprintf(stderr, "Usage: %s serve --socket <path> [--jobs <n>] [--templates <pack>] [--store <dir>] "
+                        "[--git=<mode>] [--io=<mode>] [--with=<module>,...] [--durable]\n", argv[0]);
+        return -1;
+    }
+    if (load_templates(&opts) != 0) {
+        return -1;
+    }
+
+    server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.opts = &opts;
+    srv.uring = opts.io == IO_URING || io_uring_available();
+    srv.workers = opts.jobs > 0 ? opts.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (srv.workers < 1) {
+        srv.workers = 1;
+    }
+    // Idle connections and when they last had a request; the first two poll entries are the
+    // listening socket and the wake pipe
+    struct pollfd *fds = malloc((SERVE_MAX_CONNECTIONS + 2) * sizeof(*fds));
+    double *last_active = malloc(SERVE_MAX_CONNECTIONS * sizeof(*last_active));
+    pthread_t *threads = malloc((size_t)srv.workers * sizeof(*threads));
+    if (fds == NULL || last_active == NULL || threads == NULL || pipe(serve_wake_pipe) != 0) {
+        perror("Error starting server");
+        free(fds);
+        free(last_active);
+        free(threads);
+        return -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(serve_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(serve_wake_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+
+    int listen_fd = open_serve_socket(socket_path);
+    if (listen_fd < 0) {
+        close(serve_wake_pipe[0]);
+        close(serve_wake_pipe[1]);
+        free(fds);
+        free(last_active);
+        free(threads);
+        return -1;
+    }
+
+    // Workers start with SIGINT and SIGTERM blocked, so the accepting thread is the one to see them
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_cond_init(&srv.work, NULL);
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+    long started = 0;
+    for (; started < srv.workers; ++started) {
+        if (pthread_create(&threads[started], NULL, serve_worker, &srv) != 0) {
+            break;
+        }
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    int status = 0;
+    if (started == 0) {
+        fprintf(stderr, "Error starting worker threads.\n");
+        status = -1;
+    } else {
+        srv.workers = started;
+        srv.started = monotonic_seconds();
+        printf("Serving on %s with %ld worker%s\n", socket_path, started, started == 1 ? "" : "s");
+        fflush(stdout);
+    }
+
+    fds[0] = (struct pollfd){ listen_fd, POLLIN, 0 };
+    fds[1] = (struct pollfd){ serve_wake_pipe[0], POLLIN, 0 };
+    size_t idle = 0;
+    while (status == 0 && !serve_stop_requested) {
+        if (poll(fds, idle + 2, 1000) < 0 && errno != EINTR) {
+            perror("Error waiting for connections");
+            break;
+        }
+        double now = monotonic_seconds();
+
+        // Answered connections come back to the poll set
+        char drained[64];
+        while (read(serve_wake_pipe[0], drained, sizeof(drained)) > 0) {
+        }
+        pthread_mutex_lock(&srv.lock);
+        for (size_t i = 0; i < srv.returned_count; ++i) {
+            fds[idle + 2] = (struct pollfd){ srv.returned[i], POLLIN, 0 };
+            last_active[idle++] = now;
+        }
+        srv.returned_count = 0;
+
+        // Connections with a request (or a hangup) waiting go to the workers, quiet ones time out
+        for (size_t i = 0; i < idle;) {
+            struct pollfd *entry = &fds[i + 2];
+            int expired = entry->revents == 0 && now - last_active[i] > SERVE_IDLE_SECONDS;
+            if (entry->revents != 0 && entry->fd >= 0) {
+                srv.ready[(srv.ready_head + srv.ready_count++) % SERVE_MAX_CONNECTIONS] = entry->fd;
+                pthread_cond_signal(&srv.work);
+            } else if (expired) {
+                close(entry->fd);
+                srv.open_connections--;
+            }
+            if (entry->revents != 0 || expired) {
+                // Swap-remove; the entry moved in was polled too and is looked at next
+                *entry = fds[idle + 1];
+                last_active[i] = last_active[idle - 1];
+                idle--;
+            } else {
+                ++i;
+            }
+        }
+        int accept_more = srv.open_connections < SERVE_MAX_CONNECTIONS;
+        pthread_mutex_unlock(&srv.lock);
+
+        if ((fds[0].revents & POLLIN) == 0) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            // The client may have given up already; running out of descriptors passes too
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+                perror("Error accepting connection");
+            }
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // Bounds a worker's wait for the rest of a request, and for a client that stopped reading
+        struct timeval timeout = { SERVE_IDLE_SECONDS, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        pthread_mutex_lock(&srv.lock);
+        srv.stats.connections++;
+        srv.stats.rejected += !accept_more;
+        srv.open_connections += accept_more;
+        pthread_mutex_unlock(&srv.lock);
+        if (!accept_more) {
+            // Better a quick refusal the client can retry than an unbounded backlog
+            send_message(fd, "error server busy");
+            close(fd);
+            continue;
+        }
+        fds[idle + 2] = (struct pollfd){ fd, POLLIN, 0 };
+        last_active[idle++] = now;
+    }
+
+    // Stop accepting and close the idle connections; requests already queued are still answered
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&srv.lock);
+    srv.stopping = 1;
+    for (size_t i = 0; i < idle; ++i) {
+        close(fds[i + 2].fd);
+    }
+    for (size_t i = 0; i < srv.returned_count; ++i) {
+        close(srv.returned[i]);
+    }
+    pthread_cond_broadcast(&srv.work);
+    pthread_mutex_unlock(&srv.lock);
+    for (long i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("Stopped after %llu requests (%llu failed) on %llu connections\n", srv.stats.requests,
+           srv.stats.errors, srv.stats.connections);
+    pthread_cond_destroy(&srv.work);
+    pthread_mutex_destroy(&srv.lock);
+    close(serve_wake_pipe[0]);
+    close(serve_wake_pipe[1]);
+    free(fds);
+    free(last_active);
+    free(threads);
+    return status;
+#endif
 }